@@ -0,0 +1,144 @@
+// Measures I420 -> RGBA conversion throughput of every supported kernel
+// at 1080p and 4K, on calling thread only and split into bands on WorkerPool.
+// Also checks every kernel produces exactly the same pixels as scalar one.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "ColorConversion.h"
+#include "WorkerPool.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const double MinBenchSeconds = 1.0;
+
+struct Resolution
+{
+    const char* name;
+    unsigned width;
+    unsigned height;
+};
+
+struct Image
+{
+    Image( unsigned width, unsigned height ) :
+        width( width ), height( height ),
+        yuv( width * height * 3 / 2 ),
+        rgba( width * height * 4 )
+    {
+        //deterministic noise to avoid branch predictor and cache friendly patterns
+        unsigned seed = 12345;
+        for( uint8_t& b: yuv ) {
+            seed = seed * 1103515245 + 12345;
+            b = static_cast<uint8_t>( seed >> 16 );
+        }
+
+        src.y = yuv.data();
+        src.yPitch = width;
+        src.u = src.y + width * height;
+        src.uPitch = width / 2;
+        src.v = src.u + width * height / 4;
+        src.vPitch = width / 2;
+    }
+
+    unsigned width;
+    unsigned height;
+    std::vector<uint8_t> yuv;
+    std::vector<uint8_t> rgba;
+    I420Image src;
+};
+
+void convert( Image* image, const YuvToRgbCoefficients& c, ConversionKernel kernel, WorkerPool* pool )
+{
+    ConvertI420ToRGBA( image->src, image->rgba.data(), image->width * 4,
+                       image->width, image->height, c, kernel, pool );
+}
+
+bool verify( Image* image, const YuvToRgbCoefficients& c, ConversionKernel kernel )
+{
+    convert( image, c, ConversionKernel::Scalar, nullptr );
+    const std::vector<uint8_t> reference = image->rgba;
+
+    //odd width exercises scalar tail of vector kernels
+    memset( image->rgba.data(), 0, image->rgba.size() );
+    ConvertI420ToRGBARows( image->src, image->rgba.data(), image->width * 4,
+                           image->width - 1, 0, image->height, c, kernel );
+    for( unsigned row = 0; row < image->height; ++row ) {
+        const size_t offset = row * image->width * 4;
+        if( 0 != memcmp( &reference[offset], &image->rgba[offset], ( image->width - 1 ) * 4 ) )
+            return false;
+    }
+
+    convert( image, c, kernel, &WorkerPool::instance() );
+    return reference == image->rgba;
+}
+
+double bench( Image* image, const YuvToRgbCoefficients& c, ConversionKernel kernel, WorkerPool* pool )
+{
+    convert( image, c, kernel, pool ); //warm up
+
+    unsigned frames = 0;
+    const Clock::time_point start = Clock::now();
+    double seconds = 0;
+    do {
+        convert( image, c, kernel, pool );
+        ++frames;
+        seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+    } while( seconds < MinBenchSeconds );
+
+    return frames / seconds;
+}
+
+}
+
+int main()
+{
+    const Resolution resolutions[] = {
+        { "1080p", 1920, 1080 },
+        { "4K", 3840, 2160 },
+    };
+    const ConversionKernel kernels[] = {
+        ConversionKernel::Scalar,
+        ConversionKernel::SSE2,
+        ConversionKernel::AVX2,
+        ConversionKernel::NEON,
+    };
+
+    const YuvToRgbCoefficients c =
+        MakeYuvToRgbCoefficients( ColorMatrix::BT709, ColorRange::Limited, 1080 );
+
+    WorkerPool& pool = WorkerPool::instance();
+    printf( "I420 -> RGBA, BT709 limited range, %u thread(s) in pool, best kernel %s\n",
+            pool.concurrency(), ConversionKernelName( BestConversionKernel() ) );
+    printf( "MB/s counts RGBA output bytes\n" );
+
+    for( const Resolution& resolution: resolutions ) {
+        Image image( resolution.width, resolution.height );
+        const double frameMB = image.rgba.size() / ( 1024.0 * 1024.0 );
+
+        for( ConversionKernel kernel: kernels ) {
+            if( !IsConversionKernelSupported( kernel ) )
+                continue;
+
+            if( !verify( &image, c, kernel ) ) {
+                printf( "%-6s %-6s MISMATCH with scalar kernel\n",
+                        resolution.name, ConversionKernelName( kernel ) );
+                return 1;
+            }
+
+            const double singleFps = bench( &image, c, kernel, nullptr );
+            const double pooledFps = bench( &image, c, kernel, &pool );
+            printf( "%-6s %-6s 1 thread %8.1f MB/s %7.1f fps | banded %8.1f MB/s %7.1f fps\n",
+                    resolution.name, ConversionKernelName( kernel ),
+                    singleFps * frameMB, singleFps,
+                    pooledFps * frameMB, pooledFps );
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,312 @@
+// Measures MediaIndex build, sidecar load and lookup times on synthetic
+// one hour variable frame rate MP4 with long GOPs and B-frames,
+// and compares frame seek latency with and without index.
+//
+// Real seek latency is dominated by decoding, so it's modelled as count of
+// frames decoder has to decode for every seek times per frame decode cost:
+// without index every frame step is libvlc seek which decodes from GOP keyframe,
+// with index forward steps inside GOP are done by decoding following frames only.
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "MediaIndex.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const double MinBenchSeconds = 1.0;
+
+const unsigned Timescale = 90000;
+const unsigned MediaSeconds = 3600;
+const unsigned GopSize = 60;
+//IBBP... in decode order
+const unsigned BFrames = 2;
+
+//rough cost of 1080p H.264 software decoding of single frame
+const double DecodeMsPerFrame = 4.0;
+//same limit as player uses for stepping instead of seeking
+const unsigned MaxFrameSteps = 32;
+
+const unsigned RandomSeeks = 100000;
+
+///////////////////////////////////////////////////////////////////////////////
+class Mp4Writer
+{
+public:
+    void u8( uint8_t v )
+        { data.push_back( v ); }
+    void u32( uint32_t v )
+        { for( int s = 24; s >= 0; s -= 8 ) u8( static_cast<uint8_t>( v >> s ) ); }
+    void u64( uint64_t v )
+        { u32( static_cast<uint32_t>( v >> 32 ) ); u32( static_cast<uint32_t>( v ) ); }
+    void tag( const char* t )
+        { for( int i = 0; i < 4; ++i ) u8( static_cast<uint8_t>( t[i] ) ); }
+    void zeros( size_t count )
+        { data.insert( data.end(), count, 0 ); }
+
+    size_t begin( const char* type )
+        { const size_t start = data.size(); u32( 0 ); tag( type ); return start; }
+    void end( size_t start )
+    {
+        const uint32_t size = static_cast<uint32_t>( data.size() - start );
+        for( int i = 0; i < 4; ++i )
+            data[start + i] = static_cast<uint8_t>( size >> ( 24 - 8 * i ) );
+    }
+
+    std::vector<uint8_t> data;
+};
+
+struct Sample
+{
+    uint32_t duration;
+    int32_t compositionOffset;
+    bool keyframe;
+};
+
+//deterministic VFR: phone camera jitter between ~24 and ~36 fps
+std::vector<Sample> makeSamples()
+{
+    std::vector<Sample> samples;
+    unsigned seed = 12345;
+    uint64_t time = 0;
+    while( time < static_cast<uint64_t>( MediaSeconds ) * Timescale ) {
+        seed = seed * 1103515245 + 12345;
+        const uint32_t duration = 2500 + ( seed >> 16 ) % 1250;
+
+        const unsigned gopPosition = samples.size() % GopSize;
+        Sample sample = { duration, 0, 0 == gopPosition };
+        samples.push_back( sample );
+        time += duration;
+    }
+
+    //IBBP GOP: reference frames are presented after B frames decoded after them,
+    //nominal duration is used for offsets, so jitter also shuffles order a bit
+    const int32_t nominal = Timescale / 30;
+    for( size_t i = 0; i < samples.size(); ++i ) {
+        const unsigned gopPosition = i % GopSize;
+        if( 0 == gopPosition )
+            samples[i].compositionOffset = nominal;
+        else if( 1 == gopPosition % ( BFrames + 1 ) )
+            samples[i].compositionOffset = nominal * ( BFrames + 1 );
+        else
+            samples[i].compositionOffset = 0;
+    }
+
+    return samples;
+}
+
+std::vector<uint8_t> makeMp4( const std::vector<Sample>& samples )
+{
+    Mp4Writer w;
+
+    size_t box = w.begin( "ftyp" );
+    w.tag( "isom" ); w.u32( 512 ); w.tag( "isom" ); w.tag( "mp41" );
+    w.end( box );
+
+    //media data is irrelevant for index
+    box = w.begin( "mdat" );
+    w.zeros( 1024 );
+    w.end( box );
+
+    const size_t moov = w.begin( "moov" );
+    box = w.begin( "mvhd" );
+    w.u32( 0 ); w.u32( 0 ); w.u32( 0 ); w.u32( 1000 ); w.u32( MediaSeconds * 1000 );
+    w.zeros( 80 );
+    w.end( box );
+
+    const size_t trak = w.begin( "trak" );
+    const size_t edts = w.begin( "edts" );
+    box = w.begin( "elst" );
+    w.u32( 0 ); w.u32( 1 );
+    w.u32( MediaSeconds * 1000 ); w.u32( Timescale / 30 ); w.u32( 0x00010000 );
+    w.end( box );
+    w.end( edts );
+
+    const size_t mdia = w.begin( "mdia" );
+    box = w.begin( "mdhd" );
+    w.u32( 0 ); w.u32( 0 ); w.u32( 0 ); w.u32( Timescale ); w.u32( MediaSeconds * Timescale );
+    w.u32( 0 );
+    w.end( box );
+
+    box = w.begin( "hdlr" );
+    w.u32( 0 ); w.u32( 0 ); w.tag( "vide" ); w.zeros( 12 ); w.u8( 0 );
+    w.end( box );
+
+    const size_t minf = w.begin( "minf" );
+    const size_t stbl = w.begin( "stbl" );
+
+    box = w.begin( "stts" );
+    w.u32( 0 ); w.u32( static_cast<uint32_t>( samples.size() ) );
+    for( const Sample& sample: samples ) {
+        w.u32( 1 ); w.u32( sample.duration );
+    }
+    w.end( box );
+
+    box = w.begin( "ctts" );
+    w.u32( 0x01000000 ); w.u32( static_cast<uint32_t>( samples.size() ) );
+    for( const Sample& sample: samples ) {
+        w.u32( 1 ); w.u32( static_cast<uint32_t>( sample.compositionOffset ) );
+    }
+    w.end( box );
+
+    box = w.begin( "stss" );
+    const size_t stssCount = w.data.size() + 4;
+    w.u32( 0 ); w.u32( 0 );
+    uint32_t keyframes = 0;
+    for( size_t i = 0; i < samples.size(); ++i ) {
+        if( samples[i].keyframe ) {
+            w.u32( static_cast<uint32_t>( i + 1 ) );
+            ++keyframes;
+        }
+    }
+    for( int i = 0; i < 4; ++i )
+        w.data[stssCount + i] = static_cast<uint8_t>( keyframes >> ( 24 - 8 * i ) );
+    w.end( box );
+
+    w.end( stbl );
+    w.end( minf );
+    w.end( mdia );
+    w.end( trak );
+    w.end( moov );
+
+    return w.data;
+}
+
+template<typename F>
+double measure( F f )
+{
+    f(); //warm up
+
+    unsigned runs = 0;
+    const Clock::time_point start = Clock::now();
+    double seconds = 0;
+    do {
+        f();
+        ++runs;
+        seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+    } while( seconds < MinBenchSeconds );
+
+    return seconds / runs;
+}
+
+struct SeekStats
+{
+    double decodedWithout;
+    double decodedWith;
+};
+
+//targets are visited in order, starting from frame 0
+SeekStats seekStats( const MediaIndex& index, const std::vector<unsigned>& targets )
+{
+    uint64_t decodedWithout = 0;
+    uint64_t decodedWith = 0;
+    unsigned current = 0;
+    for( unsigned target: targets ) {
+        decodedWithout += index.seekCost( target );
+
+        const unsigned steps = index.stepsTo( current, target );
+        decodedWith += steps > 0 && steps <= MaxFrameSteps ? steps : index.seekCost( target );
+
+        current = target;
+    }
+
+    SeekStats stats = {
+        static_cast<double>( decodedWithout ) / targets.size(),
+        static_cast<double>( decodedWith ) / targets.size()
+    };
+    return stats;
+}
+
+void printSeekStats( const char* name, const SeekStats& stats )
+{
+    printf( "%-22s decoded frames/seek %6.1f -> %6.1f, latency ~%7.1f ms -> %7.1f ms\n",
+            name, stats.decodedWithout, stats.decodedWith,
+            stats.decodedWithout * DecodeMsPerFrame, stats.decodedWith * DecodeMsPerFrame );
+}
+
+}
+
+int main()
+{
+    //sidecar cache directory is created by MediaIndex itself
+    const std::string mediaPath = "media_index_bench.mp4";
+    const std::string cacheDir = "media_index_bench.cache";
+
+    const std::vector<Sample> samples = makeSamples();
+    const std::vector<uint8_t> mp4 = makeMp4( samples );
+
+    FILE* file = fopen( mediaPath.c_str(), "wb" );
+    if( !file || 1 != fwrite( mp4.data(), mp4.size(), 1, file ) ) {
+        printf( "failed to write %s\n", mediaPath.c_str() );
+        return 1;
+    }
+    fclose( file );
+
+    std::shared_ptr<MediaIndex> index = MediaIndex::build( mediaPath );
+    if( !index || index->frameCount() != samples.size() ) {
+        printf( "failed to index %s\n", mediaPath.c_str() );
+        return 1;
+    }
+
+    printf( "%u frames, %u s, GOP %u, moov %.1f MB\n",
+            index->frameCount(), MediaSeconds, GopSize, mp4.size() / ( 1024.0 * 1024.0 ) );
+
+    //frame numbers from constant frame rate math, as used without index
+    const double fps = index->frameCount() * 1000000.0 / index->frameTime( index->frameCount() - 1 );
+    unsigned misnumbered = 0;
+    for( unsigned frame = 0; frame < index->frameCount(); ++frame ) {
+        const int64_t timeMs = index->frameTime( frame ) / 1000;
+        if( static_cast<unsigned>( timeMs / ( 1000.0 / fps ) + 0.5 ) != frame )
+            ++misnumbered;
+    }
+    printf( "frame numbers from average fps %.2f wrong for %.1f%% of frames\n",
+            fps, 100.0 * misnumbered / index->frameCount() );
+
+    const double buildSeconds = measure( [&] () { MediaIndex::build( mediaPath ); } );
+    printf( "build from MP4           %8.2f ms\n", buildSeconds * 1000 );
+
+    MediaIndex::open( mediaPath, cacheDir ); //makes sidecar
+    const double loadSeconds = measure( [&] () { MediaIndex::open( mediaPath, cacheDir ); } );
+    printf( "load mapped sidecar      %8.2f ms\n", loadSeconds * 1000 );
+
+    std::vector<int64_t> times( RandomSeeks );
+    std::vector<unsigned> randomTargets( RandomSeeks );
+    unsigned seed = 54321;
+    const int64_t lastTime = index->frameTime( index->frameCount() - 1 );
+    for( unsigned i = 0; i < RandomSeeks; ++i ) {
+        seed = seed * 1103515245 + 12345;
+        times[i] = static_cast<int64_t>( ( seed >> 8 ) % static_cast<unsigned>( lastTime / 1000 ) ) * 1000;
+        seed = seed * 1103515245 + 12345;
+        randomTargets[i] = ( seed >> 8 ) % index->frameCount();
+    }
+
+    unsigned sink = 0;
+    const double lookupSeconds = measure( [&] () {
+        for( int64_t time: times )
+            sink += index->frameAt( time );
+    } );
+    printf( "time -> frame lookup     %8.1f ns (checksum %u)\n", lookupSeconds * 1e9 / RandomSeeks, sink );
+
+    //annotation session: forward stepping through the whole media
+    std::vector<unsigned> forwardSteps;
+    for( unsigned frame = 1; frame < index->frameCount(); ++frame )
+        forwardSteps.push_back( frame );
+
+    //jumps a few frames forward, like scrubbing with arrow keys
+    std::vector<unsigned> shortJumps;
+    for( unsigned frame = 5; frame < index->frameCount(); frame += 5 )
+        shortJumps.push_back( frame );
+
+    printf( "seek latency without -> with index, %.1f ms per decoded frame\n", DecodeMsPerFrame );
+    printSeekStats( "next frame", seekStats( *index, forwardSteps ) );
+    printSeekStats( "5 frames forward", seekStats( *index, shortJumps ) );
+    printSeekStats( "random frame", seekStats( *index, randomTargets ) );
+
+    return 0;
+}
@@ -0,0 +1,353 @@
+// Compares libvlc event queue implementations of JsVlcPlayer with many players:
+// mutex protected std::deque of heap allocated virtual events with std::string log copies
+// (as it was) and allocation free MpmcRing of tagged records with LogArena (as it is now),
+// which overflows to mutex protected std::deque instead of waiting while the ring is full.
+//
+// Every player has own producer thread, like libvlc event thread of its media player,
+// sending mostly time and position changes with log message in between,
+// and single consumer thread drains all players, like gui thread does.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MpmcRing.h"
+#include "LogArena.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const unsigned Players = 32;
+const unsigned EventsPerPlayer = 50000;
+//every 16th event is log message
+const unsigned LogEveryEvents = 16;
+
+const char* const LogFormat = "picture might be displayed late (missing %d ms), frame %u";
+
+unsigned percentile( std::vector<unsigned>& samples, double p )
+{
+    if( samples.empty() )
+        return 0;
+
+    const size_t n = static_cast<size_t>( p * ( samples.size() - 1 ) );
+    std::nth_element( samples.begin(), samples.begin() + n, samples.end() );
+    return samples[n];
+}
+
+inline unsigned elapsedNs( Clock::time_point from, Clock::time_point to )
+{
+    return static_cast<unsigned>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>( to - from ).count() );
+}
+
+struct Stats
+{
+    std::vector<unsigned> enqueue;
+    double totalMs;
+    uint64_t checksum;
+};
+
+void report( const char* name, Stats& stats )
+{
+    const double events = static_cast<double>( Players ) * EventsPerPlayer;
+    printf( "%-28s enqueue p50 %5u ns p99 %6u ns | %6.2f Mevents/s (checksum %llu)\n",
+            name,
+            percentile( stats.enqueue, 0.5 ), percentile( stats.enqueue, 0.99 ),
+            events / stats.totalMs / 1000.0,
+            static_cast<unsigned long long>( stats.checksum ) );
+}
+
+//producers of all players start together
+template<typename Produce, typename Drain>
+Stats run( Produce produce, Drain drain )
+{
+    std::vector<std::vector<unsigned> > latencies( Players );
+    for( std::vector<unsigned>& l: latencies )
+        l.reserve( EventsPerPlayer );
+
+    std::atomic<bool> go( false );
+
+    std::vector<std::thread> producers;
+    for( unsigned player = 0; player < Players; ++player ) {
+        producers.emplace_back( [&, player] () {
+            while( !go.load() )
+                std::this_thread::yield();
+            produce( player, &latencies[player] );
+        } );
+    }
+
+    Stats stats;
+    stats.checksum = 0;
+
+    const Clock::time_point start = Clock::now();
+    go.store( true );
+
+    uint64_t processed = 0;
+    const uint64_t total = static_cast<uint64_t>( Players ) * EventsPerPlayer;
+    while( processed < total ) {
+        uint64_t drained = 0;
+        for( unsigned player = 0; player < Players; ++player )
+            drained += drain( player, &stats.checksum );
+        processed += drained;
+        if( !drained )
+            std::this_thread::yield();
+    }
+
+    stats.totalMs = std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+
+    for( std::thread& producer: producers )
+        producer.join();
+
+    for( std::vector<unsigned>& l: latencies )
+        stats.enqueue.insert( stats.enqueue.end(), l.begin(), l.end() );
+
+    return stats;
+}
+
+std::string formatString( const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    va_list argsCopy;
+    va_copy( argsCopy, args );
+    const int size = vsnprintf( nullptr, 0, format, argsCopy );
+    va_end( argsCopy );
+
+    std::string message( size + 1, '\0' );
+    vsnprintf( &message[0], message.size(), format, args );
+    message.resize( size );
+    va_end( args );
+
+    return message;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct VirtualEvent
+{
+    virtual ~VirtualEvent() {}
+    virtual void process( uint64_t* checksum ) = 0;
+};
+
+//copy of whole libvlc_event_t, as it was
+struct LibvlcEvent : public VirtualEvent
+{
+    LibvlcEvent( int type, int64_t value ) :
+        type( type ), value( value ) {}
+
+    void process( uint64_t* checksum ) override
+        { *checksum += type + value; }
+
+    int type;
+    void* object;
+    int64_t value;
+    char rest[16];
+};
+
+struct LogEvent : public VirtualEvent
+{
+    LogEvent( int level, const std::string& message, const std::string& format ) :
+        level( level ), message( message ), format( format ) {}
+
+    void process( uint64_t* checksum ) override
+        { *checksum += level + message.size() + format.size(); }
+
+    int level;
+    std::string message;
+    std::string format;
+};
+
+struct DequeQueue
+{
+    std::mutex guard;
+    std::deque<std::unique_ptr<VirtualEvent> > events;
+};
+
+Stats benchDeque()
+{
+    std::vector<DequeQueue> queues( Players );
+
+    return run(
+        [&] ( unsigned player, std::vector<unsigned>* latencies ) {
+            DequeQueue& queue = queues[player];
+            for( unsigned i = 0; i < EventsPerPlayer; ++i ) {
+                const Clock::time_point begin = Clock::now();
+                if( 0 == i % LogEveryEvents ) {
+                    const std::string message = formatString( LogFormat, 20, i );
+                    queue.guard.lock();
+                    queue.events.emplace_back( new LogEvent( 2, message, LogFormat ) );
+                    queue.guard.unlock();
+                } else {
+                    queue.guard.lock();
+                    queue.events.emplace_back( new LibvlcEvent( 1, i ) );
+                    queue.guard.unlock();
+                }
+                latencies->push_back( elapsedNs( begin, Clock::now() ) );
+            }
+        },
+        [&] ( unsigned player, uint64_t* checksum ) -> uint64_t {
+            DequeQueue& queue = queues[player];
+            std::deque<std::unique_ptr<VirtualEvent> > tmpEvents;
+            queue.guard.lock();
+            queue.events.swap( tmpEvents );
+            queue.guard.unlock();
+            for( const auto& event: tmpEvents )
+                event->process( checksum );
+            return tmpEvents.size();
+        } );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//same layout as JsVlcPlayer::PlayerEvent
+struct PlayerEvent
+{
+    enum Type
+    {
+        Libvlc,
+        LogMessage,
+    };
+
+    struct LibvlcData
+    {
+        int eventType;
+        union
+        {
+            float floatValue;
+            int intValue;
+            int64_t timeValue;
+        };
+    };
+
+    struct LogData
+    {
+        int level;
+        unsigned slot;
+    };
+
+    Type type;
+    union
+    {
+        LibvlcData libvlc;
+        LogData log;
+    };
+};
+
+struct RingQueue
+{
+    RingQueue() : overflow( false ) {}
+
+    MpmcRing<PlayerEvent, 1024> events;
+    LogArena logArena;
+
+    //events which didn't fit the ring, like JsVlcPlayer keeps state events
+    std::atomic<bool> overflow;
+    std::mutex overflowGuard;
+    std::deque<PlayerEvent> overflowEvents;
+};
+
+void storeLog( LogArena& arena, unsigned* slot, const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    *slot = arena.store( format, args );
+    va_end( args );
+}
+
+Stats benchRing()
+{
+    std::vector<std::unique_ptr<RingQueue> > queues;
+    for( unsigned player = 0; player < Players; ++player )
+        queues.emplace_back( new RingQueue );
+
+    return run(
+        [&] ( unsigned player, std::vector<unsigned>* latencies ) {
+            RingQueue& queue = *queues[player];
+            for( unsigned i = 0; i < EventsPerPlayer; ++i ) {
+                const Clock::time_point begin = Clock::now();
+                PlayerEvent event;
+                if( 0 == i % LogEveryEvents ) {
+                    event.type = PlayerEvent::LogMessage;
+                    event.log.level = 2;
+                    //JsVlcPlayer drops log messages if arena or ring is full,
+                    //but here every event should reach consumer to compare equal work
+                    do {
+                        storeLog( queue.logArena, &event.log.slot, LogFormat, 20, i );
+                        if( LogArena::NoSlot == event.log.slot )
+                            std::this_thread::yield();
+                    } while( LogArena::NoSlot == event.log.slot );
+                } else {
+                    event.type = PlayerEvent::Libvlc;
+                    event.libvlc.eventType = 1;
+                    event.libvlc.timeValue = i;
+                }
+                //producer never waits for consumer, like JsVlcPlayer::pushEvent()
+                if( queue.overflow.load() || !queue.events.push( event ) ) {
+                    queue.overflowGuard.lock();
+                    queue.overflowEvents.push_back( event );
+                    queue.overflow = true;
+                    queue.overflowGuard.unlock();
+                }
+                latencies->push_back( elapsedNs( begin, Clock::now() ) );
+            }
+        },
+        [&] ( unsigned player, uint64_t* checksum ) -> uint64_t {
+            RingQueue& queue = *queues[player];
+            uint64_t drained = 0;
+            auto process = [&] ( const PlayerEvent& event ) {
+                if( PlayerEvent::LogMessage == event.type ) {
+                    *checksum += event.log.level +
+                                 strlen( queue.logArena.message( event.log.slot ) ) +
+                                 strlen( queue.logArena.format( event.log.slot ) );
+                    queue.logArena.release( event.log.slot );
+                } else {
+                    *checksum += event.libvlc.eventType + event.libvlc.timeValue;
+                }
+                ++drained;
+            };
+            PlayerEvent event;
+            for( ;; ) {
+                while( queue.events.pop( &event ) )
+                    process( event );
+
+                if( !queue.overflow.load() )
+                    break;
+
+                std::deque<PlayerEvent> overflowEvents;
+                queue.overflowGuard.lock();
+                queue.overflowEvents.swap( overflowEvents );
+                queue.overflow = false;
+                queue.overflowGuard.unlock();
+
+                for( const PlayerEvent& overflowEvent: overflowEvents )
+                    process( overflowEvent );
+            }
+            return drained;
+        } );
+}
+
+}
+
+int main()
+{
+    printf( "%u players, %u events per player, every %u-th is log message\n",
+            Players, EventsPerPlayer, LogEveryEvents );
+
+    Stats dequeStats = benchDeque();
+    report( "mutex + std::deque + string", dequeStats );
+
+    Stats ringStats = benchRing();
+    report( "MpmcRing + LogArena", ringStats );
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+// Compares enqueue/dequeue latency of video events queue implementations:
+// mutex protected std::deque of heap allocated virtual events (as it was in VlcVideoOutput),
+// and coalesced tagged POD events queued to mutex protected std::deque
+// or to fixed capacity SPSC ring (as it is now).
+//
+// Both POD variants coalesce frame ready events the same way VlcVideoOutput does,
+// and ring producer never waits: it drops frame ready event if ring is full,
+// since consumer picks up pending frames anyway. All frames are delivered in every variant.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const unsigned EventsCount = 1000000;
+
+struct Stats
+{
+    std::vector<unsigned> enqueue;
+    std::vector<unsigned> dequeue;
+    double totalMs;
+};
+
+unsigned percentile( std::vector<unsigned>& samples, double p )
+{
+    if( samples.empty() )
+        return 0;
+
+    const size_t n = static_cast<size_t>( p * ( samples.size() - 1 ) );
+    std::nth_element( samples.begin(), samples.begin() + n, samples.end() );
+    return samples[n];
+}
+
+inline unsigned elapsedNs( Clock::time_point from, Clock::time_point to )
+{
+    return static_cast<unsigned>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>( to - from ).count() );
+}
+
+void report( const char* name, Stats& stats )
+{
+    printf( "%-22s enqueue p50 %5u ns p99 %6u ns | dequeue p50 %5u ns p99 %6u ns | %7.1f Mevents/s\n",
+            name,
+            percentile( stats.enqueue, 0.5 ), percentile( stats.enqueue, 0.99 ),
+            percentile( stats.dequeue, 0.5 ), percentile( stats.dequeue, 0.99 ),
+            EventsCount / stats.totalMs / 1000.0 );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct VirtualEvent
+{
+    virtual ~VirtualEvent() {}
+    virtual void process( unsigned* counter ) = 0;
+};
+
+struct FrameReadyEvent : public VirtualEvent
+{
+    void process( unsigned* counter ) override
+        { ++*counter; }
+};
+
+Stats benchDeque()
+{
+    std::mutex guard;
+    std::deque<std::unique_ptr<VirtualEvent> > events;
+
+    Stats stats;
+    stats.enqueue.reserve( EventsCount );
+    stats.dequeue.reserve( EventsCount );
+
+    const Clock::time_point start = Clock::now();
+
+    std::thread consumer( [&] () {
+        unsigned processed = 0;
+        while( processed < EventsCount ) {
+            const Clock::time_point begin = Clock::now();
+            std::deque<std::unique_ptr<VirtualEvent> > tmpEvents;
+            guard.lock();
+            events.swap( tmpEvents );
+            guard.unlock();
+            for( const auto& i: tmpEvents )
+                i->process( &processed );
+            const Clock::time_point end = Clock::now();
+
+            //swap cost is amortized over drained events
+            if( !tmpEvents.empty() ) {
+                const unsigned perEvent = elapsedNs( begin, end ) / static_cast<unsigned>( tmpEvents.size() );
+                stats.dequeue.insert( stats.dequeue.end(), tmpEvents.size(), perEvent );
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    } );
+
+    for( unsigned i = 0; i < EventsCount; ++i ) {
+        const Clock::time_point begin = Clock::now();
+        guard.lock();
+        events.emplace_back( new FrameReadyEvent );
+        guard.unlock();
+        stats.enqueue.push_back( elapsedNs( begin, Clock::now() ) );
+    }
+
+    consumer.join();
+    stats.totalMs = std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+
+    return stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct PodEvent
+{
+    enum Type
+    {
+        FrameSetup,
+        FrameReady,
+        FrameCleanup,
+    };
+
+    Type type;
+};
+
+//frame ready notifications are coalesced like VlcVideoOutput::notifyFrameReady() does:
+//only first frame since last delivery queues event, and consumer takes all pending frames,
+//so every frame is accounted for whatever queue does
+template<typename Push, typename Drain>
+Stats benchCoalesced( Push push, Drain drain, unsigned* queuedEvents )
+{
+    std::atomic<unsigned> pendingFrames( 0 );
+    std::atomic<bool> producerDone( false );
+
+    Stats stats;
+    stats.enqueue.reserve( EventsCount );
+    stats.dequeue.reserve( EventsCount );
+
+    const Clock::time_point start = Clock::now();
+
+    std::thread consumer( [&] () {
+        unsigned delivered = 0;
+        while( delivered < EventsCount ) {
+            const Clock::time_point begin = Clock::now();
+            unsigned events = 0;
+            drain( [&] ( const PodEvent& event ) {
+                ++events;
+                if( PodEvent::FrameReady == event.type )
+                    delivered += pendingFrames.exchange( 0 );
+            } );
+            //frame ready event could be dropped by full queue
+            if( producerDone.load() )
+                delivered += pendingFrames.exchange( 0 );
+            const Clock::time_point end = Clock::now();
+
+            if( events ) {
+                const unsigned perEvent = elapsedNs( begin, end ) / events;
+                stats.dequeue.insert( stats.dequeue.end(), events, perEvent );
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    } );
+
+    unsigned queued = 0;
+    const PodEvent frameReadyEvent = { PodEvent::FrameReady };
+    for( unsigned i = 0; i < EventsCount; ++i ) {
+        const Clock::time_point begin = Clock::now();
+        if( 0 == pendingFrames.fetch_add( 1 ) && push( frameReadyEvent ) )
+            ++queued;
+        stats.enqueue.push_back( elapsedNs( begin, Clock::now() ) );
+    }
+    producerDone.store( true );
+
+    consumer.join();
+    stats.totalMs = std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+
+    *queuedEvents = queued;
+
+    return stats;
+}
+
+Stats benchPodDeque( unsigned* queuedEvents )
+{
+    std::mutex guard;
+    std::deque<PodEvent> events;
+
+    return benchCoalesced(
+        [&] ( const PodEvent& event ) {
+            guard.lock();
+            events.push_back( event );
+            guard.unlock();
+            return true;
+        },
+        [&] ( const std::function<void( const PodEvent& )>& process ) {
+            std::deque<PodEvent> tmpEvents;
+            guard.lock();
+            events.swap( tmpEvents );
+            guard.unlock();
+            for( const PodEvent& event: tmpEvents )
+                process( event );
+        },
+        queuedEvents );
+}
+
+Stats benchPodRing( unsigned* queuedEvents )
+{
+    //same capacity as VlcVideoOutput uses
+    SpscRing<PodEvent, 16> events;
+
+    return benchCoalesced(
+        [&] ( const PodEvent& event ) {
+            //dropped if full, like VlcVideoOutput does for frame ready events
+            return events.push( event );
+        },
+        [&] ( const std::function<void( const PodEvent& )>& process ) {
+            PodEvent event;
+            while( events.pop( &event ) )
+                process( event );
+        },
+        queuedEvents );
+}
+
+}
+
+int main()
+{
+    printf( "%u frame ready events, single producer / single consumer\n", EventsCount );
+
+    Stats dequeStats = benchDeque();
+    report( "virtual events", dequeStats );
+
+    unsigned queuedEvents = 0;
+    Stats podStats = benchPodDeque( &queuedEvents );
+    report( "coalesced POD deque", podStats );
+    printf( "%-22s %u events queued\n", "", queuedEvents );
+
+    Stats ringStats = benchPodRing( &queuedEvents );
+    report( "coalesced POD ring", ringStats );
+    printf( "%-22s %u events queued\n", "", queuedEvents );
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Measures time to first frame of load() at random offsets of local media files,
+// with and without preload() of the next file, and reports p50/p95.
+// preload() only builds frame index of local MP4 files, so other files show no difference.
+//
+// usage: node ttff.js [runs] file...
+// files default to ../test/test.mp4
+
+const fileUrl = require('file-url');
+const path = require('path');
+const webChimera = require('../bin/WebChimera.js.node');
+
+const args = process.argv.slice(2);
+const runs = args.length && /^\d+$/.test(args[0]) ? parseInt(args.shift(), 10) : 50;
+const files = (args.length ? args : [path.join(__dirname, '..', 'test', 'test.mp4')])
+  .map(file => fileUrl(path.resolve(file)));
+
+// Offsets are within the first 90% of media, so playback has something to show.
+const MaxOffset = 0.9;
+
+const vlc = webChimera.createPlayer(['--no-audio']);
+vlc.pixelFormat = vlc.I420;
+
+// deterministic, so runs are comparable between builds
+let seed = 12345;
+function random() {
+  seed = (seed * 1103515245 + 12345) % 2147483648;
+  return seed / 2147483648;
+}
+
+function loadFirstFrame(mrl, atTime, play) {
+  return new Promise(resolve => {
+    const start = process.hrtime.bigint();
+    vlc.onFrameReady = () => {
+      vlc.onFrameReady = null;
+      const wallTime = Number(process.hrtime.bigint() - start) / 1e6;
+      resolve({ ttff: vlc.timeToFirstFrame, wallTime: wallTime });
+    };
+    vlc.load(mrl, play, false, atTime);
+  });
+}
+
+async function mediaLengths() {
+  const lengths = [];
+  for (const mrl of files) {
+    await loadFirstFrame(mrl, 0, false);
+    lengths.push(vlc.length);
+  }
+  return lengths;
+}
+
+function percentile(sorted, p) {
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+function report(name, samples) {
+  const ttff = samples.map(s => s.ttff).sort((a, b) => a - b);
+  const wall = samples.map(s => s.wallTime).sort((a, b) => a - b);
+  console.log(`${name.padEnd(20)} TTFF p50 ${percentile(ttff, 0.5).toFixed(1).padStart(7)} ms` +
+              `, p95 ${percentile(ttff, 0.95).toFixed(1).padStart(7)} ms` +
+              ` (JS wall p50 ${percentile(wall, 0.5).toFixed(1)} ms, p95 ${percentile(wall, 0.95).toFixed(1)} ms)`);
+}
+
+async function series(lengths, play, preload) {
+  const samples = [];
+  let next = Math.floor(random() * files.length);
+  for (let i = 0; i < runs; ++i) {
+    const file = next;
+    const atTime = Math.floor(random() * lengths[file] * MaxOffset);
+    next = Math.floor(random() * files.length);
+
+    samples.push(await loadFirstFrame(files[file], atTime, play));
+
+    // next file is known while the current one is shown, like in playlist UI
+    if (preload)
+      vlc.preload(files[next]);
+  }
+  return samples;
+}
+
+async function main() {
+  const lengths = await mediaLengths();
+  console.log(`${files.length} file(s), ${runs} loads per series`);
+
+  report('paused', await series(lengths, false, false));
+  report('paused, preloaded', await series(lengths, false, true));
+  report('playing', await series(lengths, true, false));
+  report('playing, preloaded', await series(lengths, true, true));
+
+  vlc.close();
+}
+
+main();
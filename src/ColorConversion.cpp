@@ -0,0 +1,444 @@
+#include "ColorConversion.h"
+
+#include <algorithm>
+
+#include "WorkerPool.h"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+    #define WCJS_HAS_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+#if defined( WCJS_HAS_SSE2 ) && \
+    ( defined( _MSC_VER ) || defined( __clang__ ) || \
+      ( defined( __GNUC__ ) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) ) )
+    #define WCJS_HAS_AVX2 1
+    #include <immintrin.h>
+    #if defined( _MSC_VER ) && !defined( __clang__ )
+        #include <intrin.h>
+        #define WCJS_TARGET_AVX2
+    #else
+        #define WCJS_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+    #endif
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    #define WCJS_HAS_NEON 1
+    #include <arm_neon.h>
+#endif
+
+namespace {
+
+const int FractionBits = 6;
+const int Rounding = 1 << ( FractionBits - 1 );
+const int ChromaOffset = 128;
+
+//frames smaller than that are converted on calling thread only
+const unsigned MinBandPixels = 1280 * 180;
+
+typedef void ( *ConvertRow )( const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                              uint8_t* dst, unsigned width,
+                              const YuvToRgbCoefficients& c );
+
+inline int16_t toFixed( double value )
+{
+    return static_cast<int16_t>( value * ( 1 << FractionBits ) + 0.5 );
+}
+
+inline uint8_t clampPixel( int value )
+{
+    value = ( value + Rounding ) >> FractionBits;
+    return static_cast<uint8_t>( value < 0 ? 0 : ( value > 255 ? 255 : value ) );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void convertRowScalar( const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                       uint8_t* dst, unsigned width,
+                       const YuvToRgbCoefficients& c )
+{
+    for( unsigned x = 0; x < width; ++x ) {
+        const int luma = ( y[x] - c.yOffset ) * c.yScale;
+        const int cb = u[x / 2] - ChromaOffset;
+        const int cr = v[x / 2] - ChromaOffset;
+
+        dst[0] = clampPixel( luma + cr * c.rv );
+        dst[1] = clampPixel( luma - cb * c.gu - cr * c.gv );
+        dst[2] = clampPixel( luma + cb * c.bu );
+        dst[3] = 0xFF;
+        dst += 4;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+#ifdef WCJS_HAS_SSE2
+struct Sse2Coefficients
+{
+    explicit Sse2Coefficients( const YuvToRgbCoefficients& c ) :
+        yOffset( _mm_set1_epi16( c.yOffset ) ), yScale( _mm_set1_epi16( c.yScale ) ),
+        rv( _mm_set1_epi16( c.rv ) ), gu( _mm_set1_epi16( c.gu ) ),
+        gv( _mm_set1_epi16( c.gv ) ), bu( _mm_set1_epi16( c.bu ) ),
+        chromaOffset( _mm_set1_epi16( ChromaOffset ) ), rounding( _mm_set1_epi16( Rounding ) ) {}
+
+    __m128i yOffset, yScale, rv, gu, gv, bu, chromaOffset, rounding;
+};
+
+//y, u, v - 8 x int16 each, chroma is already centered and duplicated per pixel
+inline void sse2YuvToRgb( __m128i y, __m128i u, __m128i v,
+                          const Sse2Coefficients& c,
+                          __m128i* r, __m128i* g, __m128i* b )
+{
+    y = _mm_mullo_epi16( _mm_sub_epi16( y, c.yOffset ), c.yScale );
+
+    *r = _mm_adds_epi16( y, _mm_mullo_epi16( v, c.rv ) );
+    *g = _mm_subs_epi16( _mm_subs_epi16( y, _mm_mullo_epi16( u, c.gu ) ),
+                         _mm_mullo_epi16( v, c.gv ) );
+    *b = _mm_adds_epi16( y, _mm_mullo_epi16( u, c.bu ) );
+
+    *r = _mm_srai_epi16( _mm_adds_epi16( *r, c.rounding ), FractionBits );
+    *g = _mm_srai_epi16( _mm_adds_epi16( *g, c.rounding ), FractionBits );
+    *b = _mm_srai_epi16( _mm_adds_epi16( *b, c.rounding ), FractionBits );
+}
+
+//r, g, b - 16 x uint8 each
+inline void sse2StoreRGBA( uint8_t* dst, __m128i r, __m128i g, __m128i b )
+{
+    const __m128i a = _mm_set1_epi8( -1 );
+    const __m128i rgLo = _mm_unpacklo_epi8( r, g );
+    const __m128i rgHi = _mm_unpackhi_epi8( r, g );
+    const __m128i baLo = _mm_unpacklo_epi8( b, a );
+    const __m128i baHi = _mm_unpackhi_epi8( b, a );
+
+    __m128i* out = reinterpret_cast<__m128i*>( dst );
+    _mm_storeu_si128( out + 0, _mm_unpacklo_epi16( rgLo, baLo ) );
+    _mm_storeu_si128( out + 1, _mm_unpackhi_epi16( rgLo, baLo ) );
+    _mm_storeu_si128( out + 2, _mm_unpacklo_epi16( rgHi, baHi ) );
+    _mm_storeu_si128( out + 3, _mm_unpackhi_epi16( rgHi, baHi ) );
+}
+
+void convertRowSSE2( const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                     uint8_t* dst, unsigned width,
+                     const YuvToRgbCoefficients& c )
+{
+    const Sse2Coefficients sc( c );
+    const __m128i zero = _mm_setzero_si128();
+
+    unsigned x = 0;
+    for( ; x + 16 <= width; x += 16 ) {
+        const __m128i yBytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( y + x ) );
+        const __m128i uBytes = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( u + x / 2 ) );
+        const __m128i vBytes = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( v + x / 2 ) );
+
+        const __m128i cb = _mm_sub_epi16( _mm_unpacklo_epi8( uBytes, zero ), sc.chromaOffset );
+        const __m128i cr = _mm_sub_epi16( _mm_unpacklo_epi8( vBytes, zero ), sc.chromaOffset );
+
+        __m128i rLo, gLo, bLo, rHi, gHi, bHi;
+        sse2YuvToRgb( _mm_unpacklo_epi8( yBytes, zero ),
+                      _mm_unpacklo_epi16( cb, cb ), _mm_unpacklo_epi16( cr, cr ),
+                      sc, &rLo, &gLo, &bLo );
+        sse2YuvToRgb( _mm_unpackhi_epi8( yBytes, zero ),
+                      _mm_unpackhi_epi16( cb, cb ), _mm_unpackhi_epi16( cr, cr ),
+                      sc, &rHi, &gHi, &bHi );
+
+        sse2StoreRGBA( dst + x * 4,
+                       _mm_packus_epi16( rLo, rHi ),
+                       _mm_packus_epi16( gLo, gHi ),
+                       _mm_packus_epi16( bLo, bHi ) );
+    }
+
+    convertRowScalar( y + x, u + x / 2, v + x / 2, dst + x * 4, width - x, c );
+}
+#endif //WCJS_HAS_SSE2
+
+///////////////////////////////////////////////////////////////////////////////
+#ifdef WCJS_HAS_AVX2
+WCJS_TARGET_AVX2
+inline __m128i avx2PackBytes( __m256i value )
+{
+    return _mm_packus_epi16( _mm256_castsi256_si128( value ),
+                             _mm256_extracti128_si256( value, 1 ) );
+}
+
+WCJS_TARGET_AVX2
+inline __m256i avx2LoadChroma( const uint8_t* chroma, __m256i chromaOffset )
+{
+    const __m128i bytes = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( chroma ) );
+    return _mm256_sub_epi16( _mm256_cvtepu8_epi16( _mm_unpacklo_epi8( bytes, bytes ) ),
+                             chromaOffset );
+}
+
+WCJS_TARGET_AVX2
+void convertRowAVX2( const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                     uint8_t* dst, unsigned width,
+                     const YuvToRgbCoefficients& c )
+{
+    const __m256i yOffset = _mm256_set1_epi16( c.yOffset );
+    const __m256i yScale = _mm256_set1_epi16( c.yScale );
+    const __m256i rv = _mm256_set1_epi16( c.rv );
+    const __m256i gu = _mm256_set1_epi16( c.gu );
+    const __m256i gv = _mm256_set1_epi16( c.gv );
+    const __m256i bu = _mm256_set1_epi16( c.bu );
+    const __m256i chromaOffset = _mm256_set1_epi16( ChromaOffset );
+    const __m256i rounding = _mm256_set1_epi16( Rounding );
+
+    unsigned x = 0;
+    for( ; x + 16 <= width; x += 16 ) {
+        const __m256i luma =
+            _mm256_mullo_epi16(
+                _mm256_sub_epi16(
+                    _mm256_cvtepu8_epi16( _mm_loadu_si128( reinterpret_cast<const __m128i*>( y + x ) ) ),
+                    yOffset ),
+                yScale );
+        const __m256i cb = avx2LoadChroma( u + x / 2, chromaOffset );
+        const __m256i cr = avx2LoadChroma( v + x / 2, chromaOffset );
+
+        __m256i r = _mm256_adds_epi16( luma, _mm256_mullo_epi16( cr, rv ) );
+        __m256i g = _mm256_subs_epi16( _mm256_subs_epi16( luma, _mm256_mullo_epi16( cb, gu ) ),
+                                       _mm256_mullo_epi16( cr, gv ) );
+        __m256i b = _mm256_adds_epi16( luma, _mm256_mullo_epi16( cb, bu ) );
+
+        r = _mm256_srai_epi16( _mm256_adds_epi16( r, rounding ), FractionBits );
+        g = _mm256_srai_epi16( _mm256_adds_epi16( g, rounding ), FractionBits );
+        b = _mm256_srai_epi16( _mm256_adds_epi16( b, rounding ), FractionBits );
+
+        sse2StoreRGBA( dst + x * 4, avx2PackBytes( r ), avx2PackBytes( g ), avx2PackBytes( b ) );
+    }
+
+    convertRowScalar( y + x, u + x / 2, v + x / 2, dst + x * 4, width - x, c );
+}
+
+bool cpuSupportsAVX2()
+{
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    int info[4];
+    __cpuid( info, 0 );
+    if( info[0] < 7 )
+        return false;
+
+    __cpuid( info, 1 );
+    const int osxsave = 1 << 27;
+    const int avx = 1 << 28;
+    if( ( info[2] & ( osxsave | avx ) ) != ( osxsave | avx ) )
+        return false;
+
+    //OS should save ymm registers on context switch
+    if( ( _xgetbv( 0 ) & 6 ) != 6 )
+        return false;
+
+    __cpuidex( info, 7, 0 );
+    return 0 != ( info[1] & ( 1 << 5 ) );
+#else
+    return 0 != __builtin_cpu_supports( "avx2" );
+#endif
+}
+#endif //WCJS_HAS_AVX2
+
+///////////////////////////////////////////////////////////////////////////////
+#ifdef WCJS_HAS_NEON
+struct NeonCoefficients
+{
+    explicit NeonCoefficients( const YuvToRgbCoefficients& c ) :
+        yOffset( vdupq_n_s16( c.yOffset ) ), yScale( vdupq_n_s16( c.yScale ) ),
+        rv( vdupq_n_s16( c.rv ) ), gu( vdupq_n_s16( c.gu ) ),
+        gv( vdupq_n_s16( c.gv ) ), bu( vdupq_n_s16( c.bu ) ),
+        chromaOffset( vdupq_n_s16( ChromaOffset ) ) {}
+
+    int16x8_t yOffset, yScale, rv, gu, gv, bu, chromaOffset;
+};
+
+inline int16x8_t neonWiden( uint8x8_t value )
+{
+    return vreinterpretq_s16_u16( vmovl_u8( value ) );
+}
+
+//y, u, v - 8 x int16 each, chroma is already centered and duplicated per pixel
+inline void neonYuvToRgb( int16x8_t y, int16x8_t u, int16x8_t v,
+                          const NeonCoefficients& c,
+                          uint8x8_t* r, uint8x8_t* g, uint8x8_t* b )
+{
+    y = vmulq_s16( vsubq_s16( y, c.yOffset ), c.yScale );
+
+    //vqrshrun does the same rounding and clamping as other kernels
+    *r = vqrshrun_n_s16( vqaddq_s16( y, vmulq_s16( v, c.rv ) ), FractionBits );
+    *g = vqrshrun_n_s16( vqsubq_s16( vqsubq_s16( y, vmulq_s16( u, c.gu ) ),
+                                     vmulq_s16( v, c.gv ) ), FractionBits );
+    *b = vqrshrun_n_s16( vqaddq_s16( y, vmulq_s16( u, c.bu ) ), FractionBits );
+}
+
+void convertRowNEON( const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                     uint8_t* dst, unsigned width,
+                     const YuvToRgbCoefficients& c )
+{
+    const NeonCoefficients nc( c );
+
+    unsigned x = 0;
+    for( ; x + 16 <= width; x += 16 ) {
+        const uint8x16_t yBytes = vld1q_u8( y + x );
+        const uint8x8_t uBytes = vld1_u8( u + x / 2 );
+        const uint8x8_t vBytes = vld1_u8( v + x / 2 );
+        const uint8x8x2_t cb = vzip_u8( uBytes, uBytes );
+        const uint8x8x2_t cr = vzip_u8( vBytes, vBytes );
+
+        uint8x8_t rLo, gLo, bLo, rHi, gHi, bHi;
+        neonYuvToRgb( neonWiden( vget_low_u8( yBytes ) ),
+                      vsubq_s16( neonWiden( cb.val[0] ), nc.chromaOffset ),
+                      vsubq_s16( neonWiden( cr.val[0] ), nc.chromaOffset ),
+                      nc, &rLo, &gLo, &bLo );
+        neonYuvToRgb( neonWiden( vget_high_u8( yBytes ) ),
+                      vsubq_s16( neonWiden( cb.val[1] ), nc.chromaOffset ),
+                      vsubq_s16( neonWiden( cr.val[1] ), nc.chromaOffset ),
+                      nc, &rHi, &gHi, &bHi );
+
+        uint8x16x4_t rgba;
+        rgba.val[0] = vcombine_u8( rLo, rHi );
+        rgba.val[1] = vcombine_u8( gLo, gHi );
+        rgba.val[2] = vcombine_u8( bLo, bHi );
+        rgba.val[3] = vdupq_n_u8( 0xFF );
+        vst4q_u8( dst + x * 4, rgba );
+    }
+
+    convertRowScalar( y + x, u + x / 2, v + x / 2, dst + x * 4, width - x, c );
+}
+#endif //WCJS_HAS_NEON
+
+ConvertRow rowConverter( ConversionKernel kernel )
+{
+    switch( kernel ) {
+#ifdef WCJS_HAS_SSE2
+        case ConversionKernel::SSE2:
+            return convertRowSSE2;
+#endif
+#ifdef WCJS_HAS_AVX2
+        case ConversionKernel::AVX2:
+            return convertRowAVX2;
+#endif
+#ifdef WCJS_HAS_NEON
+        case ConversionKernel::NEON:
+            return convertRowNEON;
+#endif
+        default:
+            return convertRowScalar;
+    }
+}
+
+}
+
+YuvToRgbCoefficients MakeYuvToRgbCoefficients( ColorMatrix matrix, ColorRange range, unsigned height )
+{
+    if( ColorMatrix::Auto == matrix )
+        matrix = height >= 720 ? ColorMatrix::BT709 : ColorMatrix::BT601;
+
+    const double kr = ColorMatrix::BT709 == matrix ? 0.2126 : 0.299;
+    const double kb = ColorMatrix::BT709 == matrix ? 0.0722 : 0.114;
+    const double kg = 1.0 - kr - kb;
+
+    const bool full = ColorRange::Full == range;
+    const double yScale = full ? 1.0 : 255.0 / 219.0;
+    const double cScale = full ? 1.0 : 255.0 / 224.0;
+
+    YuvToRgbCoefficients c;
+    c.yOffset = full ? 0 : 16;
+    c.yScale = toFixed( yScale );
+    c.rv = toFixed( 2.0 * ( 1.0 - kr ) * cScale );
+    c.gu = toFixed( 2.0 * kb * ( 1.0 - kb ) / kg * cScale );
+    c.gv = toFixed( 2.0 * kr * ( 1.0 - kr ) / kg * cScale );
+    c.bu = toFixed( 2.0 * ( 1.0 - kb ) * cScale );
+
+    return c;
+}
+
+bool IsConversionKernelSupported( ConversionKernel kernel )
+{
+    switch( kernel ) {
+        case ConversionKernel::Scalar:
+            return true;
+#ifdef WCJS_HAS_SSE2
+        case ConversionKernel::SSE2:
+            return true;
+#endif
+#ifdef WCJS_HAS_AVX2
+        case ConversionKernel::AVX2: {
+            static const bool supported = cpuSupportsAVX2();
+            return supported;
+        }
+#endif
+#ifdef WCJS_HAS_NEON
+        case ConversionKernel::NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+ConversionKernel BestConversionKernel()
+{
+    if( IsConversionKernelSupported( ConversionKernel::AVX2 ) )
+        return ConversionKernel::AVX2;
+    if( IsConversionKernelSupported( ConversionKernel::SSE2 ) )
+        return ConversionKernel::SSE2;
+    if( IsConversionKernelSupported( ConversionKernel::NEON ) )
+        return ConversionKernel::NEON;
+
+    return ConversionKernel::Scalar;
+}
+
+const char* ConversionKernelName( ConversionKernel kernel )
+{
+    switch( kernel ) {
+        case ConversionKernel::SSE2:
+            return "SSE2";
+        case ConversionKernel::AVX2:
+            return "AVX2";
+        case ConversionKernel::NEON:
+            return "NEON";
+        default:
+            return "Scalar";
+    }
+}
+
+void ConvertI420ToRGBARows( const I420Image& src,
+                            uint8_t* dst, unsigned dstPitch,
+                            unsigned width, unsigned beginRow, unsigned endRow,
+                            const YuvToRgbCoefficients& coefficients,
+                            ConversionKernel kernel )
+{
+    if( !IsConversionKernelSupported( kernel ) )
+        kernel = ConversionKernel::Scalar;
+
+    const ConvertRow convertRow = rowConverter( kernel );
+
+    for( unsigned row = beginRow; row < endRow; ++row ) {
+        convertRow( src.y + row * src.yPitch,
+                    src.u + ( row / 2 ) * src.uPitch,
+                    src.v + ( row / 2 ) * src.vPitch,
+                    dst + row * dstPitch,
+                    width, coefficients );
+    }
+}
+
+void ConvertI420ToRGBA( const I420Image& src,
+                        uint8_t* dst, unsigned dstPitch,
+                        unsigned width, unsigned height,
+                        const YuvToRgbCoefficients& coefficients,
+                        ConversionKernel kernel,
+                        WorkerPool* pool )
+{
+    const unsigned bands =
+        pool ? std::min( pool->concurrency(), width * height / MinBandPixels ) : 1;
+
+    if( bands <= 1 ) {
+        ConvertI420ToRGBARows( src, dst, dstPitch, width, 0, height, coefficients, kernel );
+        return;
+    }
+
+    //bands should start at even row to share chroma rows correctly
+    const unsigned bandRows = ( ( height + bands - 1 ) / bands + 1 ) & ~1u;
+
+    pool->run( bands,
+        [&] ( unsigned band ) {
+            const unsigned beginRow = std::min( band * bandRows, height );
+            const unsigned endRow = std::min( beginRow + bandRows, height );
+            ConvertI420ToRGBARows( src, dst, dstPitch, width, beginRow, endRow,
+                                   coefficients, kernel );
+        } );
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+class WorkerPool; //#include "WorkerPool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+enum class ColorMatrix
+{
+    Auto = 0, //BT601 for SD, BT709 for HD
+    BT601,
+    BT709,
+};
+
+enum class ColorRange
+{
+    Limited = 0,
+    Full,
+};
+
+enum class ConversionKernel
+{
+    Scalar = 0,
+    SSE2,
+    AVX2,
+    NEON,
+};
+
+// Fixed point (6 fractional bits) coefficients,
+// every kernel uses exactly the same arithmetic so results are bit exact.
+struct YuvToRgbCoefficients
+{
+    int16_t yOffset;
+    int16_t yScale;
+    int16_t rv;
+    int16_t gu;
+    int16_t gv;
+    int16_t bu;
+};
+
+struct I420Image
+{
+    const uint8_t* y;
+    unsigned yPitch;
+    const uint8_t* u;
+    unsigned uPitch;
+    const uint8_t* v;
+    unsigned vPitch;
+};
+
+YuvToRgbCoefficients MakeYuvToRgbCoefficients( ColorMatrix matrix, ColorRange range, unsigned height );
+
+bool IsConversionKernelSupported( ConversionKernel kernel );
+ConversionKernel BestConversionKernel();
+const char* ConversionKernelName( ConversionKernel kernel );
+
+//converts rows [beginRow, endRow), beginRow should be even
+void ConvertI420ToRGBARows( const I420Image& src,
+                            uint8_t* dst, unsigned dstPitch,
+                            unsigned width, unsigned beginRow, unsigned endRow,
+                            const YuvToRgbCoefficients& coefficients,
+                            ConversionKernel kernel );
+
+//splits large frames into row bands executed on pool (if any)
+void ConvertI420ToRGBA( const I420Image& src,
+                        uint8_t* dst, unsigned dstPitch,
+                        unsigned width, unsigned height,
+                        const YuvToRgbCoefficients& coefficients,
+                        ConversionKernel kernel,
+                        WorkerPool* pool );
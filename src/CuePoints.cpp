@@ -0,0 +1,97 @@
+#include "CuePoints.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "MediaIndex.h"
+
+CuePoints::CuePoints() :
+    _dirty( false ), _frameDuration( 0 )
+{
+}
+
+void CuePoints::add( const std::string& id, double position, bool inFrames )
+{
+    remove( id );
+
+    Cue cue;
+    cue.id = id;
+    cue.position = std::max( position, 0.0 );
+    cue.inFrames = inFrames;
+    cue.time = 0;
+    _cues.push_back( cue );
+
+    _dirty = true;
+}
+
+bool CuePoints::remove( const std::string& id )
+{
+    auto it = std::find_if( _cues.begin(), _cues.end(),
+        [&id] ( const Cue& cue ) { return cue.id == id; } );
+    if( it == _cues.end() )
+        return false;
+
+    //erase keeps order
+    _cues.erase( it );
+
+    return true;
+}
+
+void CuePoints::clear()
+{
+    _cues.clear();
+    _dirty = false;
+    _index.reset();
+    _frameDuration = 0;
+}
+
+void CuePoints::resolve( const std::shared_ptr<MediaIndex>& index, double frameDuration )
+{
+    if( !_dirty && index == _index && frameDuration == _frameDuration )
+        return;
+
+    _dirty = false;
+    _index = index;
+    _frameDuration = frameDuration;
+
+    for( Cue& cue: _cues ) {
+        if( !cue.inFrames ) {
+            cue.time = static_cast<int64_t>( cue.position );
+        } else if( _index && _index->frameCount() > 0 ) {
+            const unsigned frame = static_cast<unsigned>(
+                std::min( cue.position, static_cast<double>( _index->frameCount() - 1 ) ) );
+            cue.time = _index->frameTime( frame ) / 1000;
+        } else {
+            cue.time = static_cast<int64_t>( std::round( cue.position * _frameDuration ) );
+        }
+    }
+
+    std::stable_sort( _cues.begin(), _cues.end(),
+        [] ( const Cue& l, const Cue& r ) { return l.time < r.time; } );
+}
+
+std::vector<CuePoints::Cue>::const_iterator CuePoints::lowerBound( int64_t time ) const
+{
+    return std::lower_bound( _cues.begin(), _cues.end(), time,
+        [] ( const Cue& cue, int64_t time ) { return cue.time < time; } );
+}
+
+void CuePoints::crossed( int64_t from, int64_t to, std::vector<std::string>* ids ) const
+{
+    if( from < to ) {
+        //(from, to]
+        for( auto it = lowerBound( from + 1 ); it != _cues.end() && it->time <= to; ++it )
+            ids->push_back( it->id );
+    } else if( to < from ) {
+        //[to, from), backwards
+        const auto first = lowerBound( to );
+        for( auto it = lowerBound( from ); it != first; )
+            ids->push_back( ( --it )->id );
+    }
+}
+
+void CuePoints::landed( int64_t time, int64_t duration, std::vector<std::string>* ids ) const
+{
+    for( auto it = lowerBound( time ); it != _cues.end() && it->time < time + duration; ++it )
+        ids->push_back( it->id );
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class MediaIndex;
+
+///////////////////////////////////////////////////////////////////////////////
+// Cue points of loaded media sorted by time, checked for every shown frame.
+// Should be accessed only from gui thread.
+class CuePoints
+{
+public:
+    CuePoints();
+
+    //position is frame number if inFrames, milliseconds otherwise,
+    //cue with the same id is replaced
+    void add( const std::string& id, double position, bool inFrames );
+    bool remove( const std::string& id );
+    void clear();
+
+    bool empty() const
+        { return _cues.empty(); }
+
+    //frame cues are placed by index if there is one, otherwise by frame duration,
+    //does nothing if neither cues nor placement changed since the last call
+    void resolve( const std::shared_ptr<MediaIndex>& index, double frameDuration );
+
+    //ids of cues passed moving from "from" to "to" in passing order,
+    //cue at "from" was passed already, so it's excluded
+    void crossed( int64_t from, int64_t to, std::vector<std::string>* ids ) const;
+    //ids of cues in [time, time + duration)
+    void landed( int64_t time, int64_t duration, std::vector<std::string>* ids ) const;
+
+private:
+    struct Cue
+    {
+        std::string id;
+        double position;
+        bool inFrames;
+        //milliseconds from media start
+        int64_t time;
+    };
+
+    std::vector<Cue>::const_iterator lowerBound( int64_t time ) const;
+
+private:
+    //ordered by time after resolve()
+    std::vector<Cue> _cues;
+    bool _dirty;
+
+    std::shared_ptr<MediaIndex> _index;
+    double _frameDuration;
+};
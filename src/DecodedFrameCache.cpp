@@ -0,0 +1,76 @@
+#include "DecodedFrameCache.h"
+
+#include <string.h>
+
+DecodedFrameCache::DecodedFrameCache() :
+    _budget( 0 ), _usedBytes( 0 ), _hits( 0 ), _misses( 0 )
+{
+}
+
+void DecodedFrameCache::setBudget( size_t bytes )
+{
+    _budget = bytes;
+    evict( _budget );
+}
+
+const FrameBufferPool::Buffer* DecodedFrameCache::find( int64_t time )
+{
+    auto it = _entries.find( time );
+    if( it == _entries.end() ) {
+        ++_misses;
+        return nullptr;
+    }
+
+    ++_hits;
+    _lru.splice( _lru.begin(), _lru, it->second );
+
+    return &it->second->buffer;
+}
+
+void DecodedFrameCache::insert( int64_t time, const void* data, size_t size )
+{
+    if( 0 == size || size > _budget )
+        return;
+
+    auto it = _entries.find( time );
+    if( it != _entries.end() ) {
+        //the same frame decoded again, so just refresh it
+        _lru.splice( _lru.begin(), _lru, it->second );
+        if( it->second->buffer.size() == size ) {
+            memcpy( it->second->buffer.data(), data, size );
+            return;
+        }
+
+        _usedBytes -= it->second->buffer.size();
+        _lru.erase( it->second );
+        _entries.erase( it );
+    }
+
+    evict( _budget - size );
+
+    FrameBufferPool::Buffer buffer = FrameBufferPool::instance().acquire( size );
+    if( !buffer.data() )
+        return;
+
+    memcpy( buffer.data(), data, size );
+
+    _lru.push_front( Entry() );
+    _lru.front().time = time;
+    _lru.front().buffer = std::move( buffer );
+    _entries[time] = _lru.begin();
+    _usedBytes += size;
+}
+
+void DecodedFrameCache::clear()
+{
+    evict( 0 );
+}
+
+void DecodedFrameCache::evict( size_t budget )
+{
+    while( _usedBytes > budget && !_lru.empty() ) {
+        _usedBytes -= _lru.back().buffer.size();
+        _entries.erase( _lru.back().time );
+        _lru.pop_back();
+    }
+}
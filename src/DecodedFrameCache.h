@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <unordered_map>
+
+#include "FrameBufferPool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Least recently used copies of decoded frames keyed by presentation time,
+// bounded by memory budget. Should be accessed only from gui thread.
+class DecodedFrameCache
+{
+public:
+    DecodedFrameCache();
+
+    size_t budget() const
+        { return _budget; }
+    //evicts least recently used frames exceeding new budget, 0 disables cache
+    void setBudget( size_t bytes );
+
+    size_t usedBytes() const
+        { return _usedBytes; }
+    //how many frames of size fit into budget
+    unsigned capacity( size_t frameSize ) const
+        { return frameSize ? static_cast<unsigned>( _budget / frameSize ) : 0; }
+
+    //returns null if frame is not cached, counts hit or miss
+    const FrameBufferPool::Buffer* find( int64_t time );
+    //doesn't affect counters and eviction order
+    bool contains( int64_t time ) const
+        { return _entries.count( time ) > 0; }
+
+    //copies frame, evicting least recently used ones if budget is exceeded
+    void insert( int64_t time, const void* data, size_t size );
+    void clear();
+
+    unsigned long long hits() const
+        { return _hits; }
+    unsigned long long misses() const
+        { return _misses; }
+
+private:
+    DecodedFrameCache( const DecodedFrameCache& ) = delete;
+    DecodedFrameCache& operator = ( const DecodedFrameCache& ) = delete;
+
+    struct Entry
+    {
+        int64_t time;
+        FrameBufferPool::Buffer buffer;
+    };
+    typedef std::list<Entry> Entries;
+
+    void evict( size_t budget );
+
+private:
+    size_t _budget;
+    size_t _usedBytes;
+
+    //most recently used frames are at the front
+    Entries _lru;
+    std::unordered_map<int64_t, Entries::iterator> _entries;
+
+    unsigned long long _hits;
+    unsigned long long _misses;
+};
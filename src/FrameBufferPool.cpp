@@ -0,0 +1,189 @@
+#include "FrameBufferPool.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#ifdef _WIN32
+    #include <malloc.h>
+#endif
+#ifdef __linux__
+    #include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+//upper limit of memory kept for reuse, enough for several 4K RGBA frames
+const size_t MaxFreeBytes = 256 * 1024 * 1024;
+
+//rounding capacity up improves chances of reuse for slightly different sizes
+const size_t CapacityGranularity = 64 * 1024;
+
+//don't waste big block for much smaller request
+const size_t MaxCapacityToSizeRatio = 2;
+
+#ifdef __linux__
+//transparent huge pages reduce TLB misses on big frames,
+//smallest 4K frame (GREY) is the threshold
+const size_t HugePageMinSize = 3840 * 2160;
+const size_t HugePageSize = 2 * 1024 * 1024;
+#endif
+
+}
+
+const size_t FrameBufferPool::Alignment;
+
+///////////////////////////////////////////////////////////////////////////////
+FrameBufferPool::Buffer::Buffer( Buffer&& other ) :
+    _pool( other._pool ), _block( other._block ), _size( other._size )
+{
+    other._pool = nullptr;
+    other._block.data = nullptr;
+    other._block.capacity = 0;
+    other._size = 0;
+}
+
+FrameBufferPool::Buffer& FrameBufferPool::Buffer::operator = ( Buffer&& other )
+{
+    if( this != &other ) {
+        reset();
+
+        std::swap( _pool, other._pool );
+        std::swap( _block, other._block );
+        std::swap( _size, other._size );
+    }
+
+    return *this;
+}
+
+void FrameBufferPool::Buffer::reset()
+{
+    if( _pool && _block.data )
+        _pool->release( _block );
+
+    _pool = nullptr;
+    _block.data = nullptr;
+    _block.capacity = 0;
+    _size = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+FrameBufferPool& FrameBufferPool::instance()
+{
+    //intentionally never destroyed, since buffers could be returned
+    //by objects destroyed after static destructors
+    static FrameBufferPool* pool = new FrameBufferPool;
+    return *pool;
+}
+
+FrameBufferPool::FrameBufferPool() :
+    _freeBytes( 0 )
+{
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+    for( const Block& block: _freeBlocks )
+        free( block );
+}
+
+FrameBufferPool::Buffer FrameBufferPool::acquire( size_t size )
+{
+    if( 0 == size )
+        return Buffer();
+
+    {
+        std::lock_guard<std::mutex> lock( _guard );
+
+        auto best = _freeBlocks.end();
+        for( auto it = _freeBlocks.begin(); it != _freeBlocks.end(); ++it ) {
+            if( it->capacity < size || it->capacity / MaxCapacityToSizeRatio > size )
+                continue;
+
+            if( best == _freeBlocks.end() || it->capacity < best->capacity )
+                best = it;
+        }
+
+        if( best != _freeBlocks.end() ) {
+            const Block block = *best;
+            _freeBlocks.erase( best );
+            _freeBytes -= block.capacity;
+
+            return Buffer( this, block, size );
+        }
+    }
+
+    const Block block = allocate( size );
+    if( !block.data )
+        return Buffer();
+
+    return Buffer( this, block, size );
+}
+
+void FrameBufferPool::release( const Block& block )
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    _freeBlocks.push_back( block );
+    _freeBytes += block.capacity;
+
+    //least recently released blocks are evicted first
+    std::deque<Block> evicted;
+    while( _freeBytes > MaxFreeBytes && !_freeBlocks.empty() ) {
+        _freeBytes -= _freeBlocks.front().capacity;
+        evicted.push_back( _freeBlocks.front() );
+        _freeBlocks.pop_front();
+    }
+
+    lock.unlock();
+
+    for( const Block& b: evicted )
+        free( b );
+}
+
+FrameBufferPool::Block FrameBufferPool::allocate( size_t size )
+{
+    size_t alignment = Alignment;
+    size_t granularity = CapacityGranularity;
+#ifdef __linux__
+    if( size >= HugePageMinSize ) {
+        alignment = HugePageSize;
+        granularity = HugePageSize;
+    }
+#endif
+
+    Block block;
+    block.capacity = ( size + granularity - 1 ) / granularity * granularity;
+
+#ifdef _WIN32
+    block.data = static_cast<char*>( _aligned_malloc( block.capacity, alignment ) );
+#else
+    void* data = nullptr;
+    if( 0 != posix_memalign( &data, alignment, block.capacity ) )
+        data = nullptr;
+    block.data = static_cast<char*>( data );
+#endif
+
+#if defined( __linux__ ) && defined( MADV_HUGEPAGE )
+    //it's just a hint, so failure is not an error
+    if( block.data && HugePageSize == alignment )
+        madvise( block.data, block.capacity, MADV_HUGEPAGE );
+#endif
+
+    if( !block.data )
+        block.capacity = 0;
+
+    assert( 0 == reinterpret_cast<uintptr_t>( block.data ) % Alignment );
+
+    return block;
+}
+
+void FrameBufferPool::free( const Block& block )
+{
+#ifdef _WIN32
+    _aligned_free( block.data );
+#else
+    ::free( block.data );
+#endif
+}
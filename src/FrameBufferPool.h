@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <deque>
+#include <mutex>
+
+///////////////////////////////////////////////////////////////////////////////
+// Process wide pool of aligned frame sized allocations,
+// to not churn large allocations on every video output (re)configuration.
+class FrameBufferPool
+{
+public:
+    static const size_t Alignment = 64;
+
+    class Buffer;
+
+    static FrameBufferPool& instance();
+
+    ~FrameBufferPool();
+
+    //returns smallest free buffer with capacity of at least size bytes,
+    //or allocates new one
+    Buffer acquire( size_t size );
+
+private:
+    FrameBufferPool();
+
+    FrameBufferPool( const FrameBufferPool& ) = delete;
+    FrameBufferPool& operator = ( const FrameBufferPool& ) = delete;
+
+    struct Block
+    {
+        char* data;
+        size_t capacity;
+    };
+
+    void release( const Block& );
+
+    static Block allocate( size_t size );
+    static void free( const Block& );
+
+private:
+    std::mutex _guard;
+    //most recently released blocks are at the back
+    std::deque<Block> _freeBlocks;
+    size_t _freeBytes;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Move only owner of pooled block, returns it to pool on destruction.
+class FrameBufferPool::Buffer
+{
+public:
+    Buffer() :
+        _pool( nullptr ), _block( { nullptr, 0 } ), _size( 0 ) {}
+    Buffer( Buffer&& other );
+    ~Buffer()
+        { reset(); }
+
+    Buffer& operator = ( Buffer&& other );
+
+    char* data() const
+        { return _block.data; }
+    size_t size() const
+        { return _size; }
+    size_t capacity() const
+        { return _block.capacity; }
+
+    void reset();
+
+private:
+    friend FrameBufferPool;
+
+    Buffer( FrameBufferPool* pool, const Block& block, size_t size ) :
+        _pool( pool ), _block( block ), _size( size ) {}
+
+    Buffer( const Buffer& ) = delete;
+    Buffer& operator = ( const Buffer& ) = delete;
+
+private:
+    FrameBufferPool* _pool;
+    Block _block;
+    size_t _size;
+};
@@ -0,0 +1,40 @@
+#include "FrameCoalescer.h"
+
+FrameCoalescer::FrameCoalescer() :
+    _pendingFrames( 0 ), _undeliveredFrames( 0 ), _droppedFrames( 0 )
+{
+}
+
+bool FrameCoalescer::frameDisplayed()
+{
+    //following frames just supersede the first one
+    return 0 == _pendingFrames.fetch_add( 1 );
+}
+
+unsigned FrameCoalescer::take()
+{
+    const unsigned frames = _pendingFrames.exchange( 0 ) + _undeliveredFrames;
+    _undeliveredFrames = 0;
+
+    return frames;
+}
+
+void FrameCoalescer::undelivered( unsigned frames )
+{
+    //can't put them back to _pendingFrames: next frameDisplayed() wouldn't notify gui thread
+    _undeliveredFrames = frames;
+}
+
+unsigned FrameCoalescer::delivered( unsigned frames, unsigned skippedFrames )
+{
+    const unsigned droppedFrames = ( frames > 0 ? frames - 1 : 0 ) + skippedFrames;
+    _droppedFrames += droppedFrames;
+
+    return droppedFrames;
+}
+
+void FrameCoalescer::discard()
+{
+    _droppedFrames += _undeliveredFrames;
+    _undeliveredFrames = 0;
+}
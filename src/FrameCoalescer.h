@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+
+///////////////////////////////////////////////////////////////////////////////
+// Coalesces frames displayed by decoder into one pending delivery
+// and counts frames superseded before gui thread delivered them.
+// frameDisplayed() is called from decoder thread, everything else from gui thread.
+class FrameCoalescer
+{
+public:
+    FrameCoalescer();
+
+    //returns true only for the first frame since last take(),
+    //so only that one should notify gui thread
+    bool frameDisplayed();
+
+    //decoder displayed frames since last take()
+    bool pending() const
+        { return 0 != _pendingFrames.load(); }
+    //frames displayed since last take(), including the undelivered ones
+    unsigned take();
+    //none of taken frames could be delivered, they are counted again by the next take()
+    void undelivered( unsigned frames );
+    //the newest of taken frames was delivered, every other one is dropped,
+    //returns count of dropped frames including skippedFrames
+    unsigned delivered( unsigned frames, unsigned skippedFrames );
+    //undelivered frames will never be delivered now
+    void discard();
+
+    //total count of dropped frames
+    unsigned long long droppedFrames() const
+        { return _droppedFrames; }
+    void resetDroppedFrames()
+        { _droppedFrames = 0; }
+
+private:
+    std::atomic<unsigned> _pendingFrames;
+    unsigned _undeliveredFrames;
+    unsigned long long _droppedFrames;
+};
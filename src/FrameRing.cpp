@@ -0,0 +1,210 @@
+#include "FrameRing.h"
+
+#include <cassert>
+
+FrameRing::FrameRing( unsigned slotCount, Policy policy, std::chrono::milliseconds maxBlockTime ) :
+    _slotCount( slotCount ), _policy( policy ), _maxBlockTime( maxBlockTime ),
+    _buffersReady( false ), _releaseGeneration( 0 ),
+    _skippedFrames( 0 )
+{
+    assert( _slotCount > 0 );
+}
+
+void FrameRing::waitBuffers()
+{
+    std::unique_lock<std::mutex> lock( _guard );
+    while( !_buffersReady )
+        _waiter.wait( lock );
+}
+
+void FrameRing::setBuffers( const std::vector<void*>& buffers, const FrameInfo* leased )
+{
+    assert( buffers.size() == _slotCount );
+
+    std::unique_lock<std::mutex> lock( _guard );
+
+    _slots.clear();
+    for( void* buffer: buffers ) {
+        Slot slot = { static_cast<char*>( buffer ), SlotState::Free, { -1, 0 } };
+        _slots.push_back( slot );
+    }
+
+    if( leased ) {
+        _slots[0].state = SlotState::Leased;
+        _slots[0].info = *leased;
+    }
+
+    _buffersReady = true;
+    _waiter.notify_all();
+}
+
+char* FrameRing::buffer( unsigned slot ) const
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    return slot < _slots.size() ? _slots[slot].buffer : nullptr;
+}
+
+unsigned FrameRing::acquireSlot( std::unique_lock<std::mutex>& lock )
+{
+    //decoder could start before buffers are set
+    if( !_buffersReady )
+        return scratchSlot();
+
+    //single buffer is always shared between decoder and gui thread
+    if( 1 == _slots.size() )
+        return 0;
+
+    //vmem keeps only one picture in flight,
+    //so picture acquired but never displayed could be reused
+    for( Slot& slot: _slots ) {
+        if( SlotState::Decoding == slot.state )
+            slot.state = SlotState::Free;
+    }
+
+    const std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + _maxBlockTime;
+    //releaseAll() wakes up only decoder waiting at that moment
+    const unsigned releaseGeneration = _releaseGeneration;
+
+    for( ;; ) {
+        for( unsigned i = 0; i < _slots.size(); ++i ) {
+            if( SlotState::Free == _slots[i].state )
+                return i;
+        }
+
+        switch( _policy ) {
+            case Policy::DropOldest: {
+                unsigned oldest = scratchSlot();
+                for( unsigned i = 0; i < _slots.size(); ++i ) {
+                    if( SlotState::Displayed == _slots[i].state &&
+                        ( oldest == scratchSlot() || _slots[i].info.sequence < _slots[oldest].info.sequence ) )
+                    {
+                        oldest = i;
+                    }
+                }
+                return oldest;
+            }
+            case Policy::DropNewest:
+                return scratchSlot();
+            case Policy::Block:
+            default:
+                if( releaseGeneration != _releaseGeneration ||
+                    std::cv_status::timeout == _waiter.wait_until( lock, deadline ) )
+                {
+                    return scratchSlot();
+                }
+                break;
+        }
+    }
+}
+
+unsigned FrameRing::acquire( char** buffer )
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    const unsigned slot = acquireSlot( lock );
+    if( slot < _slots.size() ) {
+        _slots[slot].state = SlotState::Decoding;
+        *buffer = _slots[slot].buffer;
+    } else {
+        *buffer = nullptr;
+    }
+
+    return slot;
+}
+
+bool FrameRing::display( unsigned slot, const FrameInfo& info )
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    if( slot >= _slots.size() ) {
+        ++_skippedFrames;
+        return false;
+    }
+
+    _slots[slot].state = SlotState::Displayed;
+    _slots[slot].info = info;
+
+    return true;
+}
+
+unsigned FrameRing::takeSkippedFrames()
+{
+    return _skippedFrames.exchange( 0 );
+}
+
+bool FrameRing::lease( unsigned* slot, FrameInfo* info )
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    //single buffer is always shared between decoder and gui thread,
+    //so decoder could already acquire it for the next picture
+    if( 1 == _slots.size() ) {
+        *slot = 0;
+        *info = _slots[0].info;
+        return true;
+    }
+
+    unsigned newest = static_cast<unsigned>( _slots.size() );
+    for( unsigned i = 0; i < _slots.size(); ++i ) {
+        if( SlotState::Displayed != _slots[i].state )
+            continue;
+
+        if( newest == _slots.size() ) {
+            newest = i;
+        } else if( _slots[i].info.sequence > _slots[newest].info.sequence ) {
+            _slots[newest].state = SlotState::Free;
+            newest = i;
+        } else {
+            _slots[i].state = SlotState::Free;
+        }
+    }
+
+    if( newest == _slots.size() )
+        return false;
+
+    _slots[newest].state = SlotState::Leased;
+    *slot = newest;
+    *info = _slots[newest].info;
+
+    _waiter.notify_all();
+
+    return true;
+}
+
+void FrameRing::release( unsigned slot )
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    if( slot < _slots.size() && SlotState::Leased == _slots[slot].state ) {
+        _slots[slot].state = SlotState::Free;
+        _waiter.notify_all();
+    }
+}
+
+void FrameRing::releaseAll()
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    for( Slot& slot: _slots ) {
+        if( SlotState::Decoding != slot.state )
+            slot.state = SlotState::Free;
+    }
+
+    ++_releaseGeneration;
+    _waiter.notify_all();
+}
+
+bool FrameRing::displayedInfo( unsigned slot, FrameInfo* info ) const
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    //sequence starts from 1, so 0 means slot never got displayed picture
+    if( slot >= _slots.size() || 0 == _slots[slot].info.sequence )
+        return false;
+
+    *info = _slots[slot].info;
+
+    return true;
+}
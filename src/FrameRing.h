@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Ring of frame buffers shared between decoder and gui thread.
+// Decoder acquires free slot, decodes picture to it and displays it,
+// gui thread leases the newest displayed slot and releases it when it's not needed anymore.
+// Buffers are owned by caller, ring only tracks slot states.
+class FrameRing
+{
+public:
+    //what decoder should do when all slots are leased
+    enum class Policy
+    {
+        Block = 0,
+        DropOldest,
+        DropNewest,
+    };
+
+    struct FrameInfo
+    {
+        //playback time when picture was displayed, -1 if unknown
+        int64_t time;
+        //increments for every picture displayed by decoder and never resets,
+        //so gaps mean pictures which were not delivered
+        unsigned long long sequence;
+    };
+
+    //Policy::Block waits for released slot at most maxBlockTime
+    FrameRing( unsigned slotCount, Policy policy, std::chrono::milliseconds maxBlockTime );
+
+    unsigned slotCount() const
+        { return _slotCount; }
+    //slot of frames which will be dropped, there is no buffer for it
+    unsigned scratchSlot() const
+        { return _slotCount; }
+
+    void waitBuffers();
+    //if leased is not null, slot 0 already has picture and is leased
+    void setBuffers( const std::vector<void*>& buffers, const FrameInfo* leased = nullptr );
+    //null for scratch slot or if buffers are not set yet
+    char* buffer( unsigned slot ) const;
+
+    //called from decoder thread,
+    //returns slot picture should be decoded to and its buffer,
+    //scratchSlot() and null if there is no slot for it
+    unsigned acquire( char** buffer );
+    //returns false if picture was decoded to scratch slot, so it's dropped
+    bool display( unsigned slot, const FrameInfo& );
+    //count of pictures displayed to scratch slot since last call
+    unsigned takeSkippedFrames();
+
+    //leases newest displayed slot, older displayed but not leased slots are freed
+    bool lease( unsigned* slot, FrameInfo* info );
+    void release( unsigned slot );
+    //frees every slot except the one decoder is writing to
+    void releaseAll();
+
+    //info of picture displayed to slot, fails if nothing was displayed to slot yet
+    bool displayedInfo( unsigned slot, FrameInfo* info ) const;
+
+private:
+    enum class SlotState
+    {
+        Free,
+        Decoding,
+        Displayed,
+        Leased,
+    };
+
+    struct Slot
+    {
+        char* buffer;
+        SlotState state;
+        FrameInfo info;
+    };
+
+    unsigned acquireSlot( std::unique_lock<std::mutex>& lock );
+
+private:
+    const unsigned _slotCount;
+    const Policy _policy;
+    const std::chrono::milliseconds _maxBlockTime;
+
+    mutable std::mutex _guard;
+    std::condition_variable _waiter;
+    bool _buffersReady;
+    //incremented by every releaseAll()
+    unsigned _releaseGeneration;
+    std::vector<Slot> _slots;
+    std::atomic<unsigned> _skippedFrames;
+};
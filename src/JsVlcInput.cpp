@@ -40,6 +40,9 @@ void JsVlcInput::initJsApi()
     SET_RW_PROPERTY( instanceTemplate, "rateReverse",
                      &JsVlcInput::rateReverse,
                      &JsVlcInput::setRateReverse );
+    SET_RW_PROPERTY( instanceTemplate, "trickPlayRate",
+                     &JsVlcInput::trickPlayRate,
+                     &JsVlcInput::setTrickPlayRate );
 
     Local<Function> constructor = constructorTemplate->GetFunction( isolate->GetCurrentContext() ).ToLocalChecked();
     _jsConstructor.Reset( isolate, constructor );
@@ -89,7 +92,8 @@ void JsVlcInput::jsCreate( const v8::FunctionCallbackInfo<v8::Value>& args )
 
 JsVlcInput::JsVlcInput( v8::Local<v8::Object>& thisObject, JsVlcPlayer* jsPlayer ) :
     _jsPlayer( jsPlayer ),
-    _rateReverse( 1.0 )
+    _rateReverse( 1.0 ),
+    _trickPlayRate( 8.0 )
 {
     Wrap( thisObject );
 
@@ -138,12 +142,12 @@ void JsVlcInput::setTime( double time )
 
 double JsVlcInput::rate()
 {
-    return _jsPlayer->player().playback().get_rate();
+    return _jsPlayer->rate();
 }
 
 void JsVlcInput::setRate( double rate )
 {
-    _jsPlayer->player().playback().set_rate( static_cast<float>( rate ) );
+    _jsPlayer->setRate( rate );
 }
 
 double JsVlcInput::rateReverse()
@@ -155,3 +159,16 @@ void JsVlcInput::setRateReverse( double rateReverse )
 {
     _rateReverse = rateReverse;
 }
+
+double JsVlcInput::trickPlayRate()
+{
+    return _trickPlayRate;
+}
+
+void JsVlcInput::setTrickPlayRate( double trickPlayRate )
+{
+    _trickPlayRate = trickPlayRate;
+
+    //current rate could cross new threshold
+    _jsPlayer->setRate( _jsPlayer->rate() );
+}
@@ -31,6 +31,9 @@ public:
     double rateReverse();
     void setRateReverse( double );
 
+    double trickPlayRate();
+    void setTrickPlayRate( double );
+
 
 private:
     static void jsCreate( const v8::FunctionCallbackInfo<v8::Value>& args );
@@ -42,4 +45,5 @@ private:
     JsVlcPlayer* _jsPlayer;
 
     double _rateReverse;
+    double _trickPlayRate;
 };
@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <cmath>
+#include <stdio.h>
 #include <string.h>
 #include <thread>
 #include <v8.h>
@@ -12,6 +13,7 @@
 #include "JsVlcVideo.h"
 #include "JsVlcSubtitles.h"
 #include "JsVlcPlaylist.h"
+#include "FrameBufferPool.h"
 
 #if V8_MAJOR_VERSION > 4 || \
     ( V8_MAJOR_VERSION == 4 && V8_MINOR_VERSION > 4 ) || \
@@ -24,11 +26,85 @@
 #undef min
 #undef max
 
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+#ifdef USE_ARRAY_BUFFER
+
+// Frame memory allocated natively and owned by ArrayBuffer,
+// returned to FrameBufferPool when ArrayBuffer is collected.
+struct NativeFrameStore
+{
+    FrameBufferPool::Buffer buffer;
+#if V8_MAJOR_VERSION < 8
+    v8::UniquePersistent<v8::ArrayBuffer> jsStore;
+#endif
+};
+
+v8::Local<v8::ArrayBuffer> NewNativeFrameStore( v8::Isolate* isolate, size_t size )
+{
+    using namespace v8;
+
+    std::unique_ptr<NativeFrameStore> store( new NativeFrameStore );
+    store->buffer = FrameBufferPool::instance().acquire( size );
+    if( !store->buffer.data() )
+        return Local<ArrayBuffer>();
+
+    char* data = store->buffer.data();
+    const size_t capacity = store->buffer.capacity();
+
+#if V8_MAJOR_VERSION >= 8
+    // V8 accounts external memory of backing stores by itself,
+    // and deleter could be called from any thread.
+    std::shared_ptr<BackingStore> backingStore =
+        ArrayBuffer::NewBackingStore(
+            data, capacity,
+            [] ( void* /*data*/, size_t /*length*/, void* deleterData ) {
+                delete static_cast<NativeFrameStore*>( deleterData );
+            },
+            store.release() );
+
+    return ArrayBuffer::New( isolate, backingStore );
+#else
+    Local<ArrayBuffer> jsStore = ArrayBuffer::New( isolate, data, capacity );
+
+    // Let GC know real memory pressure of externalized frame stores.
+    isolate->AdjustAmountOfExternalAllocatedMemory( static_cast<int64_t>( capacity ) );
+
+    store->jsStore.Reset( isolate, jsStore );
+    NativeFrameStore* weakStore = store.release();
+    weakStore->jsStore.SetWeak( weakStore,
+        [] ( const WeakCallbackInfo<NativeFrameStore>& info ) {
+            NativeFrameStore* store = info.GetParameter();
+            info.GetIsolate()->AdjustAmountOfExternalAllocatedMemory(
+                -static_cast<int64_t>( store->buffer.capacity() ) );
+            delete store;
+        },
+        WeakCallbackType::kParameter );
+
+    return jsStore;
+#endif
+}
+
+inline void* ArrayBufferData( const v8::Local<v8::ArrayBuffer>& jsStore )
+{
+#if V8_MAJOR_VERSION >= 8
+    return jsStore->GetBackingStore()->Data();
+#else
+    return jsStore->GetContents().Data();
+#endif
+}
+
+#endif
+
+}
+
 const char* JsVlcPlayer::callbackNames[] =
 {
     "FrameSetup",
     "FrameReady",
     "FrameCleanup",
+    "CuePoint",
 
     "MediaChanged",
     "NothingSpecial",
@@ -49,74 +125,27 @@ const char* JsVlcPlayer::callbackNames[] =
     "PausableChanged",
     "LengthChanged",
 
-    "LogMessage"
-};
-
-v8::Persistent<v8::Function> JsVlcPlayer::_jsConstructor;
-std::set<JsVlcPlayer*> JsVlcPlayer::_instances;
-
-///////////////////////////////////////////////////////////////////////////////
-struct JsVlcPlayer::AsyncData
-{
-    virtual void process( JsVlcPlayer* ) = 0;
-};
-
-///////////////////////////////////////////////////////////////////////////////
-struct JsVlcPlayer::CallbackData : public JsVlcPlayer::AsyncData
-{
-    CallbackData( JsVlcPlayer::Callbacks_e callback ) :
-        callback( callback ) {}
-
-    void process( JsVlcPlayer* );
-
-    const JsVlcPlayer::Callbacks_e callback;
-};
-
-void JsVlcPlayer::CallbackData::process( JsVlcPlayer* jsPlayer )
-{
-    jsPlayer->callCallback( callback );
-}
-
-///////////////////////////////////////////////////////////////////////////////
-struct JsVlcPlayer::LibvlcEvent : public JsVlcPlayer::AsyncData
-{
-    LibvlcEvent( const libvlc_event_t& libvlcEvent ) :
-        libvlcEvent( libvlcEvent ) {}
-
-    void process( JsVlcPlayer* );
+    "LogMessage",
 
-    const libvlc_event_t libvlcEvent;
+    "EventBatch"
 };
 
-void JsVlcPlayer::LibvlcEvent::process( JsVlcPlayer* jsPlayer )
-{
-    jsPlayer->handleLibvlcEvent( libvlcEvent );
-}
-
-///////////////////////////////////////////////////////////////////////////////
-struct JsVlcPlayer::LibvlcLogEvent : public JsVlcPlayer::AsyncData
-{
-    LibvlcLogEvent( int level, const std::string& message, const std::string& format ) :
-        level( level ), message( message ), format( format ) {}
-
-    void process( JsVlcPlayer* );
-
-    const int level;
-    std::string message;
-    std::string format;
+const char* JsVlcPlayer::snapshotFieldNames[] =
+{
+    "SnapshotTime",
+    "SnapshotFrame",
+    "SnapshotPosition",
+    "SnapshotLength",
+    "SnapshotState",
+    "SnapshotPlaying",
+    "SnapshotRate",
+    "SnapshotFps",
+    "SnapshotFrames"
 };
 
-void JsVlcPlayer::LibvlcLogEvent::process( JsVlcPlayer* jsPlayer )
-{
-    v8::Isolate* isolate = v8::Isolate::GetCurrent();
-    v8::HandleScope scope( isolate );
-
-    v8::Local<v8::Integer> jsLevel = v8::Integer::New( isolate, level );
-    v8::Local<v8::String> jsMessage = v8::String::NewFromUtf8( isolate, message.c_str(), v8::NewStringType::kNormal ).ToLocalChecked();
-    v8::Local<v8::String> jsFormat = v8::String::NewFromUtf8( isolate, format.c_str(), v8::NewStringType::kNormal ).ToLocalChecked();
-
-    jsPlayer->callCallback( CB_LogMessage, { jsLevel, jsMessage, jsFormat } );
-}
+v8::Persistent<v8::Function> JsVlcPlayer::_jsConstructor;
+std::set<JsVlcPlayer*> JsVlcPlayer::_instances;
+unsigned JsVlcPlayer::_lastInstanceId = 0;
 
 ///////////////////////////////////////////////////////////////////////////////
 #define SET_CALLBACK_PROPERTY( objTemplate, name, callback )                                                                     \
@@ -163,6 +192,51 @@ void JsVlcPlayer::initJsApi( const v8::Handle<v8::Object>& exports )
     protoTemplate->Set( String::NewFromUtf8( isolate, "I420", NewStringType::kInternalized ).ToLocalChecked(),
                         Integer::New( isolate, static_cast<int>( PixelFormat::I420 ) ),
                         static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    protoTemplate->Set( String::NewFromUtf8( isolate, "RGBA", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( PixelFormat::RGBA ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    protoTemplate->Set( String::NewFromUtf8( isolate, "NV12", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( PixelFormat::NV12 ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    protoTemplate->Set( String::NewFromUtf8( isolate, "GREY", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( PixelFormat::GREY ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+
+    for( unsigned i = 0; i < SF_Max; ++i ) {
+        protoTemplate->Set( String::NewFromUtf8( isolate, snapshotFieldNames[i], NewStringType::kInternalized ).ToLocalChecked(),
+                            Integer::New( isolate, static_cast<int>( i ) ),
+                            static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    }
+    protoTemplate->Set( String::NewFromUtf8( isolate, "SnapshotFieldCount", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( SF_Max ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+
+    protoTemplate->Set( String::NewFromUtf8( isolate, "Block", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( FrameBufferPolicy::Block ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    protoTemplate->Set( String::NewFromUtf8( isolate, "DropOldest", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( FrameBufferPolicy::DropOldest ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    protoTemplate->Set( String::NewFromUtf8( isolate, "DropNewest", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( FrameBufferPolicy::DropNewest ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+
+    protoTemplate->Set( String::NewFromUtf8( isolate, "AutoColorMatrix", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( ColorMatrix::Auto ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    protoTemplate->Set( String::NewFromUtf8( isolate, "BT601", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( ColorMatrix::BT601 ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    protoTemplate->Set( String::NewFromUtf8( isolate, "BT709", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( ColorMatrix::BT709 ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+
+    protoTemplate->Set( String::NewFromUtf8( isolate, "LimitedRange", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( ColorRange::Limited ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    protoTemplate->Set( String::NewFromUtf8( isolate, "FullRange", NewStringType::kInternalized ).ToLocalChecked(),
+                        Integer::New( isolate, static_cast<int>( ColorRange::Full ) ),
+                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
 
     protoTemplate->Set( String::NewFromUtf8( isolate, "NothingSpecial", NewStringType::kInternalized ).ToLocalChecked(),
                         Integer::New( isolate, libvlc_NothingSpecial ),
@@ -202,6 +276,7 @@ void JsVlcPlayer::initJsApi( const v8::Handle<v8::Object>& exports )
     SET_CALLBACK_PROPERTY( instanceTemplate, "onFrameSetup", CB_FrameSetup );
     SET_CALLBACK_PROPERTY( instanceTemplate, "onFrameReady", CB_FrameReady );
     SET_CALLBACK_PROPERTY( instanceTemplate, "onFrameCleanup", CB_FrameCleanup );
+    SET_CALLBACK_PROPERTY( instanceTemplate, "onCuePoint", CB_CuePoint );
 
     SET_CALLBACK_PROPERTY( instanceTemplate, "onMediaChanged", CB_MediaPlayerMediaChanged );
     SET_CALLBACK_PROPERTY( instanceTemplate, "onNothingSpecial", CB_MediaPlayerNothingSpecial );
@@ -224,11 +299,24 @@ void JsVlcPlayer::initJsApi( const v8::Handle<v8::Object>& exports )
 
     SET_CALLBACK_PROPERTY( instanceTemplate, "onLogMessage", CB_LogMessage );
 
+    SET_CALLBACK_PROPERTY( instanceTemplate, "onEventBatch", CB_EventBatch );
+
     SET_RO_PROPERTY( instanceTemplate, "playing", &JsVlcPlayer::playing );
     SET_RO_PROPERTY( instanceTemplate, "playingReverse", &JsVlcPlayer::playingReverse );
+    SET_RO_PROPERTY( instanceTemplate, "reverseFps", &JsVlcPlayer::reverseFps );
+    SET_RO_PROPERTY( instanceTemplate, "trickPlaying", &JsVlcPlayer::trickPlaying );
+    SET_RO_PROPERTY( instanceTemplate, "loopCached", &JsVlcPlayer::loopCached );
+    SET_RO_PROPERTY( instanceTemplate, "prerollHits", &JsVlcPlayer::prerollHits );
+    SET_RO_PROPERTY( instanceTemplate, "prerollMisses", &JsVlcPlayer::prerollMisses );
     SET_RO_PROPERTY( instanceTemplate, "length", &JsVlcPlayer::length );
     SET_RO_PROPERTY( instanceTemplate, "frames", &JsVlcPlayer::frames );
+    SET_RO_PROPERTY( instanceTemplate, "indexed", &JsVlcPlayer::indexed );
+    SET_RO_PROPERTY( instanceTemplate, "frameCacheHits", &JsVlcPlayer::frameCacheHits );
+    SET_RO_PROPERTY( instanceTemplate, "frameCacheMisses", &JsVlcPlayer::frameCacheMisses );
     SET_RO_PROPERTY( instanceTemplate, "state", &JsVlcPlayer::state );
+    SET_RO_PROPERTY( instanceTemplate, "droppedFrames", &JsVlcPlayer::droppedFrames );
+    SET_RO_PROPERTY( instanceTemplate, "timeToFirstFrame", &JsVlcPlayer::timeToFirstFrame );
+    SET_RO_PROPERTY( instanceTemplate, "conversionKernel", &JsVlcPlayer::conversionKernel );
 
     SET_RO_PROPERTY( instanceTemplate, "input", &JsVlcPlayer::input );
     SET_RO_PROPERTY( instanceTemplate, "audio", &JsVlcPlayer::audio );
@@ -240,13 +328,34 @@ void JsVlcPlayer::initJsApi( const v8::Handle<v8::Object>& exports )
     SET_RO_PROPERTY( instanceTemplate, "events", &JsVlcPlayer::getEventEmitter );
 
     SET_RW_PROPERTY( instanceTemplate, "pixelFormat", &JsVlcPlayer::pixelFormat, &JsVlcPlayer::setPixelFormat );
+    SET_RW_PROPERTY( instanceTemplate, "frameBufferCount", &JsVlcPlayer::frameBufferCount, &JsVlcPlayer::setFrameBufferCount );
+    SET_RW_PROPERTY( instanceTemplate, "frameBufferPolicy", &JsVlcPlayer::frameBufferPolicy, &JsVlcPlayer::setFrameBufferPolicy );
+    SET_RW_PROPERTY( instanceTemplate, "rowAlignment", &JsVlcPlayer::rowAlignment, &JsVlcPlayer::setRowAlignment );
+    SET_RW_PROPERTY( instanceTemplate, "frameCacheSize", &JsVlcPlayer::frameCacheSize, &JsVlcPlayer::setFrameCacheSize );
+    SET_RW_PROPERTY( instanceTemplate, "prefetchFrames", &JsVlcPlayer::prefetchFrames, &JsVlcPlayer::setPrefetchFrames );
+    SET_RW_PROPERTY( instanceTemplate, "prerollTime", &JsVlcPlayer::prerollTime, &JsVlcPlayer::setPrerollTime );
+    SET_RW_PROPERTY( instanceTemplate, "rgbaConversion", &JsVlcPlayer::rgbaConversion, &JsVlcPlayer::setRGBAConversion );
+    SET_RW_PROPERTY( instanceTemplate, "colorMatrix", &JsVlcPlayer::colorMatrix, &JsVlcPlayer::setColorMatrix );
+    SET_RW_PROPERTY( instanceTemplate, "colorRange", &JsVlcPlayer::colorRange, &JsVlcPlayer::setColorRange );
     SET_RW_PROPERTY( instanceTemplate, "position", &JsVlcPlayer::position, &JsVlcPlayer::setPosition );
     SET_RW_PROPERTY( instanceTemplate, "time", &JsVlcPlayer::time, &JsVlcPlayer::setTime );
+    SET_RW_PROPERTY( instanceTemplate, "scrubbing", &JsVlcPlayer::scrubbing, &JsVlcPlayer::setScrubbing );
+    SET_RW_PROPERTY( instanceTemplate, "keyframeScrubbing", &JsVlcPlayer::keyframeScrubbing, &JsVlcPlayer::setKeyframeScrubbing );
     SET_RW_PROPERTY( instanceTemplate, "frame", &JsVlcPlayer::frame, &JsVlcPlayer::setFrame );
     SET_RW_PROPERTY( instanceTemplate, "volume", &JsVlcPlayer::volume, &JsVlcPlayer::setVolume );
     SET_RW_PROPERTY( instanceTemplate, "mute", &JsVlcPlayer::muted, &JsVlcPlayer::setMuted );
+    SET_RW_PROPERTY( instanceTemplate, "batchEvents", &JsVlcPlayer::batchEvents, &JsVlcPlayer::setBatchEvents );
+    SET_RW_PROPERTY( instanceTemplate, "eventThrottleMs", &JsVlcPlayer::eventThrottleMs, &JsVlcPlayer::setEventThrottleMs );
 
     NODE_SET_PROTOTYPE_METHOD( constructorTemplate, "load", jsLoad );
+    SET_METHOD( constructorTemplate, "preload", &JsVlcPlayer::preload );
+    NODE_SET_PROTOTYPE_METHOD( constructorTemplate, "setOutputSize", jsSetOutputSize );
+    NODE_SET_PROTOTYPE_METHOD( constructorTemplate, "seekToFrame", jsSeekToFrame );
+    NODE_SET_PROTOTYPE_METHOD( constructorTemplate, "setLoop", jsSetLoop );
+    SET_METHOD( constructorTemplate, "clearLoop", &JsVlcPlayer::clearLoop );
+    NODE_SET_PROTOTYPE_METHOD( constructorTemplate, "addCuePoint", jsAddCuePoint );
+    SET_METHOD( constructorTemplate, "removeCuePoint", &JsVlcPlayer::removeCuePoint );
+    NODE_SET_PROTOTYPE_METHOD( constructorTemplate, "snapshot", jsSnapshot );
     SET_METHOD( constructorTemplate, "play", &JsVlcPlayer::play );
     SET_METHOD( constructorTemplate, "playReverse", &JsVlcPlayer::playReverse );
     SET_METHOD( constructorTemplate, "pause", &JsVlcPlayer::pause );
@@ -255,6 +364,8 @@ void JsVlcPlayer::initJsApi( const v8::Handle<v8::Object>& exports )
     SET_METHOD( constructorTemplate, "toggleMute", &JsVlcPlayer::toggleMute );
     SET_METHOD( constructorTemplate, "previousFrame", &JsVlcPlayer::previousFrame );
     SET_METHOD( constructorTemplate, "nextFrame", &JsVlcPlayer::nextFrame );
+    SET_METHOD( constructorTemplate, "releaseFrame", &JsVlcPlayer::releaseJsFrame );
+    SET_METHOD( constructorTemplate, "setCropRegion", &JsVlcPlayer::setCropRegion );
 
     SET_METHOD( constructorTemplate, "close", &JsVlcPlayer::close );
 
@@ -305,7 +416,16 @@ void JsVlcPlayer::closeAll()
 }
 
 JsVlcPlayer::JsVlcPlayer( v8::Local<v8::Object>& thisObject, const v8::Local<v8::Array>& vlcOpts ) :
+    _instanceId( ++_lastInstanceId ),
     _libvlc( nullptr ),
+    _overflow( false ),
+    _frameDelivered( false ),
+    _undeliveredDroppedFrames( 0 ),
+    _currentFrameInfo( { InvalidTime, 0 } ),
+    _batchEvents( false ),
+    _wantedCallbacks( 0 ),
+    _eventThrottleMs( 0 ),
+    _throttledEvents{ { CB_MediaPlayerTimeChanged, false, 0 }, { CB_MediaPlayerPositionChanged, false, 0 } },
     _cppInput( nullptr ),
     _cppAudio( nullptr ),
     _cppVideo( nullptr ),
@@ -315,32 +435,87 @@ JsVlcPlayer::JsVlcPlayer( v8::Local<v8::Object>& thisObject, const v8::Local<v8:
     _startPlayingReverse( false ),
     _isPlaying( false ),
     _reversePlayback( false ),
-    _loadingTime( 0 ),
     _currentTime( 0 ),
     _performSeek( false ),
-    _seekedFrameLoadedSanityChecks( MaxSanityChecks ),
-    _lastPlaybackTimeFrameReady( InvalidTime ),
-    _lastGlobalTimeFrameReady( InvalidTime ),
+    _seekTime( InvalidTime ),
     _loadVideoState( ELoadVideoState::UNLOADED ),
     _bufferingValue( 0.0f ),
-    _withFps( 0.0f )
+    _reportedState( libvlc_NothingSpecial ),
+    _reportedLength( 0 ),
+    _mediaFps( 0 ),
+    _timeToFirstFrame( -1 ),
+    _scrubbing( false ),
+    _keyframeScrubbing( false ),
+    _scrubPending( false ),
+    _scrubTime( 0 ),
+    _scrubApproximate( false ),
+    _withFps( 0.0f ),
+    _mediaGeneration( 0 ),
+    _prefetchFrames( DefaultPrefetchFrames ),
+    _cachedFrameData( nullptr ),
+    _decoderFrame( InvalidFrame ),
+    _decoderMoved( false ),
+    _prefetchState( EPrefetchState::IDLE ),
+    _prefetchFrame( InvalidFrame ),
+    _prefetchSequence( 0 ),
+    _reverseSeekTime( 0 ),
+    _reverseSequence( 0 ),
+    _reverseStepping( false ),
+    _rate( 1.0 ),
+    _trickPlay( false ),
+    _trickPlayClock( 0 ),
+    _trickPlayTime( 0 ),
+    _loop( false ),
+    _loopCache( false ),
+    _loopWrapped( false ),
+    _loopReplay( false ),
+    _prerollTime( 0 ),
+    _prerollItem( -1 ),
+    _prerollHits( 0 ),
+    _prerollMisses( 0 ),
+    _cueTime( InvalidTime ),
+    _cueJump( false )
 {
     Wrap( thisObject );
 
+    std::fill( std::begin( _emitterListeners ), std::end( _emitterListeners ), 0 );
+
     _instances.insert( this );
 
     uv_loop_t* loop = uv_default_loop();
 
-    uv_async_init( loop, &_async,
+    _async = new uv_async_t;
+    uv_async_init( loop, _async,
         [] ( uv_async_t* handle ) {
             if( handle->data )
                 reinterpret_cast<JsVlcPlayer*>( handle->data )->handleAsync();
         }
     );
-    _async.data = this;
+    _async->data = this;
+
+    _errorTimer = new uv_timer_t;
+    uv_timer_init( loop, _errorTimer );
+    _errorTimer->data = this;
+
+    _reverseTimer = new uv_timer_t;
+    uv_timer_init( loop, _reverseTimer );
+    _reverseTimer->data = this;
 
-    uv_timer_init( loop, &_errorTimer );
-    _errorTimer.data = this;
+    _trickPlayTimer = new uv_timer_t;
+    uv_timer_init( loop, _trickPlayTimer );
+    _trickPlayTimer->data = this;
+
+    _loopTimer = new uv_timer_t;
+    uv_timer_init( loop, _loopTimer );
+    _loopTimer->data = this;
+
+    _throttleTimer = new uv_timer_t;
+    uv_timer_init( loop, _throttleTimer );
+    _throttleTimer->data = this;
+
+    _seekTimer = new uv_timer_t;
+    uv_timer_init( loop, _seekTimer );
+    _seekTimer->data = this;
 
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     v8::Local<v8::Context> context = isolate->GetCurrentContext();
@@ -351,6 +526,47 @@ JsVlcPlayer::JsVlcPlayer( v8::Local<v8::Object>& thisObject, const v8::Local<v8:
                                          "EventEmitter",
                                          v8::NewStringType::kInternalized ).ToLocalChecked() ) )->NewInstance( context ).ToLocalChecked() );
 
+    v8::Local<v8::Object> eventEmitter = getEventEmitter();
+    _jsEmit.Reset( isolate,
+        v8::Local<v8::Function>::Cast(
+            eventEmitter->Get(
+                v8::String::NewFromUtf8( isolate, "emit", v8::NewStringType::kInternalized ).ToLocalChecked() ) ) );
+
+    v8::Local<v8::Array> jsCallbackNames = v8::Array::New( isolate, CB_Max );
+    for( unsigned i = 0; i < CB_Max; ++i ) {
+        jsCallbackNames->Set( context, i,
+            v8::String::NewFromUtf8( isolate,
+                                     callbackNames[i],
+                                     v8::NewStringType::kInternalized ).ToLocalChecked() ).FromJust();
+    }
+    // The same array is passed to EventBatch listeners, so they can't change event names.
+    jsCallbackNames->SetIntegrityLevel( context, v8::IntegrityLevel::kFrozen ).FromJust();
+    _jsCallbackNames.Reset( isolate, jsCallbackNames );
+
+    // Listeners are tracked to know which libvlc events are worth queueing.
+    // Methods changing listeners are wrapped instead of listening "newListener" and "removeListener",
+    // since JS could remove those listeners with removeAllListeners().
+    static const char* const listenersMethods[] = {
+        "on", "addListener", "prependListener", "once", "prependOnceListener",
+        "off", "removeListener", "removeAllListeners"
+    };
+    v8::Local<v8::Value> instanceId = v8::Integer::NewFromUnsigned( isolate, _instanceId );
+    for( const char* methodName: listenersMethods ) {
+        v8::Local<v8::String> name =
+            v8::String::NewFromUtf8( isolate, methodName, v8::NewStringType::kInternalized ).ToLocalChecked();
+        v8::Local<v8::Value> method = eventEmitter->Get( name );
+        if( !method->IsFunction() )
+            continue;
+
+        v8::Local<v8::Array> data = v8::Array::New( isolate, 2 );
+        data->Set( context, 0, instanceId ).FromJust();
+        data->Set( context, 1, method ).FromJust();
+        eventEmitter->Set( context, name,
+            v8::Function::New( context, jsEmitterListenersMethod, data ).ToLocalChecked() ).FromJust();
+    }
+
+    updateWantedCallbacks();
+
     initLibvlc( vlcOpts );
 
     _player.set_playback_mode( vlc::mode_normal );
@@ -358,6 +574,7 @@ JsVlcPlayer::JsVlcPlayer( v8::Local<v8::Object>& thisObject, const v8::Local<v8:
     if( _libvlc && _player.open( _libvlc ) ) {
         _player.register_callback( this );
         VlcVideoOutput::open( &_player.basic_player() );
+        _preroll.open( _libvlc );
     } else {
         assert( false );
     }
@@ -413,115 +630,369 @@ JsVlcPlayer::~JsVlcPlayer()
 
 void JsVlcPlayer::close()
 {
+    // closeAll() and destructor both close player.
+    if( !_async )
+        return;
+
     _player.unregister_callback( this );
     VlcVideoOutput::close();
 
     _player.close();
+    _preroll.close();
 
-    _async.data = nullptr;
-    uv_close( reinterpret_cast<uv_handle_t*>( &_async ), 0 );
-
-    _errorTimer.data = nullptr;
-    uv_timer_stop( &_errorTimer );
+    // Indexing threads are detached, they just won't touch _async anymore.
+    cancelIndexJob( &_indexJob );
+    cancelIndexJob( &_preloadJob );
 
+    // libvlc could log till it's released.
     if( _libvlc ) {
         libvlc_release( _libvlc );
         _libvlc = nullptr;
     }
+
+    CloseUvHandle( &_async );
+
+    CloseUvHandle( &_errorTimer );
+
+    stopReverse();
+    CloseUvHandle( &_reverseTimer );
+
+    stopTrickPlay();
+    CloseUvHandle( &_trickPlayTimer );
+
+    stopLoopReplay();
+    CloseUvHandle( &_loopTimer );
+
+    CloseUvHandle( &_throttleTimer );
+
+    CloseUvHandle( &_seekTimer );
+}
+
+JsVlcPlayer::Callbacks_e JsVlcPlayer::libvlcEventCallback( int eventType )
+{
+    switch( eventType ) {
+        case libvlc_MediaPlayerMediaChanged:
+            return CB_MediaPlayerMediaChanged;
+        case libvlc_MediaPlayerNothingSpecial:
+            return CB_MediaPlayerNothingSpecial;
+        case libvlc_MediaPlayerOpening:
+            return CB_MediaPlayerOpening;
+        case libvlc_MediaPlayerBuffering:
+            return CB_MediaPlayerBuffering;
+        case libvlc_MediaPlayerPlaying:
+            return CB_MediaPlayerPlaying;
+        case libvlc_MediaPlayerPaused:
+            return CB_MediaPlayerPaused;
+        case libvlc_MediaPlayerStopped:
+            return CB_MediaPlayerStopped;
+        case libvlc_MediaPlayerForward:
+            return CB_MediaPlayerForward;
+        case libvlc_MediaPlayerBackward:
+            return CB_MediaPlayerBackward;
+        case libvlc_MediaPlayerEndReached:
+            return CB_MediaPlayerEndReached;
+        case libvlc_MediaPlayerEncounteredError:
+            return CB_MediaPlayerEncounteredError;
+        case libvlc_MediaPlayerTimeChanged:
+            return CB_MediaPlayerTimeChanged;
+        case libvlc_MediaPlayerPositionChanged:
+            return CB_MediaPlayerPositionChanged;
+        case libvlc_MediaPlayerSeekableChanged:
+            return CB_MediaPlayerSeekableChanged;
+        case libvlc_MediaPlayerPausableChanged:
+            return CB_MediaPlayerPausableChanged;
+        case libvlc_MediaPlayerLengthChanged:
+            return CB_MediaPlayerLengthChanged;
+        default:
+            return CB_Max;
+    }
 }
 
 void JsVlcPlayer::media_player_event( const libvlc_event_t* e )
 {
-    _asyncDataGuard.lock();
-    _asyncData.emplace_back( new LibvlcEvent( *e ) );
-    _asyncDataGuard.unlock();
-    uv_async_send( &_async );
+    // Clock of displayed frames follows libvlc right when it reports changes,
+    // since video output can't ask libvlc from its callbacks.
+    switch( e->type ) {
+        case libvlc_MediaPlayerTimeChanged:
+            VlcVideoOutput::setPlaybackTime( e->u.media_player_time_changed.new_time );
+            break;
+        case libvlc_MediaPlayerPlaying:
+            VlcVideoOutput::setPlaybackPlaying( true );
+            break;
+        case libvlc_MediaPlayerPaused:
+        case libvlc_MediaPlayerEndReached:
+        case libvlc_MediaPlayerEncounteredError:
+            VlcVideoOutput::setPlaybackPlaying( false );
+            break;
+        case libvlc_MediaPlayerStopped:
+            VlcVideoOutput::setPlaybackPlaying( false );
+            VlcVideoOutput::setPlaybackTime( -1 );
+            break;
+    }
+
+    switch( e->type ) {
+        case libvlc_MediaPlayerMediaChanged:
+            _reportedState = libvlc_NothingSpecial;
+            _reportedLength = 0;
+            break;
+        case libvlc_MediaPlayerNothingSpecial:
+            _reportedState = libvlc_NothingSpecial;
+            break;
+        case libvlc_MediaPlayerOpening:
+            _reportedState = libvlc_Opening;
+            break;
+        case libvlc_MediaPlayerPlaying:
+            _reportedState = libvlc_Playing;
+            break;
+        case libvlc_MediaPlayerPaused:
+            _reportedState = libvlc_Paused;
+            break;
+        case libvlc_MediaPlayerStopped:
+            _reportedState = libvlc_Stopped;
+            break;
+        case libvlc_MediaPlayerEndReached:
+            _reportedState = libvlc_Ended;
+            break;
+        case libvlc_MediaPlayerEncounteredError:
+            _reportedState = libvlc_Error;
+            break;
+        case libvlc_MediaPlayerLengthChanged:
+            _reportedLength = e->u.media_player_length_changed.new_length;
+            break;
+    }
+
+    // Nobody would see the event, so it isn't worth queueing.
+    const Callbacks_e callback = libvlcEventCallback( e->type );
+    if( CB_Max == callback || !callbackWanted( callback ) )
+        return;
+
+    PlayerEvent event;
+    event.type = PlayerEvent::Libvlc;
+    event.libvlc.eventType = e->type;
+    event.libvlc.timeValue = 0;
+
+    // Time and position are superseded by the next change anyway, so they could be dropped.
+    bool mustDeliver = true;
+
+    switch( e->type ) {
+        case libvlc_MediaPlayerBuffering:
+            event.libvlc.floatValue = e->u.media_player_buffering.new_cache;
+            break;
+        case libvlc_MediaPlayerTimeChanged:
+            event.libvlc.timeValue = e->u.media_player_time_changed.new_time;
+            mustDeliver = false;
+            break;
+        case libvlc_MediaPlayerPositionChanged:
+            event.libvlc.floatValue = e->u.media_player_position_changed.new_position;
+            mustDeliver = false;
+            break;
+        case libvlc_MediaPlayerSeekableChanged:
+            event.libvlc.intValue = e->u.media_player_seekable_changed.new_seekable;
+            break;
+        case libvlc_MediaPlayerPausableChanged:
+            event.libvlc.intValue = e->u.media_player_pausable_changed.new_pausable;
+            break;
+        case libvlc_MediaPlayerLengthChanged:
+            event.libvlc.timeValue = e->u.media_player_length_changed.new_length;
+            break;
+    }
+
+    pushEvent( event, mustDeliver );
 }
 
-void JsVlcPlayer::log_event_wrapper( void *data, int level, const libvlc_log_t *ctx, const char *fmt, va_list args )
+bool JsVlcPlayer::pushEvent( const PlayerEvent& event, bool mustDeliver )
 {
-    ((JsVlcPlayer *)data)->log_event(level, ctx, fmt, args);
+    if( !_overflow.load() && _events.push( event ) ) {
+        uv_async_send( _async );
+        return true;
+    }
+
+    if( !mustDeliver )
+        return false;
+
+    // Only happens while gui thread is stuck, so allocation doesn't matter here.
+    _overflowGuard.lock();
+    _overflowEvents.push_back( event );
+    _overflow = true;
+    _overflowGuard.unlock();
+
+    uv_async_send( _async );
+
+    return true;
 }
 
-#ifndef _MSC_VER
-inline int _vscprintf( const char* format, va_list argptr )
+void JsVlcPlayer::log_event_wrapper( void *data, int level, const libvlc_log_t *ctx, const char *fmt, va_list args )
 {
-    return vsnprintf( nullptr, 0, format, argptr );
+    ((JsVlcPlayer *)data)->log_event(level, ctx, fmt, args);
 }
-#endif
 
 void JsVlcPlayer::log_event( int level, const libvlc_log_t *ctx, const char *fmt, va_list args )
 {
 #if defined(_DEBUG)
-    va_list argsCopy;
-    va_copy( argsCopy, args );
-    int messageSize = _vscprintf( fmt, argsCopy );
-    va_end( argsCopy );
-
-    // If the format string is bad, there is nothing we'll ever be able to do.
-    if( messageSize <= 0 )
+    if( !callbackWanted( CB_LogMessage ) )
         return;
 
-    std::string message( messageSize + 1, '\0' );
-    // vsnprintf is a bit of a mess in Microsoft-land, older versions do not guarantee termination.
-    vsnprintf( &message[0], message.size(), fmt, args );
-    while( '\0' == message[message.size() - 1] )
-        message.resize( message.size() - 1 );
+    // If all slots are taken, the message is lost.
+    const unsigned slot = _logArena.store( fmt, args );
+    if( LogArena::NoSlot == slot )
+        return;
 
-    _asyncDataGuard.lock();
-    _asyncData.emplace_back( new LibvlcLogEvent( level, message, fmt ) );
-    _asyncDataGuard.unlock();
+    PlayerEvent event;
+    event.type = PlayerEvent::LogMessage;
+    event.log.level = level;
+    event.log.slot = slot;
 
-    uv_async_send( &_async );
+    if( !pushEvent( event, false ) )
+        _logArena.release( slot );
 #endif
 }
 
 void JsVlcPlayer::handleAsync()
 {
-    while( !_asyncData.empty() ) {
-        std::deque<std::unique_ptr<AsyncData> > tmpData;
-        _asyncDataGuard.lock();
-        _asyncData.swap( tmpData );
-        _asyncDataGuard.unlock();
-        for( const auto& i: tmpData ) {
-            i->process( this );
-
-            //events queue could be very long...
-            if( VlcVideoOutput::isFrameReady() ) {
-                onFrameReady();
-            }
-        }
+    PlayerEvent event;
+    for( ;; ) {
+        while( _events.pop( &event ) )
+            handleEvent( event );
+
+        if( !_overflow.load() )
+            break;
+
+        // Events in the ring are older than overflowed ones.
+        std::deque<PlayerEvent> overflowEvents;
+        _overflowGuard.lock();
+        _overflowEvents.swap( overflowEvents );
+        _overflow = false;
+        _overflowGuard.unlock();
+
+        for( const PlayerEvent& overflowEvent: overflowEvents )
+            handleEvent( overflowEvent );
     }
+
+    handleMediaIndexReady();
+
+    flushEventBatch();
 }
 
-void* JsVlcPlayer::onFrameSetup( const RV32VideoFrame& videoFrame )
+void JsVlcPlayer::handleEvent( const PlayerEvent& event )
 {
-    using namespace v8;
-
-    if( 0 == videoFrame.width() || 0 == videoFrame.height() || 0 == videoFrame.size() ) {
-        assert( false );
-        return nullptr;
+    switch( event.type ) {
+        case PlayerEvent::Libvlc:
+            handleLibvlcEvent( event );
+            break;
+        case PlayerEvent::LogMessage:
+            handleLogMessage( event );
+            break;
     }
 
+    //events queue could be very long...
+    VlcVideoOutput::deliverReadyFrame();
+}
+
+void JsVlcPlayer::handleLogMessage( const PlayerEvent& event )
+{
+    using namespace v8;
+
     Isolate* isolate = Isolate::GetCurrent();
     HandleScope scope( isolate );
 
-    Local<Object> global = isolate->GetCurrentContext()->Global();
+    Local<Integer> jsLevel = Integer::New( isolate, event.log.level );
+    Local<String> jsMessage =
+        String::NewFromUtf8( isolate, _logArena.message( event.log.slot ), NewStringType::kNormal ).ToLocalChecked();
+    Local<String> jsFormat =
+        String::NewFromUtf8( isolate, _logArena.format( event.log.slot ), NewStringType::kNormal ).ToLocalChecked();
+
+    _logArena.release( event.log.slot );
+
+    callCallback( CB_LogMessage, { jsLevel, jsMessage, jsFormat } );
+}
+
+void JsVlcPlayer::handleMediaIndexReady()
+{
+    if( !_indexJob )
+        return;
+
+    std::shared_ptr<MediaIndex> index;
+    _indexJob->guard.lock();
+    index = std::move( _indexJob->result );
+    _indexJob->guard.unlock();
+
+    if( !index )
+        return;
+
+    // Job is cancelled on every generation change, so it's just a safety net.
+    const bool current = _indexJob->generation == _mediaGeneration;
+    _indexJob.reset();
+    if( !current )
+        return;
+
+    _mediaIndex = std::move( index );
+    VlcVideoOutput::setFrameIndex( _mediaIndex );
+    prefetchNext();
+}
+
+v8::Local<v8::Uint8Array> JsVlcPlayer::createFrameBuffer( const VideoFrame& videoFrame, unsigned slot )
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    EscapableHandleScope scope( isolate );
 
-    Local<Value> abv =
-        global->Get(
-            String::NewFromUtf8( isolate,
-                                 "Uint8Array",
-                                 NewStringType::kInternalized ).ToLocalChecked() );
     Local<Context> context = isolate->GetCurrentContext();
-    Local<Value> argv[] =
-        { Integer::NewFromUnsigned( isolate, videoFrame.size() ) };
-    Local<Uint8Array> jsArray =
-        Handle<Uint8Array>::Cast( Handle<Function>::Cast( abv )->NewInstance( context, 1, argv ).ToLocalChecked() );
+
+    if( _jsUint8Array.IsEmpty() ) {
+        Local<Value> abv =
+            context->Global()->Get(
+                String::NewFromUtf8( isolate,
+                                     "Uint8Array",
+                                     NewStringType::kInternalized ).ToLocalChecked() );
+        _jsUint8Array.Reset( isolate, Handle<Function>::Cast( abv ) );
+    }
+    Local<Function> uint8Array = Local<Function>::New( isolate, _jsUint8Array );
+
+    // Backing store of the same slot is reused if it fits and isn't too big for the new frame.
+    Local<ArrayBuffer> jsStore;
+    if( slot < _jsFrameStores.size() && !_jsFrameStores[slot].IsEmpty() ) {
+        jsStore = Local<ArrayBuffer>::New( isolate, _jsFrameStores[slot] );
+        if( jsStore->ByteLength() < videoFrame.size() ||
+            jsStore->ByteLength() / MaxFrameStoreWaste > videoFrame.size() )
+        {
+            jsStore.Clear();
+        }
+    }
+
+#ifdef USE_ARRAY_BUFFER
+    if( jsStore.IsEmpty() ) {
+        jsStore = NewNativeFrameStore( isolate, videoFrame.size() );
+
+        if( slot >= _jsFrameStores.size() )
+            _jsFrameStores.resize( slot + 1 );
+        _jsFrameStores[slot].Reset( isolate, jsStore );
+    }
+#endif
+
+    Local<Uint8Array> jsArray;
+    if( jsStore.IsEmpty() ) {
+        Local<Value> argv[] =
+            { Integer::NewFromUnsigned( isolate, videoFrame.size() ) };
+        jsArray =
+            Handle<Uint8Array>::Cast( uint8Array->NewInstance( context, 1, argv ).ToLocalChecked() );
+
+        if( slot >= _jsFrameStores.size() )
+            _jsFrameStores.resize( slot + 1 );
+        _jsFrameStores[slot].Reset( isolate, jsArray->Buffer() );
+    } else {
+        // Frame metadata is read only, so every setup gets new view.
+        Local<Value> argv[] =
+            { jsStore,
+              Integer::New( isolate, 0 ),
+              Integer::NewFromUnsigned( isolate, videoFrame.size() ) };
+        jsArray =
+            Handle<Uint8Array>::Cast( uint8Array->NewInstance( context, 3, argv ).ToLocalChecked() );
+    }
 
     Local<Integer> jsWidth = Integer::New( isolate, videoFrame.width() );
     Local<Integer> jsHeight = Integer::New( isolate, videoFrame.height() );
-    Local<Integer> jsPixelFormat = Integer::New( isolate, static_cast<int>( PixelFormat::RV32 ) );
+    Local<Integer> jsPixelFormat = Integer::New( isolate, static_cast<int>( videoFrame.pixelFormat() ) );
 
     jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "width", NewStringType::kInternalized ).ToLocalChecked(), jsWidth,
                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
@@ -529,245 +1000,403 @@ void* JsVlcPlayer::onFrameSetup( const RV32VideoFrame& videoFrame )
                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
     jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "pixelFormat", NewStringType::kInternalized ).ToLocalChecked(), jsPixelFormat,
                        static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "pitch", NewStringType::kInternalized ).ToLocalChecked(),
+                       Integer::New( isolate, videoFrame.planePitch( 0 ) ),
+                       static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
 
-    _jsFrameBuffer.Reset( isolate, jsArray );
-
-    callCallback( CB_FrameSetup, { jsWidth, jsHeight, jsPixelFormat, jsArray } );
+    switch( videoFrame.pixelFormat() ) {
+        case PixelFormat::I420:
+            jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "uOffset", NewStringType::kInternalized ).ToLocalChecked(),
+                               Integer::New( isolate, videoFrame.planeOffset( 1 ) ),
+                               static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+            jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "vOffset", NewStringType::kInternalized ).ToLocalChecked(),
+                               Integer::New( isolate, videoFrame.planeOffset( 2 ) ),
+                               static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+            jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "uPitch", NewStringType::kInternalized ).ToLocalChecked(),
+                               Integer::New( isolate, videoFrame.planePitch( 1 ) ),
+                               static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+            jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "vPitch", NewStringType::kInternalized ).ToLocalChecked(),
+                               Integer::New( isolate, videoFrame.planePitch( 2 ) ),
+                               static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+            break;
+        case PixelFormat::NV12:
+            jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "uvOffset", NewStringType::kInternalized ).ToLocalChecked(),
+                               Integer::New( isolate, videoFrame.planeOffset( 1 ) ),
+                               static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+            jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "uvPitch", NewStringType::kInternalized ).ToLocalChecked(),
+                               Integer::New( isolate, videoFrame.planePitch( 1 ) ),
+                               static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+            break;
+        default:
+            break;
+    }
 
-#ifdef USE_ARRAY_BUFFER
-    return jsArray->Buffer()->GetContents().Data();
-#else
-    return jsArray->GetIndexedPropertiesExternalArrayData();
-#endif
+    return scope.Escape( jsArray );
 }
 
-void* JsVlcPlayer::onFrameSetup( const I420VideoFrame& videoFrame )
+std::vector<void*> JsVlcPlayer::onFrameSetup( const VideoFrame& videoFrame )
 {
     using namespace v8;
 
-    if( 0 == videoFrame.width() || 0 == videoFrame.height() ||
-        0 == videoFrame.uPlaneOffset() || 0 == videoFrame.vPlaneOffset() ||
-        0 == videoFrame.size() )
-    {
+    if( 0 == videoFrame.width() || 0 == videoFrame.height() || 0 == videoFrame.size() ) {
         assert( false );
-        return nullptr;
+        return std::vector<void*>();
     }
 
     Isolate* isolate = Isolate::GetCurrent();
     HandleScope scope( isolate );
 
-    Local<Object> global = isolate->GetCurrentContext()->Global();
+    std::vector<void*> buffers;
+    buffers.reserve( videoFrame.slotCount() );
 
-    Local<Value> abv =
-        global->Get(
-            String::NewFromUtf8( isolate,
-                                 "Uint8Array",
-                                 NewStringType::kInternalized ).ToLocalChecked() );
-    Local<Context> context = isolate->GetCurrentContext();
-    Local<Value> argv[] =
-        { Integer::NewFromUnsigned( isolate, videoFrame.size() ) };
-    Local<Uint8Array> jsArray =
-        Handle<Uint8Array>::Cast( Handle<Function>::Cast( abv )->NewInstance( context, 1, argv ).ToLocalChecked() );
+    _jsFrameBuffers.clear();
+    for( unsigned i = 0; i < videoFrame.slotCount(); ++i ) {
+        Local<Uint8Array> jsArray = createFrameBuffer( videoFrame, i );
 
-    Local<Integer> jsWidth = Integer::New( isolate, videoFrame.width() );
-    Local<Integer> jsHeight = Integer::New( isolate, videoFrame.height() );
-    Local<Integer> jsPixelFormat = Integer::New( isolate, static_cast<int>( PixelFormat::I420 ) );
+        _jsFrameBuffers.emplace_back( isolate, jsArray );
+#ifdef USE_ARRAY_BUFFER
+        buffers.push_back( static_cast<char*>( ArrayBufferData( jsArray->Buffer() ) ) + jsArray->ByteOffset() );
+#else
+        buffers.push_back( jsArray->GetIndexedPropertiesExternalArrayData() );
+#endif
+    }
 
-    jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "width", NewStringType::kInternalized ).ToLocalChecked(),
-                       jsWidth,
-                       static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
-    jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "height", NewStringType::kInternalized ).ToLocalChecked(),
-                       jsHeight,
-                       static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
-    jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "pixelFormat", NewStringType::kInternalized ).ToLocalChecked(),
-                       jsPixelFormat,
-                       static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
-    jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "uOffset", NewStringType::kInternalized ).ToLocalChecked(),
-                       Integer::New( isolate, videoFrame.uPlaneOffset() ),
-                       static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
-    jsArray->DefineOwnProperty( context, String::NewFromUtf8( isolate, "vOffset", NewStringType::kInternalized ).ToLocalChecked(),
-                       Integer::New( isolate, videoFrame.vPlaneOffset() ),
-                       static_cast<v8::PropertyAttribute>( ReadOnly | DontDelete ) );
+    // Stores of slots not used anymore are not worth to keep.
+    if( _jsFrameStores.size() > videoFrame.slotCount() )
+        _jsFrameStores.resize( videoFrame.slotCount() );
 
-    _jsFrameBuffer.Reset( isolate, jsArray );
+    // Cached frames have layout of previous setup.
+    _frameBufferData = buffers;
+    _frameCache.clear();
+    _jsCachedFrameBuffer.Reset();
+    _cachedFrameData = nullptr;
+    cancelPrefetch();
 
-    callCallback( CB_FrameSetup, { jsWidth, jsHeight, jsPixelFormat, jsArray } );
+    // Decoded segments and looped clip have layout of previous setup too.
+    if( _reversePlayback )
+        startReverse();
+
+    _loopClip.clear();
+    if( _loopReplay ) {
+        stopLoopReplay();
+        _decoderMoved = true;
+        resyncDecoder();
+        player().play();
+    }
 
-#ifdef USE_ARRAY_BUFFER
-    return jsArray->Buffer()->GetContents().Data();
-#else
-    return jsArray->GetIndexedPropertiesExternalArrayData();
-#endif
+    Local<Value> jsFrameBuffer = Local<Value>::New( isolate, _jsFrameBuffers.front() );
+    _jsFrameBuffer.Reset( isolate, jsFrameBuffer );
+
+    callCallback( CB_FrameSetup, {
+        Integer::New( isolate, videoFrame.width() ),
+        Integer::New( isolate, videoFrame.height() ),
+        Integer::New( isolate, static_cast<int>( videoFrame.pixelFormat() ) ),
+        jsFrameBuffer } );
+
+    return buffers;
 }
 
-void JsVlcPlayer::onFrameReady()
+void JsVlcPlayer::onFrameReady( const FrameInfo& frameInfo, unsigned droppedFrames )
 {
     vlc::player& p = player();
     vlc::playback& playback = p.playback();
-    const libvlc_time_t playbackTime = playback.get_time();
 
-    updateCurrentTime();
+    // Time sampled when the frame was displayed, not when it reached us.
+    const libvlc_time_t playbackTime =
+        frameInfo.time >= 0 ? frameInfo.time : playback.get_time();
+
+    _currentFrameInfo = frameInfo;
+    _currentFrameInfo.time = playbackTime;
+
+    updateCurrentTime( playbackTime );
+
+    _frameDelivered = false;
+    _undeliveredDroppedFrames += droppedFrames;
 
     switch( _loadVideoState ) {
         case ELoadVideoState::LOADED:
-            if( _isPlaying ) {
-                _seekedFrameLoadedSanityChecks = MaxSanityChecks;
+            if( _reversePlayback ) {
+                handleReverseFrame( frameInfo, playbackTime );
+            }
+            else if( _isPlaying && !_trickPlay ) {
                 _performSeek = false;
-                doCallCallback();
-
-                // Stop reverse playback when gets the beginning.
-                if( _reversePlayback && playbackTime == 0 ) {
-                    callCallback( CB_MediaPlayerBeginReached );
-
-                    _isPlaying = false;
-                    _reversePlayback = false;
-                }
+                if( !_loop || !handleLoopFrame( playbackTime, droppedFrames ) )
+                    doCallCallback();
+                settleFrameSeek( "Seek interrupted by playback" );
             }
             else if( _performSeek ) {
-              if( playbackTime == _currentTime ) {
-                  doCallCallback();
-
-                  if( 0u == --_seekedFrameLoadedSanityChecks )
-                      _performSeek = false;
-              }
-              else if( playbackTime != _currentTime ) {
-                  // It means that there have been another seek.
-                  _seekedFrameLoadedSanityChecks = MaxSanityChecks;
-              }
+                if( _seekMatcher.matches( playbackTime, frameInfo.sequence, _currentTime ) )
+                    finishSeek();
             }
-            break;
-        case ELoadVideoState::GETTING:
-            if( libvlc_Paused == p.get_state() ) {
-                if( playbackTime == _currentTime ) {
-                    _loadVideoState = ELoadVideoState::LOADED;
-
-                    if( _startPlaying || _startPlayingReverse ) {
-                        // Set the new current time taking into account the spent time loading the proper starting frame.
-                        const libvlc_time_t length = player().playback().get_length();
-                        const libvlc_time_t time = std::min( _currentTime + _loadingTime, length );
-                        playback.set_time( time );
-                    }
-
-                    if( _startPlaying && !_startPlayingReverse )
-                        play();
-                    else if( _startPlayingReverse )
-                        playReverse();
-                    else
-                        doCallCallback();
-                }
-                else
-                    playback.set_time( _currentTime );
+            else if( EPrefetchState::IDLE != _prefetchState ) {
+                handlePrefetchedFrame( frameInfo, playbackTime );
             }
-            else {
-                p.pause();
+            break;
+        case ELoadVideoState::GETTING: {
+            // Demux started at the requested time, so the first frame is the one to show.
+            using namespace std::chrono;
+            _timeToFirstFrame = duration<double, std::milli>( steady_clock::now() - _loadStart ).count();
+            _loadVideoState = ELoadVideoState::LOADED;
+            setCurrentTime( playbackTime );
+
+            if( _startPlaying && !_startPlayingReverse ) {
+                play();
+                doCallCallback();
+            } else if( _startPlayingReverse ) {
+                playReverse();
+            } else {
+                // Media is opened with :start-paused, so decoder stays on this frame.
+                doCallCallback();
             }
             break;
+        }
     }
+
+    // Frame not seen by JS could be reused by decoder right away.
+    if( !_frameDelivered )
+        VlcVideoOutput::releaseFrame( currentFrameSlot() );
+
+    // The latest scrub target is seeked as soon as the previous seek shows its frame.
+    if( _scrubPending && !_performSeek && ELoadVideoState::LOADED == _loadVideoState )
+        seekToScrubTime();
+
+    // Paused decoder is idle, so it could decode frames around the current one.
+    prefetchNext();
 }
 
 void JsVlcPlayer::onFrameCleanup()
 {
+    _frameBufferData.clear();
+    _frameCache.clear();
+    _jsCachedFrameBuffer.Reset();
+    _cachedFrameData = nullptr;
+    cancelPrefetch();
+
     callCallback( CB_FrameCleanup );
 }
 
-void JsVlcPlayer::handleLibvlcEvent( const libvlc_event_t& libvlcEvent )
+void JsVlcPlayer::handleLibvlcEvent( const PlayerEvent& event )
 {
-    using namespace v8;
+    const Callbacks_e callback = libvlcEventCallback( event.libvlc.eventType );
+    if( CB_Max == callback )
+        return;
 
-    Isolate* isolate = Isolate::GetCurrent();
-    HandleScope scope( isolate );
+    LibvlcValueType valueType = NoValue;
+    double value = 0;
 
-    Callbacks_e callback = CB_Max;
+    const PlayerEvent::LibvlcData& libvlcEvent = event.libvlc;
 
-    switch( libvlcEvent.type ) {
-        case libvlc_MediaPlayerMediaChanged:
-            callback = CB_MediaPlayerMediaChanged;
-            break;
-        case libvlc_MediaPlayerNothingSpecial:
-            callback = CB_MediaPlayerNothingSpecial;
-            break;
-        case libvlc_MediaPlayerOpening:
-            callback = CB_MediaPlayerOpening;
-            break;
-        case libvlc_MediaPlayerBuffering: {
-            _bufferingValue = libvlcEvent.u.media_player_buffering.new_cache;
-            callCallback( CB_MediaPlayerBuffering, { Number::New( isolate, _bufferingValue ) } );
-            break;
-        }
-        case libvlc_MediaPlayerPlaying:
-            callback = CB_MediaPlayerPlaying;
-            break;
+    // Held time and position are delivered before state transition, so JS sees the final ones.
+    switch( libvlcEvent.eventType ) {
         case libvlc_MediaPlayerPaused:
-            callback = CB_MediaPlayerPaused;
-            break;
         case libvlc_MediaPlayerStopped:
-            callback = CB_MediaPlayerStopped;
+        case libvlc_MediaPlayerEndReached:
+        case libvlc_MediaPlayerEncounteredError:
+            flushThrottledEvents();
             break;
-        case libvlc_MediaPlayerForward:
-            callback = CB_MediaPlayerForward;
+    }
+
+    switch( libvlcEvent.eventType ) {
+        case libvlc_MediaPlayerBuffering:
+            _bufferingValue = libvlcEvent.floatValue;
+            valueType = NumberValue;
+            value = _bufferingValue;
             break;
-        case libvlc_MediaPlayerBackward:
-            callback = CB_MediaPlayerBackward;
+        case libvlc_MediaPlayerMediaChanged:
+            currentMediaChanged();
             break;
         case libvlc_MediaPlayerEndReached:
-            callback = CB_MediaPlayerEndReached;
-            uv_timer_stop( &_errorTimer );
+            uv_timer_stop( _errorTimer );
             currentItemEndReached();
             break;
         case libvlc_MediaPlayerEncounteredError:
-            callback = CB_MediaPlayerEncounteredError;
             //sometimes libvlc do some internal error handling
             //and sends EndReached after that,
             //so we have to wait it some time,
             //to not break playlist ligic.
-            uv_timer_start( &_errorTimer,
+            uv_timer_start( _errorTimer,
                 [] ( uv_timer_t* handle ) {
                     if( handle->data )
                         static_cast<JsVlcPlayer*>( handle->data )->currentItemEndReached();
                 }, 1000, 0 );
             break;
-        case libvlc_MediaPlayerTimeChanged: {
-            const double new_time =
-                static_cast<double>( libvlcEvent.u.media_player_time_changed.new_time );
-            callCallback( CB_MediaPlayerTimeChanged,
-                          { Number::New( isolate, static_cast<double>( new_time ) ) } );
+        case libvlc_MediaPlayerTimeChanged:
+            valueType = NumberValue;
+            value = static_cast<double>( libvlcEvent.timeValue );
+            prerollNextItem( libvlcEvent.timeValue );
+            if( _performSeek && !_isPlaying && !_reversePlayback &&
+                ELoadVideoState::LOADED == _loadVideoState )
+            {
+                // Paused decoder could display the seeked frame before its time is reported,
+                // then no other frame comes to match.
+                _seekMatcher.timeReported( libvlcEvent.timeValue, _currentTime );
+                if( _seekMatcher.matchesReported( _currentFrameInfo.sequence ) ) {
+                    finishSeek();
+                    if( _scrubPending )
+                        seekToScrubTime();
+                    prefetchNext();
+                }
+            }
             break;
-        }
-        case libvlc_MediaPlayerPositionChanged: {
-            callCallback( CB_MediaPlayerPositionChanged,
-                          { Number::New( isolate,
-                                         libvlcEvent.u.media_player_position_changed.new_position ) } );
+        case libvlc_MediaPlayerPositionChanged:
+            valueType = NumberValue;
+            value = libvlcEvent.floatValue;
             break;
-        }
-        case libvlc_MediaPlayerSeekableChanged: {
-            callCallback( CB_MediaPlayerSeekableChanged,
-                          { Boolean::New( isolate,
-                            libvlcEvent.u.media_player_seekable_changed.new_seekable != 0 ) } );
+        case libvlc_MediaPlayerSeekableChanged:
+            valueType = BooleanValue;
+            value = libvlcEvent.intValue != 0 ? 1 : 0;
             break;
-        }
-        case libvlc_MediaPlayerPausableChanged: {
-            callCallback( CB_MediaPlayerPausableChanged,
-                          { Boolean::New( isolate,
-                                          libvlcEvent.u.media_player_pausable_changed.new_pausable != 0 ) } );
+        case libvlc_MediaPlayerPausableChanged:
+            valueType = BooleanValue;
+            value = libvlcEvent.intValue != 0 ? 1 : 0;
             break;
-        }
-        case libvlc_MediaPlayerLengthChanged: {
-            const double new_length =
-                static_cast<double>( libvlcEvent.u.media_player_length_changed.new_length );
-            callCallback( CB_MediaPlayerLengthChanged, { Number::New( isolate, new_length ) } );
+        case libvlc_MediaPlayerLengthChanged:
+            valueType = NumberValue;
+            value = static_cast<double>( libvlcEvent.timeValue );
             break;
-        }
     }
 
-    if( callback != CB_Max ) {
-        callCallback( callback );
+    if( throttleEvent( callback, value ) )
+        return;
+
+    deliverLibvlcCallback( callback, valueType, value );
+}
+
+void JsVlcPlayer::deliverLibvlcCallback( Callbacks_e callback, LibvlcValueType valueType, double value )
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope( isolate );
+
+    // Batched events are passed to JS all at once at the end of handleAsync().
+    if( _batchEvents ) {
+        _eventBatch.push_back( static_cast<double>( callback ) );
+        _eventBatch.push_back( value );
+        return;
+    }
+
+    switch( valueType ) {
+        case NumberValue:
+            callCallback( callback, { Number::New( isolate, value ) } );
+            break;
+        case BooleanValue:
+            callCallback( callback, { Boolean::New( isolate, value != 0 ) } );
+            break;
+        default:
+            callCallback( callback );
+            break;
     }
 }
 
 void JsVlcPlayer::currentItemEndReached()
 {
-    if( vlc::mode_single != player().get_playback_mode() )
+    if( vlc::mode_single != player().get_playback_mode() ) {
+        presentPrerolledItem();
         player().next();
+        // Not waiting for MediaChanged event, frames of the next item could come first.
+        currentMediaChanged();
+    }
+}
+
+void JsVlcPlayer::currentMediaChanged()
+{
+    vlc::player& p = player();
+
+    const int item = p.current_item();
+    if( item < 0 )
+        return;
+
+    const std::string mrl = p.get_media( static_cast<unsigned>( item ) ).mrl();
+    if( mrl == _mediaMrl )
+        return;
+
+    // Cue points were added for the previous media, if there was one.
+    const bool switched = !_mediaMrl.empty();
+    _mediaMrl = mrl;
+    _mediaFps = 0;
+    if( switched )
+        _cuePoints.clear();
+    _cueTime = InvalidTime;
+
+    stopReverse();
+    _reversePlayback = false;
+
+    // Loop range and its cached frames belong to the previous media,
+    // and decoder already plays the new one, so it's not resynced.
+    stopLoopReplay();
+    _loop = false;
+    _loopWrapped = false;
+    _loopClip.reset( nullptr, 0, 0, 0, 0 );
+
+    cancelPrefetch();
+    _frameCache.clear();
+    _decoderFrame = InvalidFrame;
+    _decoderMoved = false;
+
+    cancelIndexJob( &_indexJob );
+    _mediaIndex.reset();
+    VlcVideoOutput::setFrameIndex( nullptr );
+    ++_mediaGeneration;
+
+    startIndexing( mrl );
+}
+
+int JsVlcPlayer::nextItem()
+{
+    vlc::player& p = player();
+
+    const int current = p.current_item();
+    const int count = static_cast<int>( p.item_count() );
+    if( current < 0 || vlc::mode_single == p.get_playback_mode() )
+        return -1;
+
+    if( current + 1 < count )
+        return current + 1;
+
+    return vlc::mode_loop == p.get_playback_mode() ? 0 : -1;
+}
+
+void JsVlcPlayer::prerollNextItem( libvlc_time_t time )
+{
+    if( _prerollTime <= 0 || !_isPlaying || _trickPlay || _loop )
+        return;
+
+    const int item = nextItem();
+    if( item < 0 || ( item == _prerollItem && _preroll.started() ) )
+        return;
+
+    const libvlc_time_t length = player().playback().get_length();
+    if( length <= 0 || length - time > static_cast<libvlc_time_t>( _prerollTime * 1000 ) )
+        return;
+
+    _prerollItem = item;
+    _preroll.start( player().get_media( static_cast<unsigned>( item ) ), *this );
+}
+
+void JsVlcPlayer::presentPrerolledItem()
+{
+    if( !_preroll.started() )
+        return;
+
+    // Frame is shown only if it fits current frame buffers as is,
+    // otherwise the main pipeline has to set them up anew anyway.
+    const VideoFrame* videoFrame = VlcVideoOutput::currentVideoFrame();
+    if( _prerollItem == nextItem() && videoFrame && _preroll.matches( *videoFrame ) &&
+        deliverFrameCopy( _preroll.frame(), 0, false ) )
+    {
+        ++_prerollHits;
+    } else {
+        ++_prerollMisses;
+    }
+
+    resetPreroll();
+}
+
+void JsVlcPlayer::resetPreroll()
+{
+    _preroll.stop();
+    _prerollItem = -1;
 }
 
 void JsVlcPlayer::callCallback( Callbacks_e callback,
@@ -777,30 +1406,54 @@ void JsVlcPlayer::callCallback( Callbacks_e callback,
 
     Isolate* isolate = Isolate::GetCurrent();
     HandleScope scope( isolate );
+    Local<Context> context = isolate->GetCurrentContext();
 
-    std::vector<v8::Local<v8::Value> > argList;
-    argList.reserve( list.size() );
-    argList.push_back(
-        String::NewFromUtf8( isolate,
-                             callbackNames[callback],
-                             NewStringType::kInternalized ).ToLocalChecked());
-    if( list.size() > 0 )
-        argList.insert( argList.end(), list );
+    assert( list.size() <= MaxCallbackArgs );
+
+    // Event name goes first for emit().
+    Local<Value> argv[MaxCallbackArgs + 1];
+    argv[0] = Local<Array>::New( isolate, _jsCallbackNames )->Get( context, callback ).ToLocalChecked();
+    int argc = 1;
+    for( const Local<Value>& arg: list ) {
+        if( argc > static_cast<int>( MaxCallbackArgs ) )
+            break;
+        argv[argc++] = arg;
+    }
 
     if( !_jsCallbacks[callback].IsEmpty() ) {
         Local<Function> callbackFunc =
             Local<Function>::New( isolate, _jsCallbacks[callback] );
 
-        callbackFunc->Call( isolate->GetCurrentContext(), handle(), static_cast<int>( argList.size() - 1), argList.data() + 1 );
+        callbackFunc->Call( context, handle(), argc - 1, argv + 1 );
     }
 
-    Local<Object> eventEmitter = getEventEmitter();
-    Local<Function> emitFunction =
-        v8::Local<v8::Function>::Cast(
-            eventEmitter->Get(
-                String::NewFromUtf8( isolate, "emit", NewStringType::kInternalized ).ToLocalChecked()) );
+    Local<Function>::New( isolate, _jsEmit )->Call( context, getEventEmitter(), argc, argv );
+}
+
+void JsVlcPlayer::flushEventBatch()
+{
+    using namespace v8;
 
-    emitFunction->Call( isolate->GetCurrentContext(), eventEmitter, static_cast<int>( argList.size() ), argList.data() );
+    if( _eventBatch.empty() )
+        return;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope( isolate );
+
+#ifdef USE_ARRAY_BUFFER
+    Local<ArrayBuffer> jsStore = ArrayBuffer::New( isolate, _eventBatch.size() * sizeof( double ) );
+    memcpy( ArrayBufferData( jsStore ), _eventBatch.data(), _eventBatch.size() * sizeof( double ) );
+    Local<Value> jsEvents = Float64Array::New( jsStore, 0, _eventBatch.size() );
+#else
+    Local<Array> jsEvents = Array::New( isolate, static_cast<int>( _eventBatch.size() ) );
+    for( unsigned i = 0; i < _eventBatch.size(); ++i )
+        jsEvents->Set( i, Number::New( isolate, _eventBatch[i] ) );
+#endif
+
+    // Capacity is kept, so batches don't allocate after the first ones.
+    _eventBatch.clear();
+
+    callCallback( CB_EventBatch, { jsEvents, Local<Array>::New( isolate, _jsCallbackNames ) } );
 }
 
 void JsVlcPlayer::doCallCallback() {
@@ -809,48 +1462,161 @@ void JsVlcPlayer::doCallCallback() {
     Isolate* isolate = Isolate::GetCurrent();
     HandleScope scope( isolate );
 
+    if( currentFrameSlot() < _jsFrameBuffers.size() )
+        _jsFrameBuffer.Reset( isolate, _jsFrameBuffers[currentFrameSlot()] );
+    _frameDelivered = true;
+
+    callFrameReadyCallback();
+}
+
+void JsVlcPlayer::callFrameReadyCallback( bool checkCues ) {
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope( isolate );
+
     assert( !_jsFrameBuffer.IsEmpty() ); //FIXME! maybe it worth add condition here
     callCallback( CB_FrameReady, {
       Local<Value>::New( isolate, _jsFrameBuffer ),
       Number::New( isolate, frame() ),
-      Number::New( isolate, time() )
+      Number::New( isolate, time() ),
+      Integer::NewFromUnsigned( isolate, _undeliveredDroppedFrames ),
+      Number::New( isolate, static_cast<double>( _currentFrameInfo.sequence ) )
     } );
+
+    _undeliveredDroppedFrames = 0;
+
+    if( checkCues )
+        checkCuePoints();
 }
 
-void JsVlcPlayer::updateCurrentTime() {
-    using namespace std::chrono;
+void JsVlcPlayer::checkCuePoints()
+{
+    using namespace v8;
 
-    const milliseconds msSinceEpoch = duration_cast<milliseconds>( system_clock::now().time_since_epoch() );
-    const libvlc_time_t currentGlobalTime = static_cast<libvlc_time_t>( msSinceEpoch.count() );
+    // Playback moving against its direction wrapped or was seeked.
+    const libvlc_time_t from = _cueTime;
+    const bool jump = _cueJump || InvalidTime == from ||
+        ( _reversePlayback ? _currentTime > from : _isPlaying && _currentTime < from );
 
-    if( _isPlaying && !_reversePlayback ) {
-        const libvlc_time_t playbackTime = player().playback().get_time();
+    _cueTime = _currentTime;
+    _cueJump = false;
 
-        if( _performSeek ) {
-            _lastPlaybackTimeFrameReady = playbackTime;
-        }
-        else if( _lastPlaybackTimeFrameReady == playbackTime ) {
-            _currentTime += static_cast<libvlc_time_t>( static_cast<double>( currentGlobalTime - _lastGlobalTimeFrameReady ) * _cppInput->rate() );
+    if( _cuePoints.empty() )
+        return;
 
-            const libvlc_time_t length = player().playback().get_length();
-            _currentTime = std::min( _currentTime, length );
-        }
-        else {
-            _lastPlaybackTimeFrameReady = playbackTime;
+    const double fps = this->fps();
+    _cuePoints.resolve( _mediaIndex, fps > 0 ? 1000.0 / fps : 0 );
+
+    std::vector<std::string> ids;
+    if( !jump ) {
+        // Cues of dropped frames are crossed too.
+        _cuePoints.crossed( from, _currentTime, &ids );
+    } else if( _mediaIndex && _mediaIndex->frameCount() > 0 ) {
+        const unsigned frame = indexedFrame();
+        const libvlc_time_t start = _mediaIndex->frameTime( frame ) / 1000;
+        const libvlc_time_t end = frame + 1 < _mediaIndex->frameCount() ?
+            _mediaIndex->frameTime( frame + 1 ) / 1000 : start + 1;
+        _cuePoints.landed( start, std::max<libvlc_time_t>( end - start, 1 ), &ids );
+    } else {
+        const libvlc_time_t frameDuration = fps > 0 ? static_cast<libvlc_time_t>( 1000.0 / fps ) : 1;
+        _cuePoints.landed( _currentTime, std::max<libvlc_time_t>( frameDuration, 1 ), &ids );
+    }
 
-            const libvlc_time_t length = player().playback().get_length();
-            _currentTime = std::min( playbackTime, length );
-        }
+    if( ids.empty() )
+        return;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope( isolate );
+
+    // Callbacks could seek or change cues, so ids are copied.
+    for( const std::string& id: ids ) {
+        callCallback( CB_CuePoint, {
+            String::NewFromUtf8( isolate, id.c_str(), NewStringType::kNormal ).ToLocalChecked(),
+            Number::New( isolate, static_cast<double>( _cueTime ) ) } );
+    }
+}
+
+void JsVlcPlayer::startSeek( unsigned steps )
+{
+    // Frames displayed before the seek are never the seeked one, even if they already got
+    // the new time, and the seeked one is stamped with time rounded to frame at most.
+    const double fps = this->fps();
+    const int64_t tolerance = std::max( 1ll, static_cast<long long>( fps > 0 ? 500.0 / fps : 0 ) );
+
+    _performSeek = true;
+    _seekMatcher.start( _currentFrameInfo.sequence, steps, tolerance );
+
+    uv_timer_start( _seekTimer,
+        [] ( uv_timer_t* handle ) {
+            if( handle->data )
+                static_cast<JsVlcPlayer*>( handle->data )->handleSeekTimeout();
+        }, MaxSeekWait, 0 );
+}
+
+void JsVlcPlayer::finishSeek()
+{
+    _performSeek = false;
+    uv_timer_stop( _seekTimer );
+
+    if( _mediaIndex ) {
+        _decoderFrame = indexedFrame();
+        cacheCurrentFrame( _decoderFrame );
     }
-    else if( _loadVideoState == ELoadVideoState::GETTING ) {
-        // Take into account spent time loading the proper starting frame.
-        if ( _startPlayingReverse )
-          _loadingTime -= static_cast<libvlc_time_t>( static_cast<double>( currentGlobalTime - _lastGlobalTimeFrameReady ) * _cppInput->rateReverse() );
-        else if ( _startPlaying )
-          _loadingTime += static_cast<libvlc_time_t>( static_cast<double>( currentGlobalTime - _lastGlobalTimeFrameReady ) * _cppInput->rate() );
+    doCallCallback();
+    settleFrameSeek();
+}
+
+void JsVlcPlayer::handleSeekTimeout()
+{
+    if( !_performSeek )
+        return;
+
+    // Decoder position is unknown, so next seek doesn't step from it.
+    _performSeek = false;
+    _decoderFrame = InvalidFrame;
+    settleFrameSeek( "Seek timed out" );
+
+    if( _scrubPending && ELoadVideoState::LOADED == _loadVideoState )
+        seekToScrubTime();
+}
+
+void JsVlcPlayer::settleFrameSeek( const char* error )
+{
+    using namespace v8;
+
+    if( _jsSeekResolver.IsEmpty() )
+        return;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope( isolate );
+    Local<Context> context = isolate->GetCurrentContext();
+
+    Local<Promise::Resolver> resolver = Local<Promise::Resolver>::New( isolate, _jsSeekResolver );
+    _jsSeekResolver.Reset();
+
+    // Another seek could come after seekToFrame() and satisfy only itself.
+    if( !error && _seekTime != _currentTime )
+        error = "Seek superseded by another seek";
+
+    if( error ) {
+        resolver->Reject( context,
+            Exception::Error( String::NewFromUtf8( isolate, error, NewStringType::kNormal ).ToLocalChecked() ) );
+    } else {
+        resolver->Resolve( context, Local<Value>::New( isolate, _jsFrameBuffer ) );
     }
+}
 
-    _lastGlobalTimeFrameReady = currentGlobalTime;
+void JsVlcPlayer::updateCurrentTime( libvlc_time_t frameTime ) {
+    if( _isPlaying && !_reversePlayback && !_trickPlay ) {
+        // Frame time is stamped by video output when the frame is displayed (picture PTS for
+        // indexed media), so it doesn't depend on how late the frame reached us.
+        if( !_performSeek && frameTime >= 0 ) {
+            // Cached from LengthChanged, libvlc is not asked on every frame.
+            const libvlc_time_t length = _reportedLength;
+            _currentTime = length > 0 ? std::min( frameTime, length ) : frameTime;
+        }
+    }
 }
 
 void JsVlcPlayer::setCurrentTime( libvlc_time_t time )
@@ -860,15 +1626,6 @@ void JsVlcPlayer::setCurrentTime( libvlc_time_t time )
         _currentTime = std::max( 0ll, std::min( time, videoLength ) );
     else
         _currentTime = std::max( 0ll, time );
-
-    using namespace std::chrono;
-
-    const libvlc_time_t playbackTime = player().playback().get_time();
-    _lastPlaybackTimeFrameReady = playbackTime;
-
-    const milliseconds msSinceEpoch = duration_cast<milliseconds>( system_clock::now().time_since_epoch() );
-    const libvlc_time_t nowTime = static_cast<libvlc_time_t>( msSinceEpoch.count() );
-    _lastGlobalTimeFrameReady = nowTime;
 }
 
 double JsVlcPlayer::rateReverse()
@@ -881,6 +1638,27 @@ void JsVlcPlayer::setRateReverse( double rateReverse )
     _cppInput->setRateReverse( rateReverse );
 }
 
+double JsVlcPlayer::trickPlayRate()
+{
+    return _cppInput->trickPlayRate();
+}
+
+void JsVlcPlayer::reshapeVideoOutput()
+{
+    // Decoder keeps going, only frame buffers are recreated
+    // and the current picture is rendered to them with the new geometry.
+    if( !VlcVideoOutput::reshapeVideoFrame() )
+        return;
+
+    // Playing decoder replaces it right away anyway.
+    if( _isPlaying || _reversePlayback || _trickPlay || _performSeek ) {
+        VlcVideoOutput::releaseFrame( currentFrameSlot() );
+        return;
+    }
+
+    doCallCallback();
+}
+
 double JsVlcPlayer::decimalFrame() {
   return time() / ( 1000.0 / fps() );
 }
@@ -925,6 +1703,120 @@ void JsVlcPlayer::jsLoad( const v8::FunctionCallbackInfo<v8::Value>& args )
     }
 }
 
+void JsVlcPlayer::jsSeekToFrame( const v8::FunctionCallbackInfo<v8::Value>& args )
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    JsVlcPlayer* jsPlayer = ObjectWrap::Unwrap<JsVlcPlayer>( args.Holder() );
+
+    Local<Promise::Resolver> resolver = Promise::Resolver::New( context ).ToLocalChecked();
+    args.GetReturnValue().Set( resolver->GetPromise() );
+
+    if( args.Length() < 1 || !args[0]->IsNumber() ) {
+        resolver->Reject( context,
+            Exception::TypeError( String::NewFromUtf8( isolate, "Frame number expected", NewStringType::kNormal ).ToLocalChecked() ) );
+        return;
+    }
+
+    jsPlayer->seekToFrame( args[0]->ToNumber( context ).ToLocalChecked()->Value(), resolver );
+}
+
+void JsVlcPlayer::jsSetLoop( const v8::FunctionCallbackInfo<v8::Value>& args )
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    JsVlcPlayer* jsPlayer = ObjectWrap::Unwrap<JsVlcPlayer>( args.Holder() );
+
+    if( args.Length() < 2 ) {
+        jsPlayer->clearLoop();
+        return;
+    }
+
+    assert( args[0]->IsNumber() && args[1]->IsNumber() );
+    const double in = args[0]->ToNumber( context ).ToLocalChecked()->Value();
+    const double out = args[1]->ToNumber( context ).ToLocalChecked()->Value();
+
+    bool cache = false;
+    unsigned cacheSize = DefaultLoopCacheSize;
+    if( args.Length() >= 3 && args[2]->IsObject() ) {
+        Local<Object> options = Local<Object>::Cast( args[2] );
+        Local<Value> jsCache =
+            options->Get( String::NewFromUtf8( isolate, "cache", NewStringType::kInternalized ).ToLocalChecked() );
+        if( !jsCache->IsUndefined() )
+            cache = jsCache->ToBoolean()->Value();
+
+        Local<Value> jsCacheSize =
+            options->Get( String::NewFromUtf8( isolate, "cacheSize", NewStringType::kInternalized ).ToLocalChecked() );
+        if( jsCacheSize->IsUint32() )
+            cacheSize = jsCacheSize->ToUint32( context ).ToLocalChecked()->Value();
+    }
+
+    jsPlayer->setLoop( in, out, cache, cacheSize );
+}
+
+void JsVlcPlayer::jsAddCuePoint( const v8::FunctionCallbackInfo<v8::Value>& args )
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    JsVlcPlayer* jsPlayer = ObjectWrap::Unwrap<JsVlcPlayer>( args.Holder() );
+
+    assert( args.Length() >= 2 && args[0]->IsNumber() );
+    if( args.Length() < 2 || !args[0]->IsNumber() )
+        return;
+
+    const double position = args[0]->ToNumber( context ).ToLocalChecked()->Value();
+    String::Utf8Value id( args[1]->ToString() );
+
+    bool inFrames = false;
+    if( args.Length() >= 3 && args[2]->IsObject() ) {
+        Local<Object> options = Local<Object>::Cast( args[2] );
+        Local<Value> jsFrames =
+            options->Get( String::NewFromUtf8( isolate, "frames", NewStringType::kInternalized ).ToLocalChecked() );
+        if( !jsFrames->IsUndefined() )
+            inFrames = jsFrames->ToBoolean()->Value();
+    }
+
+    jsPlayer->addCuePoint( std::string( *id, id.length() ), position, inFrames );
+}
+
+void JsVlcPlayer::jsSetOutputSize( const v8::FunctionCallbackInfo<v8::Value>& args )
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    JsVlcPlayer* jsPlayer = ObjectWrap::Unwrap<JsVlcPlayer>( args.Holder() );
+
+    unsigned width = 0;
+    unsigned height = 0;
+    if( args.Length() >= 2 ) {
+        assert( args[0]->IsUint32() && args[1]->IsUint32() );
+        width = args[0]->ToUint32( context ).ToLocalChecked()->Value();
+        height = args[1]->ToUint32( context ).ToLocalChecked()->Value();
+    }
+
+    bool keepAspect = true;
+    if( args.Length() >= 3 && args[2]->IsObject() ) {
+        Local<Object> options = Local<Object>::Cast( args[2] );
+        Local<Value> jsKeepAspect =
+            options->Get( String::NewFromUtf8( isolate, "keepAspect", NewStringType::kInternalized ).ToLocalChecked() );
+        if( !jsKeepAspect->IsUndefined() )
+            keepAspect = jsKeepAspect->ToBoolean()->Value();
+    }
+
+    jsPlayer->setOutputSize( width, height, keepAspect );
+}
+
 void JsVlcPlayer::getJsCallback( v8::Local<v8::String> property,
                                  const v8::PropertyCallbackInfo<v8::Value>& info,
                                  Callbacks_e callback )
@@ -957,119 +1849,1222 @@ void JsVlcPlayer::setJsCallback( v8::Local<v8::String> property,
 
     JsVlcPlayer* jsPlayer = ObjectWrap::Unwrap<JsVlcPlayer>( info.Holder() );
 
-    Local<Function> callbackFunc = Local<Function>::Cast( value );
-    if( !callbackFunc.IsEmpty() )
-        jsPlayer->_jsCallbacks[callback].Reset( isolate, callbackFunc );
+    if( value->IsFunction() )
+        jsPlayer->_jsCallbacks[callback].Reset( isolate, Local<Function>::Cast( value ) );
+    else
+        jsPlayer->_jsCallbacks[callback].Reset();
+
+    jsPlayer->updateWantedCallbacks();
+}
+
+void JsVlcPlayer::jsEmitterListenersMethod( const v8::FunctionCallbackInfo<v8::Value>& args )
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    Local<Array> data = Local<Array>::Cast( args.Data() );
+    const unsigned instanceId =
+        Local<Uint32>::Cast( data->Get( context, 0 ).ToLocalChecked() )->Value();
+    Local<Function> method = Local<Function>::Cast( data->Get( context, 1 ).ToLocalChecked() );
+
+    std::vector<Local<Value> > argv;
+    for( int i = 0; i < args.Length(); ++i )
+        argv.push_back( args[i] );
+
+    MaybeLocal<Value> result =
+        method->Call( context, args.This(), static_cast<int>( argv.size() ), argv.data() );
+    // Exception is left for the caller.
+    if( result.IsEmpty() )
+        return;
+
+    for( JsVlcPlayer* p : _instances ) {
+        if( p->_instanceId == instanceId ) {
+            p->countEmitterListeners();
+            break;
+        }
+    }
+
+    args.GetReturnValue().Set( result.ToLocalChecked() );
+}
+
+void JsVlcPlayer::countEmitterListeners()
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    Local<Object> eventEmitter = getEventEmitter();
+    Local<Value> listenerCount =
+        eventEmitter->Get(
+            String::NewFromUtf8( isolate, "listenerCount", NewStringType::kInternalized ).ToLocalChecked() );
+    if( !listenerCount->IsFunction() )
+        return;
+
+    Local<Array> jsCallbackNames = Local<Array>::New( isolate, _jsCallbackNames );
+    for( unsigned i = 0; i < CB_Max; ++i ) {
+        Local<Value> argv[] = { jsCallbackNames->Get( context, i ).ToLocalChecked() };
+        Local<Value> count;
+        if( Local<Function>::Cast( listenerCount )->Call( context, eventEmitter, 1, argv ).ToLocal( &count ) &&
+            count->IsNumber() )
+        {
+            _emitterListeners[i] = static_cast<unsigned>( Local<Number>::Cast( count )->Value() );
+        }
+    }
+
+    updateWantedCallbacks();
+}
+
+void JsVlcPlayer::updateWantedCallbacks()
+{
+    static_assert( CB_Max <= 32, "_wantedCallbacks has bit per callback" );
+
+    uint32_t listened = 0;
+    for( unsigned i = 0; i < CB_Max; ++i ) {
+        if( _emitterListeners[i] || !_jsCallbacks[i].IsEmpty() )
+            listened |= 1u << i;
+    }
+
+    uint32_t libvlcCallbacks = 0;
+    for( unsigned i = CB_MediaPlayerMediaChanged; i <= CB_MediaPlayerLengthChanged; ++i )
+        libvlcCallbacks |= 1u << i;
+
+    uint32_t wanted = listened;
+    // Batched libvlc events are seen only by EventBatch listeners.
+    if( _batchEvents ) {
+        wanted &= ~libvlcCallbacks;
+        if( listened & ( 1u << CB_EventBatch ) )
+            wanted |= libvlcCallbacks;
+    }
+
+    // These drive playlist, per-media state and preroll, no matter if JS listens.
+    wanted |= 1u << CB_MediaPlayerMediaChanged;
+    wanted |= 1u << CB_MediaPlayerEndReached;
+    wanted |= 1u << CB_MediaPlayerEncounteredError;
+    if( _prerollTime > 0 )
+        wanted |= 1u << CB_MediaPlayerTimeChanged;
+
+    _wantedCallbacks.store( wanted, std::memory_order_relaxed );
+}
+
+bool JsVlcPlayer::throttleEvent( Callbacks_e callback, double value )
+{
+    if( !_eventThrottleMs )
+        return false;
+
+    ThrottledEvent* throttled = nullptr;
+    for( ThrottledEvent& e: _throttledEvents ) {
+        if( e.callback == callback )
+            throttled = &e;
+    }
+    if( !throttled )
+        return false;
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const std::chrono::milliseconds interval( _eventThrottleMs );
+    if( now - throttled->lastDelivered >= interval ) {
+        throttled->pending = false;
+        throttled->lastDelivered = now;
+        return false;
+    }
+
+    // Only the latest value is kept, and it's delivered when interval is over.
+    throttled->pending = true;
+    throttled->value = value;
+
+    if( !uv_is_active( reinterpret_cast<uv_handle_t*>( _throttleTimer ) ) ) {
+        const uint64_t remaining = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                throttled->lastDelivered + interval - now ).count() );
+        uv_timer_start( _throttleTimer,
+            [] ( uv_timer_t* handle ) {
+                if( handle->data ) {
+                    JsVlcPlayer* jsPlayer = static_cast<JsVlcPlayer*>( handle->data );
+                    jsPlayer->flushThrottledEvents();
+                    jsPlayer->flushEventBatch();
+                }
+            }, std::max<uint64_t>( remaining, 1 ), 0 );
+    }
+
+    return true;
+}
+
+void JsVlcPlayer::flushThrottledEvents()
+{
+    uv_timer_stop( _throttleTimer );
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for( ThrottledEvent& e: _throttledEvents ) {
+        if( !e.pending )
+            continue;
+
+        e.pending = false;
+        e.lastDelivered = now;
+        deliverLibvlcCallback( e.callback, NumberValue, e.value );
+    }
 }
 
 bool JsVlcPlayer::playing()
 {
-    return _isPlaying;
+    return _isPlaying;
+}
+
+bool JsVlcPlayer::playingReverse()
+{
+    return _reversePlayback;
+}
+
+double JsVlcPlayer::reverseFps()
+{
+    return _reverse.fps();
+}
+
+bool JsVlcPlayer::trickPlaying()
+{
+    return _trickPlay;
+}
+
+double JsVlcPlayer::length()
+{
+    return static_cast<double>( player().playback().get_length() );
+}
+
+double JsVlcPlayer::fps()
+{
+    if ( _withFps > 0.0f )
+        return static_cast<double>( _withFps );
+
+    return static_cast<double>( player().playback().get_fps() );
+}
+
+double JsVlcPlayer::frames()
+{
+    if( _mediaIndex )
+        return _mediaIndex->frameCount();
+
+    return std::ceil( length() * fps() / 1000.0 ) + 1;
+}
+
+bool JsVlcPlayer::indexed()
+{
+    return static_cast<bool>( _mediaIndex );
+}
+
+unsigned JsVlcPlayer::state()
+{
+    return player().get_state();
+}
+
+v8::Local<v8::Value> JsVlcPlayer::getVideoFrame()
+{
+    return v8::Local<v8::Value>::New( v8::Isolate::GetCurrent(), _jsFrameBuffer );
+}
+
+v8::Local<v8::Object> JsVlcPlayer::getEventEmitter()
+{
+    return v8::Local<v8::Object>::New( v8::Isolate::GetCurrent(), _jsEventEmitter );
+}
+
+unsigned JsVlcPlayer::pixelFormat()
+{
+    return static_cast<unsigned>( VlcVideoOutput::pixelFormat() );
+}
+
+void JsVlcPlayer::setPixelFormat( unsigned format )
+{
+    switch( format ) {
+        case static_cast<unsigned>( PixelFormat::RV32 ):
+            VlcVideoOutput::setPixelFormat( PixelFormat::RV32 );
+            break;
+        case static_cast<unsigned>( PixelFormat::I420 ):
+            VlcVideoOutput::setPixelFormat( PixelFormat::I420 );
+            break;
+        case static_cast<unsigned>( PixelFormat::RGBA ):
+            VlcVideoOutput::setPixelFormat( PixelFormat::RGBA );
+            break;
+        case static_cast<unsigned>( PixelFormat::NV12 ):
+            VlcVideoOutput::setPixelFormat( PixelFormat::NV12 );
+            break;
+        case static_cast<unsigned>( PixelFormat::GREY ):
+            VlcVideoOutput::setPixelFormat( PixelFormat::GREY );
+            break;
+    }
+}
+
+unsigned JsVlcPlayer::frameBufferCount()
+{
+    return VlcVideoOutput::frameBufferCount();
+}
+
+void JsVlcPlayer::setFrameBufferCount( unsigned count )
+{
+    VlcVideoOutput::setFrameBufferCount( count );
+}
+
+unsigned JsVlcPlayer::frameBufferPolicy()
+{
+    return static_cast<unsigned>( VlcVideoOutput::frameBufferPolicy() );
+}
+
+void JsVlcPlayer::setFrameBufferPolicy( unsigned policy )
+{
+    switch( policy ) {
+        case static_cast<unsigned>( FrameBufferPolicy::Block ):
+            VlcVideoOutput::setFrameBufferPolicy( FrameBufferPolicy::Block );
+            break;
+        case static_cast<unsigned>( FrameBufferPolicy::DropOldest ):
+            VlcVideoOutput::setFrameBufferPolicy( FrameBufferPolicy::DropOldest );
+            break;
+        case static_cast<unsigned>( FrameBufferPolicy::DropNewest ):
+            VlcVideoOutput::setFrameBufferPolicy( FrameBufferPolicy::DropNewest );
+            break;
+    }
+}
+
+unsigned JsVlcPlayer::rowAlignment()
+{
+    return VlcVideoOutput::rowAlignment();
+}
+
+void JsVlcPlayer::setRowAlignment( unsigned alignment )
+{
+    VlcVideoOutput::setRowAlignment( alignment );
+}
+
+double JsVlcPlayer::droppedFrames()
+{
+    return static_cast<double>( VlcVideoOutput::droppedFrames() );
+}
+
+unsigned JsVlcPlayer::frameCacheSize()
+{
+    return static_cast<unsigned>( _frameCache.budget() / ( 1024 * 1024 ) );
+}
+
+void JsVlcPlayer::setFrameCacheSize( unsigned megabytes )
+{
+    _frameCache.setBudget( static_cast<size_t>( megabytes ) * 1024 * 1024 );
+    prefetchNext();
+}
+
+unsigned JsVlcPlayer::prefetchFrames()
+{
+    return _prefetchFrames;
+}
+
+void JsVlcPlayer::setPrefetchFrames( unsigned frames )
+{
+    _prefetchFrames = frames;
+    prefetchNext();
+}
+
+void JsVlcPlayer::jsSnapshot( const v8::FunctionCallbackInfo<v8::Value>& args )
+{
+    using namespace v8;
+
+    JsVlcPlayer* jsPlayer = ObjectWrap::Unwrap<JsVlcPlayer>( args.Holder() );
+
+    double fields[SF_Max];
+
+#ifdef USE_ARRAY_BUFFER
+    assert( args.Length() >= 1 && args[0]->IsFloat64Array() );
+    if( args.Length() < 1 || !args[0]->IsFloat64Array() )
+        return;
+
+    // Filled in place, so render loop doesn't allocate anything per frame.
+    Local<Float64Array> jsFields = Local<Float64Array>::Cast( args[0] );
+    const unsigned count = std::min<unsigned>( static_cast<unsigned>( jsFields->Length() ), SF_Max );
+    jsPlayer->snapshot( fields );
+    memcpy( static_cast<char*>( ArrayBufferData( jsFields->Buffer() ) ) + jsFields->ByteOffset(),
+            fields, count * sizeof( double ) );
+#else
+    Isolate* isolate = Isolate::GetCurrent();
+    Local<Context> context = isolate->GetCurrentContext();
+
+    assert( args.Length() >= 1 && args[0]->IsArray() );
+    if( args.Length() < 1 || !args[0]->IsArray() )
+        return;
+
+    Local<Array> jsFields = Local<Array>::Cast( args[0] );
+    const unsigned count = std::min<unsigned>( jsFields->Length(), SF_Max );
+    jsPlayer->snapshot( fields );
+    for( unsigned i = 0; i < count; ++i )
+        jsFields->Set( context, i, Number::New( isolate, fields[i] ) ).FromJust();
+#endif
+
+    args.GetReturnValue().Set( count );
+}
+
+void JsVlcPlayer::snapshot( double ( &fields )[SF_Max] )
+{
+    // Everything is derived from the same current time and from state libvlc already reported,
+    // unlike separate getters, each of which takes libvlc locks on its own.
+    const libvlc_time_t time = _currentTime;
+    const double length = static_cast<double>( _reportedLength.load() );
+
+    if( _withFps > 0.0f )
+        _mediaFps = _withFps;
+    else if( _mediaFps <= 0 )
+        _mediaFps = static_cast<double>( player().playback().get_fps() );
+    const double fps = _mediaFps;
+
+    // Frames is count of frames here, like frameCount() of index,
+    // so the last frame is frames - 1.
+    double frame;
+    double frames;
+    if( _mediaIndex ) {
+        frames = _mediaIndex->frameCount();
+        frame = _mediaIndex->frameAt( ( time + 1 ) * 1000 - 1 );
+    } else {
+        frames = std::ceil( length * fps / 1000.0 );
+        frame = fps > 0 ? std::min( std::round( time / ( 1000.0 / fps ) ), std::max( frames - 1.0, 0.0 ) ) : 0.0;
+    }
+
+    fields[SF_Time] = static_cast<double>( time );
+    fields[SF_Frame] = frame;
+    fields[SF_Position] = length > 0 ? time / length : 0.0;
+    fields[SF_Length] = length;
+    fields[SF_State] = static_cast<double>( _reportedState.load() );
+    fields[SF_Playing] = _isPlaying ? 1.0 : 0.0;
+    fields[SF_Rate] = _rate;
+    fields[SF_Fps] = fps;
+    fields[SF_Frames] = frames;
+}
+
+bool JsVlcPlayer::batchEvents()
+{
+    return _batchEvents;
+}
+
+unsigned JsVlcPlayer::eventThrottleMs()
+{
+    return _eventThrottleMs;
+}
+
+void JsVlcPlayer::setEventThrottleMs( unsigned ms )
+{
+    _eventThrottleMs = ms;
+
+    if( !_eventThrottleMs ) {
+        flushThrottledEvents();
+        flushEventBatch();
+    }
+}
+
+void JsVlcPlayer::setBatchEvents( bool batch )
+{
+    _batchEvents = batch;
+
+    updateWantedCallbacks();
+}
+
+double JsVlcPlayer::prerollTime()
+{
+    return _prerollTime;
+}
+
+void JsVlcPlayer::setPrerollTime( double seconds )
+{
+    _prerollTime = std::max( seconds, 0.0 );
+
+    if( 0 == _prerollTime )
+        resetPreroll();
+
+    updateWantedCallbacks();
+}
+
+double JsVlcPlayer::prerollHits()
+{
+    return static_cast<double>( _prerollHits );
+}
+
+double JsVlcPlayer::prerollMisses()
+{
+    return static_cast<double>( _prerollMisses );
+}
+
+double JsVlcPlayer::frameCacheHits()
+{
+    return static_cast<double>( _frameCache.hits() );
+}
+
+double JsVlcPlayer::frameCacheMisses()
+{
+    return static_cast<double>( _frameCache.misses() );
+}
+
+bool JsVlcPlayer::rgbaConversion()
+{
+    return VlcVideoOutput::rgbaConversion();
+}
+
+void JsVlcPlayer::setRGBAConversion( bool enabled )
+{
+    VlcVideoOutput::setRGBAConversion( enabled );
+}
+
+unsigned JsVlcPlayer::colorMatrix()
+{
+    return static_cast<unsigned>( VlcVideoOutput::colorMatrix() );
+}
+
+void JsVlcPlayer::setColorMatrix( unsigned matrix )
+{
+    switch( matrix ) {
+        case static_cast<unsigned>( ColorMatrix::Auto ):
+            VlcVideoOutput::setColorMatrix( ColorMatrix::Auto );
+            break;
+        case static_cast<unsigned>( ColorMatrix::BT601 ):
+            VlcVideoOutput::setColorMatrix( ColorMatrix::BT601 );
+            break;
+        case static_cast<unsigned>( ColorMatrix::BT709 ):
+            VlcVideoOutput::setColorMatrix( ColorMatrix::BT709 );
+            break;
+    }
+}
+
+unsigned JsVlcPlayer::colorRange()
+{
+    return static_cast<unsigned>( VlcVideoOutput::colorRange() );
+}
+
+void JsVlcPlayer::setColorRange( unsigned range )
+{
+    switch( range ) {
+        case static_cast<unsigned>( ColorRange::Limited ):
+            VlcVideoOutput::setColorRange( ColorRange::Limited );
+            break;
+        case static_cast<unsigned>( ColorRange::Full ):
+            VlcVideoOutput::setColorRange( ColorRange::Full );
+            break;
+    }
+}
+
+std::string JsVlcPlayer::conversionKernel()
+{
+    return ConversionKernelName( BestConversionKernel() );
+}
+
+void JsVlcPlayer::releaseJsFrame( v8::Local<v8::Value> jsFrame )
+{
+    using namespace v8;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope( isolate );
+
+    for( unsigned i = 0; i < _jsFrameBuffers.size(); ++i ) {
+        if( Local<Value>::New( isolate, _jsFrameBuffers[i] )->StrictEquals( jsFrame ) ) {
+            VlcVideoOutput::releaseFrame( i );
+            break;
+        }
+    }
+}
+
+void JsVlcPlayer::setOutputSize( unsigned width, unsigned height, bool keepAspect )
+{
+    if( VlcVideoOutput::setOutputSize( width, height, keepAspect ) )
+        reshapeVideoOutput();
+}
+
+void JsVlcPlayer::setCropRegion( unsigned x, unsigned y, unsigned width, unsigned height )
+{
+    // Only size change requires new frame buffers,
+    // region is cropped from the same decoded picture either way.
+    if( VlcVideoOutput::setCropRegion( x, y, width, height ) )
+        reshapeVideoOutput();
+}
+
+double JsVlcPlayer::position()
+{
+    assert( _currentTime >= 0 && _currentTime <= length() );
+
+    return static_cast<double>( _currentTime ) / length();
+}
+
+void JsVlcPlayer::setPosition( double position )
+{
+    position = std::max( 0.0, std::min( position, 1.0 ) );
+
+    if( _reversePlayback ) {
+        setCurrentTime( static_cast<libvlc_time_t>( position * length() ) );
+        startReverse();
+        return;
+    }
+
+    if( _scrubbing && length() > 0 ) {
+        setTime( position * length() );
+        return;
+    }
+
+    cancelPrefetch();
+    _decoderFrame = InvalidFrame;
+    _decoderMoved = false;
+
+    startSeek( 0 );
+    setCurrentTime( static_cast<libvlc_time_t>( position * length() ) );
+    player().playback().set_position( static_cast<float>( position ) );
+}
+
+double JsVlcPlayer::time()
+{
+    assert( _currentTime >= 0.0 && _currentTime <= length() );
+
+    return static_cast<double>( _currentTime );
+}
+
+void JsVlcPlayer::setTime( double time )
+{
+    if( !_scrubbing ) {
+        seekTo( static_cast<libvlc_time_t>( time ) );
+        return;
+    }
+
+    // Seeks are queued by libvlc, so while one is in progress only the latest target is kept.
+    _scrubTime = static_cast<libvlc_time_t>( time );
+    _scrubPending = true;
+
+    // Seek could never show a frame, e.g. beyond the end, and shouldn't block scrubbing forever.
+    const bool seekStuck =
+        std::chrono::steady_clock::now() - _scrubSeekStart > std::chrono::milliseconds( MaxScrubSeekWait );
+    if( !_performSeek || seekStuck )
+        seekToScrubTime();
+}
+
+double JsVlcPlayer::rate()
+{
+    return _rate;
+}
+
+void JsVlcPlayer::setRate( double rate )
+{
+    _rate = rate;
+
+    // libvlc would try to decode every frame and fall behind.
+    const bool trickPlay = isTrickPlayRate( rate );
+    if( !trickPlay ) {
+        player().playback().set_rate( static_cast<float>( rate ) );
+        VlcVideoOutput::setPlaybackRate( static_cast<float>( rate ) );
+    }
+
+    if( !_isPlaying || _reversePlayback || trickPlay == _trickPlay )
+        return;
+
+    if( trickPlay ) {
+        startTrickPlay();
+    } else {
+        stopTrickPlay();
+        _decoderMoved = true;
+        resyncDecoder();
+        player().play();
+    }
+}
+
+bool JsVlcPlayer::scrubbing()
+{
+    return _scrubbing;
+}
+
+void JsVlcPlayer::setScrubbing( bool scrubbing )
+{
+    if( _scrubbing == scrubbing )
+        return;
+
+    _scrubbing = scrubbing;
+    if( scrubbing )
+        return;
+
+    // Pending and approximate seeks are finished by the exact seek to the latest target.
+    if( _scrubPending || _scrubApproximate )
+        seekTo( _scrubTime );
+
+    _scrubPending = false;
+    _scrubApproximate = false;
+}
+
+bool JsVlcPlayer::keyframeScrubbing()
+{
+    return _keyframeScrubbing;
+}
+
+void JsVlcPlayer::setKeyframeScrubbing( bool keyframeScrubbing )
+{
+    _keyframeScrubbing = keyframeScrubbing;
+}
+
+void JsVlcPlayer::seekToScrubTime()
+{
+    _scrubPending = false;
+    _scrubSeekStart = std::chrono::steady_clock::now();
+
+    // Keyframe is shown without decoding of any other frame.
+    libvlc_time_t time = _scrubTime;
+    if( _keyframeScrubbing && _mediaIndex && !_reversePlayback ) {
+        const unsigned frame = _mediaIndex->frameAt( ( _scrubTime + 1 ) * 1000 - 1 );
+        time = _mediaIndex->frameTime( _mediaIndex->keyframeBefore( frame ) ) / 1000;
+    }
+    _scrubApproximate = time != _scrubTime;
+
+    seekTo( time );
+}
+
+void JsVlcPlayer::seekTo( libvlc_time_t time )
+{
+    _cueJump = true;
+
+    if( _reversePlayback ) {
+        setCurrentTime( time );
+        startReverse();
+        return;
+    }
+
+    // Decoder continues from the seeked time, clip is replayed again on the next wrap.
+    if( _loopReplay ) {
+        stopLoopReplay();
+        player().play();
+    }
+    _loopWrapped = false;
+
+    cancelPrefetch();
+    _decoderFrame = InvalidFrame;
+    _decoderMoved = false;
+
+    startSeek( 0 );
+    setCurrentTime( time );
+    player().playback().set_time( _currentTime );
+}
+
+double JsVlcPlayer::frame()
+{
+    if( _mediaIndex )
+        return indexedFrame();
+
+    const double iFrame = std::round( decimalFrame() );
+
+    return std::min( iFrame, frames() );
+}
+
+void JsVlcPlayer::setFrame( double frame )
+{
+    if( _mediaIndex ) {
+        const unsigned lastFrame = _mediaIndex->frameCount() - 1;
+        const unsigned target = static_cast<unsigned>( std::max( 0.0, std::min( frame, static_cast<double>( lastFrame ) ) ) );
+        // Seek is floored to milliseconds, so decoder doesn't skip the frame as too early.
+        const libvlc_time_t targetTime = _mediaIndex->frameTime( target ) / 1000;
+
+        const bool paused = !_isPlaying && ELoadVideoState::LOADED == _loadVideoState;
+        if( paused && _frameCache.budget() > 0 && deliverCachedFrame( target ) )
+            return;
+
+        // Frame of outstanding request would be taken for stepped one.
+        const bool decoderIdle = !_performSeek && EPrefetchState::IDLE == _prefetchState;
+        cancelPrefetch();
+
+        // Seek decodes from the keyframe, so if there is no keyframe in between,
+        // it's cheaper to decode just the next few frames.
+        const unsigned steps =
+            paused && decoderIdle && InvalidFrame != _decoderFrame ?
+                _mediaIndex->stepsTo( _decoderFrame, target ) : 0;
+        if( steps > 0 && steps <= MaxFrameSteps ) {
+            _decoderFrame = InvalidFrame;
+            _decoderMoved = false;
+            startSeek( steps );
+            setCurrentTime( targetTime );
+
+            libvlc_media_player_t* mp = player().basic_player().get_mp();
+            for( unsigned i = 0; i < steps; ++i )
+                libvlc_media_player_next_frame( mp );
+        } else {
+            seekTo( targetTime );
+        }
+
+        return;
+    }
+
+    frame = std::max( 0.0, std::min( frame, frames() ) );
+
+    seekTo( static_cast<libvlc_time_t>( std::min( frame * 1000.0 / fps(), length() ) ) );
+}
+
+bool JsVlcPlayer::deliverFrameCopy( const FrameBufferPool::Buffer& frame, libvlc_time_t time, bool checkCues )
+{
+    using namespace v8;
+
+    const VideoFrame* videoFrame = VlcVideoOutput::currentVideoFrame();
+    if( !videoFrame || frame.size() != videoFrame->size() )
+        return false;
+
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope( isolate );
+
+    // Separate buffer, since decoder keeps writing to frame buffers meanwhile.
+    if( _jsCachedFrameBuffer.IsEmpty() ) {
+        Local<Uint8Array> jsArray = createFrameBuffer( *videoFrame, videoFrame->slotCount() );
+        _jsCachedFrameBuffer.Reset( isolate, jsArray );
+#ifdef USE_ARRAY_BUFFER
+        _cachedFrameData = static_cast<char*>( ArrayBufferData( jsArray->Buffer() ) ) + jsArray->ByteOffset();
+#else
+        _cachedFrameData = static_cast<char*>( jsArray->GetIndexedPropertiesExternalArrayData() );
+#endif
+    }
+
+    memcpy( _cachedFrameData, frame.data(), frame.size() );
+
+    setCurrentTime( time );
+
+    _jsFrameBuffer.Reset( isolate, Local<Value>::New( isolate, _jsCachedFrameBuffer ) );
+    callFrameReadyCallback( checkCues );
+
+    return true;
+}
+
+bool JsVlcPlayer::deliverCachedFrame( unsigned frame )
+{
+    const FrameBufferPool::Buffer* cached = _frameCache.find( _mediaIndex->frameTime( frame ) );
+    if( !cached )
+        return false;
+
+    // Frame of seek in progress is not needed anymore, but decoder position after it is unknown.
+    const bool performSeek = _performSeek;
+    _performSeek = false;
+    if( !deliverFrameCopy( *cached, _mediaIndex->frameTime( frame ) / 1000 ) ) {
+        _performSeek = performSeek;
+        return false;
+    }
+
+    if( performSeek )
+        _decoderFrame = InvalidFrame;
+    _decoderMoved = true;
+
+    return true;
 }
 
-bool JsVlcPlayer::playingReverse()
+void JsVlcPlayer::cacheCurrentFrame( unsigned frame )
 {
-    return _reversePlayback;
+    const VideoFrame* videoFrame = VlcVideoOutput::currentVideoFrame();
+    if( !videoFrame || 0 == _frameCache.budget() || currentFrameSlot() >= _frameBufferData.size() )
+        return;
+
+    _frameCache.insert( _mediaIndex->frameTime( frame ),
+                        _frameBufferData[currentFrameSlot()], videoFrame->size() );
 }
 
-double JsVlcPlayer::length()
+void JsVlcPlayer::prefetchNext()
 {
-    return static_cast<double>( player().playback().get_length() );
+    const VideoFrame* videoFrame = VlcVideoOutput::currentVideoFrame();
+
+    // Single frame buffer is shared with JS, so prefetched frames would overwrite the shown one.
+    if( EPrefetchState::IDLE != _prefetchState || !_mediaIndex || !videoFrame ||
+        videoFrame->slotCount() < 2 || 0 == _prefetchFrames ||
+        ELoadVideoState::LOADED != _loadVideoState || _isPlaying || _performSeek )
+    {
+        return;
+    }
+
+    // Prefetch should never evict frames it has just prefetched.
+    const unsigned capacity = _frameCache.capacity( videoFrame->size() );
+    if( 0 == capacity )
+        return;
+    const unsigned radius = std::min( _prefetchFrames, ( capacity - 1 ) / 2 );
+
+    const unsigned current = indexedFrame();
+    const unsigned first = current > radius ? current - radius : 0;
+    const unsigned last = std::min( current + radius, _mediaIndex->frameCount() - 1 );
+
+    unsigned target = InvalidFrame;
+    for( unsigned frame = first; frame <= last; ++frame ) {
+        if( !_frameCache.contains( _mediaIndex->frameTime( frame ) ) ) {
+            target = frame;
+            break;
+        }
+    }
+
+    // Stepping forward from decoder frame is the cheapest way to get following frames.
+    unsigned stepTarget = InvalidFrame;
+    if( InvalidFrame != _decoderFrame && _decoderFrame < last ) {
+        for( unsigned frame = std::max( _decoderFrame + 1, first ); frame <= last; ++frame ) {
+            if( !_frameCache.contains( _mediaIndex->frameTime( frame ) ) ) {
+                stepTarget = frame;
+                break;
+            }
+        }
+    }
+
+    if( InvalidFrame == target )
+        return;
+
+    _prefetchSequence = _currentFrameInfo.sequence;
+    _decoderMoved = true;
+
+    const unsigned steps =
+        InvalidFrame != stepTarget ? _mediaIndex->stepsTo( _decoderFrame, stepTarget ) : 0;
+    if( steps > 0 && steps <= MaxFrameSteps ) {
+        _prefetchState = EPrefetchState::STEPPING;
+        _prefetchFrame = _decoderFrame + 1;
+        libvlc_media_player_next_frame( player().basic_player().get_mp() );
+    } else {
+        _prefetchState = EPrefetchState::SEEKING;
+        _prefetchFrame = target;
+        _decoderFrame = InvalidFrame;
+        player().playback().set_time( _mediaIndex->frameTime( target ) / 1000 );
+    }
 }
 
-double JsVlcPlayer::fps()
+void JsVlcPlayer::handlePrefetchedFrame( const FrameInfo& frameInfo, libvlc_time_t playbackTime )
 {
-    if ( _withFps > 0.0f )
-        return static_cast<double>( _withFps );
+    if( frameInfo.sequence <= _prefetchSequence )
+        return;
 
-    return static_cast<double>( player().playback().get_fps() );
+    // Decoder could still show frames from before the seek.
+    if( EPrefetchState::SEEKING == _prefetchState &&
+        playbackTime != _mediaIndex->frameTime( _prefetchFrame ) / 1000 )
+    {
+        return;
+    }
+
+    _prefetchState = EPrefetchState::IDLE;
+    _decoderFrame = _prefetchFrame;
+    cacheCurrentFrame( _prefetchFrame );
 }
 
-double JsVlcPlayer::frames()
+void JsVlcPlayer::cancelPrefetch()
 {
-    return std::ceil( length() * fps() / 1000.0 ) + 1;
+    // Outstanding request still moves decoder somewhere.
+    if( EPrefetchState::IDLE != _prefetchState ) {
+        _prefetchState = EPrefetchState::IDLE;
+        _decoderFrame = InvalidFrame;
+    }
 }
 
-unsigned JsVlcPlayer::state()
+void JsVlcPlayer::resyncDecoder()
 {
-    return player().get_state();
+    cancelPrefetch();
+    _decoderFrame = InvalidFrame;
+
+    // Cache hits and prefetch leave decoder away from the current frame.
+    if( _decoderMoved ) {
+        _decoderMoved = false;
+        player().playback().set_time( _currentTime );
+    }
 }
 
-v8::Local<v8::Value> JsVlcPlayer::getVideoFrame()
+void JsVlcPlayer::startReverse()
 {
-    return v8::Local<v8::Value>::New( v8::Isolate::GetCurrent(), _jsFrameBuffer );
+    uv_timer_stop( _reverseTimer );
+
+    const VideoFrame* videoFrame = VlcVideoOutput::currentVideoFrame();
+    if( !videoFrame ) {
+        _reverse.stop();
+        return;
+    }
+
+    const double mediaFps = fps();
+    _reverse.start( _mediaIndex, mediaFps > 0 ? 1000.0 / mediaFps : 0,
+                    _currentTime, videoFrame->size() );
+
+    decodeReverseSegment();
+
+    // Ticks twice per frame, so frames are not late by whole tick because of timer jitter.
+    const uint64_t interval =
+        static_cast<uint64_t>( std::max( 1.0, _reverse.frameDuration() / 2 ) );
+    uv_timer_start( _reverseTimer,
+        [] ( uv_timer_t* handle ) {
+            if( handle->data )
+                static_cast<JsVlcPlayer*>( handle->data )->presentReverseFrame();
+        }, interval, interval );
 }
 
-v8::Local<v8::Object> JsVlcPlayer::getEventEmitter()
+void JsVlcPlayer::stopReverse()
 {
-    return v8::Local<v8::Object>::New( v8::Isolate::GetCurrent(), _jsEventEmitter );
+    uv_timer_stop( _reverseTimer );
+    _reverse.stop();
 }
 
-unsigned JsVlcPlayer::pixelFormat()
+void JsVlcPlayer::decodeReverseSegment()
 {
-    return static_cast<unsigned>( VlcVideoOutput::pixelFormat() );
+    libvlc_time_t seekTime;
+    if( !_reverse.beginSegment( &seekTime ) )
+        return;
+
+    _reverseSeekTime = seekTime;
+    _reverseSequence = _currentFrameInfo.sequence;
+    _reverseStepping = false;
+    _decoderFrame = InvalidFrame;
+    _decoderMoved = true;
+
+    player().playback().set_time( seekTime );
 }
 
-void JsVlcPlayer::setPixelFormat( unsigned format )
+void JsVlcPlayer::handleReverseFrame( const FrameInfo& frameInfo, libvlc_time_t playbackTime )
 {
-    switch( format ) {
-        case static_cast<unsigned>( PixelFormat::RV32 ):
-            VlcVideoOutput::setPixelFormat( PixelFormat::RV32 );
-            break;
-        case static_cast<unsigned>( PixelFormat::I420 ):
-            VlcVideoOutput::setPixelFormat( PixelFormat::I420 );
-            break;
+    if( !_reverse.decoding() || frameInfo.sequence <= _reverseSequence )
+        return;
+
+    // Decoder could still show frames from before the seek.
+    if( !_reverseStepping && playbackTime != _reverseSeekTime )
+        return;
+
+    const VideoFrame* videoFrame = VlcVideoOutput::currentVideoFrame();
+    if( !videoFrame || currentFrameSlot() >= _frameBufferData.size() )
+        return;
+
+    _reverseSequence = frameInfo.sequence;
+    if( _reverse.addFrame( _frameBufferData[currentFrameSlot()], videoFrame->size() ) ) {
+        _reverseStepping = true;
+        libvlc_media_player_next_frame( player().basic_player().get_mp() );
     }
 }
 
-double JsVlcPlayer::position()
+void JsVlcPlayer::presentReverseFrame()
 {
-    assert( _currentTime >= 0 && _currentTime <= length() );
+    if( !_reversePlayback )
+        return;
 
-    return static_cast<double>( _currentTime ) / length();
+    const ReversePlayback::Frame* frame =
+        _reverse.present( ReversePlayback::Clock::now(), rateReverse() );
+    if( frame )
+        deliverFrameCopy( frame->buffer, frame->time );
+
+    if( _reverse.finished() ) {
+        stopReverse();
+        _isPlaying = false;
+        _reversePlayback = false;
+
+        callCallback( CB_MediaPlayerBeginReached );
+        return;
+    }
+
+    // Presented segment could be just swapped with decoded one.
+    decodeReverseSegment();
 }
 
-void JsVlcPlayer::setPosition( double position )
+bool JsVlcPlayer::isTrickPlayRate( double rate )
 {
-    position = std::max( 0.0, std::min( position, 1.0 ) );
+    const double threshold = trickPlayRate();
+    return threshold > 0 && rate >= threshold;
+}
 
-    _performSeek = true;
-    setCurrentTime( static_cast<libvlc_time_t>( position * length() ) );
-    player().playback().set_position( static_cast<float>( position ) );
+void JsVlcPlayer::startTrickPlay()
+{
+    using namespace std::chrono;
+
+    stopLoopReplay();
+
+    _trickPlay = true;
+    _trickPlayClock = static_cast<double>( _currentTime );
+    _trickPlayTime = _currentTime;
+    _trickPlayTick = steady_clock::now();
+    _trickPlaySeekStart = steady_clock::time_point();
+
+    player().pause();
+
+    uv_timer_start( _trickPlayTimer,
+        [] ( uv_timer_t* handle ) {
+            if( handle->data )
+                static_cast<JsVlcPlayer*>( handle->data )->advanceTrickPlay();
+        }, TrickPlayInterval, TrickPlayInterval );
 }
 
-double JsVlcPlayer::time()
+void JsVlcPlayer::stopTrickPlay()
 {
-    assert( _currentTime >= 0.0 && _currentTime <= length() );
+    uv_timer_stop( _trickPlayTimer );
+    _trickPlay = false;
+}
 
-    return static_cast<double>( _currentTime );
+void JsVlcPlayer::advanceTrickPlay()
+{
+    using namespace std::chrono;
+
+    if( !_trickPlay )
+        return;
+
+    const steady_clock::time_point now = steady_clock::now();
+    const double elapsed = duration<double, std::milli>( now - _trickPlayTick ).count();
+    _trickPlayTick = now;
+
+    // Media clock follows seeks done meanwhile by user.
+    if( _currentTime != _trickPlayTime && !_performSeek )
+        _trickPlayClock = static_cast<double>( _currentTime );
+    _trickPlayClock += elapsed * _rate;
+
+    // Normal playback gets the end and reports it as usual.
+    const double mediaLength = length();
+    if( mediaLength > 0 && _trickPlayClock >= mediaLength ) {
+        stopTrickPlay();
+        setCurrentTime( static_cast<libvlc_time_t>( mediaLength ) );
+        _decoderMoved = true;
+        resyncDecoder();
+        player().play();
+        return;
+    }
+
+    // Decoder is the limit, so frames of clock times passed meanwhile are skipped.
+    if( _performSeek && now - _trickPlaySeekStart < milliseconds( MaxScrubSeekWait ) )
+        return;
+
+    // Keyframe is shown without decoding of any other frame,
+    // without index the seek decodes from the keyframe up to the clock time.
+    libvlc_time_t time = static_cast<libvlc_time_t>( _trickPlayClock );
+    if( _mediaIndex ) {
+        const unsigned frame = _mediaIndex->frameAt( ( time + 1 ) * 1000 - 1 );
+        time = _mediaIndex->frameTime( _mediaIndex->keyframeBefore( frame ) ) / 1000;
+    }
+    if( time <= _currentTime )
+        return;
+
+    _trickPlaySeekStart = now;
+    seekTo( time );
+    _trickPlayTime = _currentTime;
 }
 
-void JsVlcPlayer::setTime( double time )
+bool JsVlcPlayer::handleLoopFrame( libvlc_time_t playbackTime, unsigned droppedFrames )
 {
-    _performSeek = true;
-    setCurrentTime( static_cast<libvlc_time_t>( time ) );
-    player().playback().set_time( _currentTime );
+    // Frames shown before the wrap seek are not looped again.
+    if( _loopWrapped ) {
+        if( playbackTime >= _loopClip.out() )
+            return true;
+        _loopWrapped = false;
+    }
+
+    if( _currentTime < _loopClip.out() ) {
+        const VideoFrame* videoFrame = VlcVideoOutput::currentVideoFrame();
+        if( _loopCache && videoFrame && currentFrameSlot() < _frameBufferData.size() ) {
+            _loopClip.capture( _currentTime, _frameBufferData[currentFrameSlot()],
+                               videoFrame->size(), droppedFrames > 0 );
+        }
+        return false;
+    }
+
+    // The first frame of clip follows its last one right away, if it's in memory.
+    if( _loopCache && _loopClip.finish() ) {
+        startLoopReplay( _loopClip.in() );
+        return true;
+    }
+
+    _loopWrapped = true;
+    seekTo( _loopClip.in() );
+
+    return true;
 }
 
-double JsVlcPlayer::frame()
+void JsVlcPlayer::startLoopReplay( libvlc_time_t time )
 {
-    const double iFrame = std::round( decimalFrame() );
+    player().pause();
 
-    return std::min( iFrame, frames() );
+    _loopReplay = true;
+    _decoderFrame = InvalidFrame;
+    _decoderMoved = true;
+
+    _loopClip.startReplay( time, LoopClip::Clock::now() );
+    presentLoopFrame();
+
+    // Ticks twice per frame, so frames are not late by whole tick because of timer jitter.
+    const uint64_t interval =
+        static_cast<uint64_t>( std::max( 1.0, _loopClip.frameDuration() / 2 ) );
+    uv_timer_start( _loopTimer,
+        [] ( uv_timer_t* handle ) {
+            if( handle->data )
+                static_cast<JsVlcPlayer*>( handle->data )->presentLoopFrame();
+        }, interval, interval );
 }
 
-void JsVlcPlayer::setFrame( double frame )
+void JsVlcPlayer::stopLoopReplay()
 {
-    frame = std::max( 0.0, std::min( frame, frames() ) );
+    uv_timer_stop( _loopTimer );
+    _loopReplay = false;
+}
+
+void JsVlcPlayer::presentLoopFrame()
+{
+    if( !_loopReplay )
+        return;
+
+    const LoopClip::Frame* frame = _loopClip.present( LoopClip::Clock::now(), _rate );
+    if( frame )
+        deliverFrameCopy( frame->buffer, frame->time );
+}
+
+void JsVlcPlayer::setLoop( double in, double out, bool cache, unsigned cacheSize )
+{
+    clearLoop();
+
+    in = std::max( 0.0, in );
+    if( out <= in )
+        return;
+
+    const double mediaFps = fps();
+    _loopClip.reset( _mediaIndex, mediaFps > 0 ? 1000.0 / mediaFps : 0,
+                     static_cast<libvlc_time_t>( in ), static_cast<libvlc_time_t>( out ),
+                     static_cast<size_t>( cacheSize ) * 1024 * 1024 );
+    _loop = true;
+    _loopCache = cache;
+}
+
+void JsVlcPlayer::clearLoop()
+{
+    if( _loopReplay ) {
+        stopLoopReplay();
+        if( _isPlaying ) {
+            resyncDecoder();
+            player().play();
+        }
+    }
+
+    _loop = false;
+    _loopWrapped = false;
+    _loopClip.reset( nullptr, 0, 0, 0, 0 );
+}
+
+bool JsVlcPlayer::loopCached()
+{
+    return _loopClip.complete();
+}
+
+void JsVlcPlayer::addCuePoint( const std::string& id, double position, bool inFrames )
+{
+    _cuePoints.add( id, position, inFrames );
+}
+
+bool JsVlcPlayer::removeCuePoint( const std::string& id )
+{
+    return _cuePoints.remove( id );
+}
+
+void JsVlcPlayer::seekToFrame( double frame, v8::Local<v8::Promise::Resolver> resolver )
+{
+    // Only the latest seek could be satisfied.
+    settleFrameSeek( "Seek superseded by another seek" );
+
+    _jsSeekResolver.Reset( v8::Isolate::GetCurrent(), resolver );
+
+    if( ELoadVideoState::LOADED != _loadVideoState ) {
+        settleFrameSeek( "Media is not loaded" );
+        return;
+    }
 
-    setTime( std::min( frame * 1000.0 / fps(), length() ) );
+    if( _isPlaying )
+        pause();
+
+    setFrame( frame );
+    _seekTime = _currentTime;
+
+    // Cached frame is delivered right away.
+    if( !_performSeek )
+        settleFrameSeek();
 }
 
 void JsVlcPlayer::previousFrame()
 {
     pause();
 
+    if( _mediaIndex ) {
+        const unsigned frame = indexedFrame();
+        if( frame > 0 )
+            setFrame( frame - 1 );
+        return;
+    }
+
     const double iFrame = decimalFrame();
     if( iFrame > 0.0 )
         setFrame( std::ceil( iFrame ) - 1 );
@@ -1079,12 +3074,19 @@ void JsVlcPlayer::nextFrame()
 {
     pause();
 
+    if( _mediaIndex ) {
+        const unsigned frame = indexedFrame();
+        if( frame + 1 < _mediaIndex->frameCount() )
+            setFrame( frame + 1 );
+        return;
+    }
+
     const double frames = length() / ( 1000.0 / fps() );
     const double iFrame = decimalFrame();
     if( iFrame < frames - 1.0 )
         setFrame( std::floor( iFrame ) + 1 );
     else
-        setTime( length() );
+        seekTo( static_cast<libvlc_time_t>( length() ) );
 }
 
 unsigned JsVlcPlayer::volume()
@@ -1109,26 +3111,35 @@ void JsVlcPlayer::setMuted( bool mute )
 
 void JsVlcPlayer::load( const std::string& mrl, bool startPlaying, bool startPlayingReverse, unsigned atTime, double withFps )
 {
+    _loadStart = std::chrono::steady_clock::now();
+    _timeToFirstFrame = -1;
+
     stop();
     setCurrentTime( static_cast<libvlc_time_t>( atTime ) );
 
-    _loadingTime = 0;
     _isPlaying = false;
     _reversePlayback = false;
+    stopReverse();
+    stopTrickPlay();
 
-    using namespace std::chrono;
+    // Cue points belong to the loaded media.
+    _cuePoints.clear();
 
-    const libvlc_time_t playbackTime = player().playback().get_time();
-    _lastPlaybackTimeFrameReady = playbackTime;
+    VlcVideoOutput::resetDroppedFrames();
+    _undeliveredDroppedFrames = 0;
 
-    const milliseconds msSinceEpoch = duration_cast<milliseconds>( system_clock::now().time_since_epoch() );
-    const libvlc_time_t nowTime = static_cast<libvlc_time_t>( msSinceEpoch.count() );
-    _lastGlobalTimeFrameReady = nowTime;
+    // Demux starts right at the requested time, instead of seeking after the first frame.
+    char startTime[32];
+    snprintf( startTime, sizeof( startTime ), ":start-time=%u.%03u", atTime / 1000, atTime % 1000 );
+    // Input pauses itself right on the first frame, so decoder never runs past it.
+    // Reverse playback keeps decoder paused as well.
+    const char* options[] = { startTime, ":start-paused" };
+    const unsigned optionsCount = startPlaying && !startPlayingReverse ? 1 : 2;
 
     vlc::player& p = player();
 
     p.clear_items();
-    const int idx = p.add_media( mrl.c_str() );
+    const int idx = p.add_media( mrl.c_str(), 0, nullptr, optionsCount, options );
     if( idx >= 0 ) {
         _startPlaying = startPlaying;
         _startPlayingReverse = startPlayingReverse;
@@ -1137,76 +3148,157 @@ void JsVlcPlayer::load( const std::string& mrl, bool startPlaying, bool startPla
         _loadVideoState = ELoadVideoState::GETTING;
 
         p.play( idx );
-        p.playback().set_time( _currentTime );
-        p.pause();
+
+        // MediaChanged event of this item finds everything set up already.
+        _mediaMrl = p.get_media( static_cast<unsigned>( idx ) ).mrl();
+        startIndexing( mrl );
     }
 }
 
+void JsVlcPlayer::preload( const std::string& mrl )
+{
+    // Only the latest preloaded media is worth indexing.
+    cancelIndexJob( &_preloadJob );
+
+    std::string path;
+    if( !MediaIndex::mrlToPath( mrl, &path ) )
+        return;
+
+    _preloadJob = startIndexJob( path, _mediaGeneration, nullptr );
+}
+
+double JsVlcPlayer::timeToFirstFrame()
+{
+    return _timeToFirstFrame;
+}
+
+std::shared_ptr<JsVlcPlayer::IndexJob> JsVlcPlayer::startIndexJob( const std::string& path,
+                                                                   unsigned generation, uv_async_t* async )
+{
+    std::shared_ptr<IndexJob> job = std::make_shared<IndexJob>( generation, async );
+
+    // Parsing of large moov could take a while, so nobody waits for the thread,
+    // it's cancelled instead and finishes on its own.
+    std::thread(
+        [ job, path ] ()
+        {
+            std::shared_ptr<MediaIndex> index =
+                MediaIndex::open( path, MediaIndex::defaultCacheDir(), &job->cancelled );
+
+            std::lock_guard<std::mutex> lock( job->guard );
+            if( !index || !job->async )
+                return;
+
+            // Result is never lost, unlike events which don't fit the ring.
+            job->result = std::move( index );
+            uv_async_send( job->async );
+        }
+    ).detach();
+
+    return job;
+}
+
+void JsVlcPlayer::cancelIndexJob( std::shared_ptr<IndexJob>* job )
+{
+    if( !*job )
+        return;
+
+    ( *job )->cancelled = true;
+
+    ( *job )->guard.lock();
+    ( *job )->async = nullptr;
+    ( *job )->guard.unlock();
+
+    job->reset();
+}
+
+void JsVlcPlayer::startIndexing( const std::string& mrl )
+{
+    cancelIndexJob( &_indexJob );
+
+    std::string path;
+    if( !MediaIndex::mrlToPath( mrl, &path ) )
+        return;
+
+    _indexJob = startIndexJob( path, _mediaGeneration, _async );
+}
+
+unsigned JsVlcPlayer::indexedFrame()
+{
+    // The last frame presented at or before current millisecond.
+    return _mediaIndex->frameAt( ( _currentTime + 1 ) * 1000 - 1 );
+}
+
 void JsVlcPlayer::play()
 {
+    stopReverse();
+    resyncDecoder();
+
     _isPlaying = true;
     _reversePlayback = false;
 
+    if( isTrickPlayRate( _rate ) ) {
+        if( !_trickPlay )
+            startTrickPlay();
+        return;
+    }
+
+    if( _loop && _loopClip.complete() &&
+        _currentTime >= _loopClip.in() && _currentTime < _loopClip.out() )
+    {
+        if( !_loopReplay )
+            startLoopReplay( _currentTime );
+        return;
+    }
+
     player().play();
 }
 
 void JsVlcPlayer::playReverse()
 {
-    // Avoid creating more than one thread to do the same.
     if( _reversePlayback )
         return;
 
+    cancelPrefetch();
+    _decoderFrame = InvalidFrame;
+    stopTrickPlay();
+    stopLoopReplay();
+
+    if( _performSeek ) {
+        _performSeek = false;
+        settleFrameSeek( "Seek interrupted by playback" );
+    }
+
     _isPlaying = true;
     _reversePlayback = true;
 
     player().pause();
 
-    std::thread reverseUpdateThread(
-        [ this ]()
-        {
-            using namespace std::chrono;
-
-            libvlc_time_t lastTime = 0;
-            libvlc_time_t currentTime = 0;
-            vlc::playback& playback = player().playback();
-            const double msPerFrame = 1000.0 / fps();
-
-            while( _isPlaying && _reversePlayback ) {
-                libvlc_time_t msToGoBack;
-
-                lastTime = currentTime;
-                const milliseconds msSinceEpoch = duration_cast<milliseconds>( system_clock::now().time_since_epoch() );
-                currentTime = static_cast<libvlc_time_t>( msSinceEpoch.count() );
-
-                if( 0 == lastTime )
-                    msToGoBack = static_cast<libvlc_time_t>( msPerFrame * rateReverse() );
-                else
-                    msToGoBack = static_cast<libvlc_time_t>( static_cast<double>( currentTime - lastTime ) * rateReverse() );
-
-                const libvlc_time_t playbackTime = playback.get_time();
-                if( playbackTime > 0 ) {
-                    setTime( std::max( 0.0, static_cast<double>( _currentTime - msToGoBack ) ) );
-                    std::this_thread::sleep_for( std::chrono::milliseconds( static_cast<libvlc_time_t>( msPerFrame / rateReverse()) ) );
-                }
-                else {
-                    break;
-                }
-            }
-        }
-    );
-    reverseUpdateThread.detach();
+    startReverse();
 }
 
 void JsVlcPlayer::pause()
 {
     _isPlaying = false;
     _reversePlayback = false;
+    stopReverse();
+    stopTrickPlay();
+    stopLoopReplay();
 
     player().pause();
 }
 
 void JsVlcPlayer::togglePause()
 {
+    // Decoder is paused while playing reverse, trick play or replaying loop.
+    if( _reversePlayback || _trickPlay || _loopReplay ) {
+        pause();
+        return;
+    }
+
+    if( !_isPlaying )
+        resyncDecoder();
+
     _isPlaying = !_isPlaying;
     _reversePlayback = false;
 
@@ -1216,10 +3308,34 @@ void JsVlcPlayer::togglePause()
 void JsVlcPlayer::stop()
 {
     _loadVideoState = ELoadVideoState::UNLOADED;
-    _loadingTime = 0;
     _startPlaying = false;
     _isPlaying = false;
     _reversePlayback = false;
+    _performSeek = false;
+
+    _scrubPending = false;
+    _scrubApproximate = false;
+
+    stopReverse();
+    stopTrickPlay();
+    clearLoop();
+    resetPreroll();
+    _cueTime = InvalidTime;
+    settleFrameSeek( "Playback stopped" );
+
+    cancelPrefetch();
+    _frameCache.clear();
+    _decoderFrame = InvalidFrame;
+    _decoderMoved = false;
+
+    _mediaMrl.clear();
+    cancelIndexJob( &_indexJob );
+    _mediaIndex.reset();
+    VlcVideoOutput::setFrameIndex( nullptr );
+    ++_mediaGeneration;
+
+    //decoder could wait for leased frames
+    VlcVideoOutput::releaseAllFrames();
 
     player().stop();
     setCurrentTime( 0 );
@@ -3,6 +3,10 @@
 #include <memory>
 #include <deque>
 #include <set>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 #include <v8.h>
 #include <node.h>
@@ -13,6 +17,16 @@
 #include <libvlc_wrapper/vlc_vmem.h>
 
 #include "VlcVideoOutput.h"
+#include "MediaIndex.h"
+#include "DecodedFrameCache.h"
+#include "ReversePlayback.h"
+#include "LoopClip.h"
+#include "PrerollOutput.h"
+#include "CuePoints.h"
+#include "SeekMatcher.h"
+#include "MpmcRing.h"
+#include "LogArena.h"
+#include "UvHandle.h"
 
 class JsVlcInput;
 class JsVlcAudio;
@@ -29,6 +43,7 @@ class JsVlcPlayer :
         CB_FrameSetup = 0,
         CB_FrameReady,
         CB_FrameCleanup,
+        CB_CuePoint,
 
         CB_MediaPlayerMediaChanged,
         CB_MediaPlayerNothingSpecial,
@@ -51,15 +66,39 @@ class JsVlcPlayer :
 
         CB_LogMessage,
 
+        CB_EventBatch,
+
         CB_Max,
     };
 
     static const char* callbackNames[CB_Max];
 
+    // Fields filled by snapshot(), in this order.
+    enum SnapshotFields_e {
+        SF_Time = 0,
+        SF_Frame,
+        SF_Position,
+        SF_Length,
+        SF_State,
+        SF_Playing,
+        SF_Rate,
+        SF_Fps,
+        SF_Frames,
+
+        SF_Max,
+    };
+
+    static const char* snapshotFieldNames[SF_Max];
+
 public:
     static void initJsApi( const v8::Handle<v8::Object>& exports );
 
     static void jsLoad( const v8::FunctionCallbackInfo<v8::Value>& args );
+    static void jsSetOutputSize( const v8::FunctionCallbackInfo<v8::Value>& args );
+    static void jsSeekToFrame( const v8::FunctionCallbackInfo<v8::Value>& args );
+    static void jsSetLoop( const v8::FunctionCallbackInfo<v8::Value>& args );
+    static void jsAddCuePoint( const v8::FunctionCallbackInfo<v8::Value>& args );
+    static void jsSnapshot( const v8::FunctionCallbackInfo<v8::Value>& args );
 
     static void getJsCallback( v8::Local<v8::String> property,
                                const v8::PropertyCallbackInfo<v8::Value>& info,
@@ -68,12 +107,16 @@ public:
                                v8::Local<v8::Value> value,
                                const v8::PropertyCallbackInfo<void>& info,
                                Callbacks_e callback );
+    static void jsEmitterListenersMethod( const v8::FunctionCallbackInfo<v8::Value>& args );
 
     bool playing();
     bool playingReverse();
+    double reverseFps();
+    bool trickPlaying();
     double length();
     double fps();
     double frames();
+    bool indexed();
     unsigned state();
 
     v8::Local<v8::Value> getVideoFrame();
@@ -82,18 +125,84 @@ public:
     unsigned pixelFormat();
     void setPixelFormat( unsigned );
 
+    unsigned frameBufferCount();
+    void setFrameBufferCount( unsigned );
+
+    unsigned frameBufferPolicy();
+    void setFrameBufferPolicy( unsigned );
+
+    unsigned rowAlignment();
+    void setRowAlignment( unsigned );
+
+    double droppedFrames();
+
+    unsigned frameCacheSize();
+    void setFrameCacheSize( unsigned );
+    unsigned prefetchFrames();
+    void setPrefetchFrames( unsigned );
+    double frameCacheHits();
+    double frameCacheMisses();
+
+    bool rgbaConversion();
+    void setRGBAConversion( bool );
+
+    unsigned colorMatrix();
+    void setColorMatrix( unsigned );
+
+    unsigned colorRange();
+    void setColorRange( unsigned );
+
+    std::string conversionKernel();
+
+    void releaseJsFrame( v8::Local<v8::Value> );
+
+    // Decoder always outputs source size and every frame is scaled in software to fit,
+    // so the cost is paid per frame, but changing the size never interrupts playback.
+    void setOutputSize( unsigned width, unsigned height, bool keepAspect );
+    void setCropRegion( unsigned x, unsigned y, unsigned width, unsigned height );
+
     double position();
     void setPosition( double );
 
     double time();
     void setTime( double );
 
+    double rate();
+    void setRate( double );
+
+    bool scrubbing();
+    void setScrubbing( bool );
+    bool keyframeScrubbing();
+    void setKeyframeScrubbing( bool );
+
     double frame();
     void setFrame( double );
+    void seekToFrame( double frame, v8::Local<v8::Promise::Resolver> );
 
     void previousFrame();
     void nextFrame();
 
+    void setLoop( double in, double out, bool cache, unsigned cacheSize );
+    void clearLoop();
+    bool loopCached();
+
+    void addCuePoint( const std::string& id, double position, bool inFrames );
+    bool removeCuePoint( const std::string& id );
+
+    // Hot playback state for render loop in one call, all fields are from the same instant.
+    void snapshot( double ( &fields )[SF_Max] );
+
+    bool batchEvents();
+    void setBatchEvents( bool );
+
+    unsigned eventThrottleMs();
+    void setEventThrottleMs( unsigned );
+
+    double prerollTime();
+    void setPrerollTime( double );
+    double prerollHits();
+    double prerollMisses();
+
     unsigned volume();
     void setVolume( unsigned );
 
@@ -101,6 +210,10 @@ public:
     void setMuted( bool );
 
     void load( const std::string& mrl, bool startPlaying, bool startPlayingReverse, unsigned atTime, double withFps );
+    // Builds frame index sidecar of local MP4 file ahead of load(), so load() only maps it.
+    // Media itself is not opened or parsed, so other sources don't get anything from it.
+    void preload( const std::string& mrl );
+    double timeToFirstFrame();
     void play();
     void playReverse();
     void pause();
@@ -130,15 +243,68 @@ private:
     JsVlcPlayer( v8::Local<v8::Object>& thisObject, const v8::Local<v8::Array>& vlcOpts );
     ~JsVlcPlayer();
 
-    struct AsyncData;
-    struct CallbackData;
-    struct LibvlcEvent;
-    struct LibvlcLogEvent;
+    // Compact record of libvlc event or log message,
+    // queued from libvlc threads without allocations.
+    struct PlayerEvent
+    {
+        enum Type
+        {
+            Libvlc,
+            LogMessage,
+        };
+
+        struct LibvlcData
+        {
+            int eventType;
+            // The only value libvlc events handled here carry.
+            union
+            {
+                float floatValue;
+                int intValue;
+                libvlc_time_t timeValue;
+            };
+        };
+
+        struct LogData
+        {
+            int level;
+            // Slot of _logArena, released when message is handled.
+            unsigned slot;
+        };
+
+        Type type;
+        union
+        {
+            LibvlcData libvlc;
+            LogData log;
+        };
+    };
+
+    // State shared with detached indexing thread, which could outlive the player.
+    struct IndexJob
+    {
+        IndexJob( unsigned generation, uv_async_t* async ) :
+            generation( generation ), cancelled( false ), async( async ) {}
+
+        // Media generation the index is built for.
+        const unsigned generation;
+        // Checked by MediaIndex between parsing steps.
+        std::atomic<bool> cancelled;
+
+        std::mutex guard;
+        // Woken up when result is ready, null if job is cancelled or nobody waits for result.
+        uv_async_t* async;
+        std::shared_ptr<MediaIndex> result;
+    };
 
     static void closeAll();
     void initLibvlc( const v8::Local<v8::Array>& vlcOpts );
 
+    bool pushEvent( const PlayerEvent&, bool mustDeliver );
     void handleAsync();
+    void handleEvent( const PlayerEvent& );
+    void handleLogMessage( const PlayerEvent& );
+    void handleMediaIndexReady();
 
     //could come from worker thread
     void media_player_event( const libvlc_event_t* );
@@ -146,27 +312,91 @@ private:
     static void log_event_wrapper( void *, int, const libvlc_log_t *, const char *, va_list );
     void log_event( int, const libvlc_log_t *, const char *, va_list );
 
-    void handleLibvlcEvent( const libvlc_event_t& );
+    static Callbacks_e libvlcEventCallback( int eventType );
+    // Value passed to callback of libvlc event, if any.
+    enum LibvlcValueType { NoValue, NumberValue, BooleanValue };
+    bool callbackWanted( Callbacks_e callback ) const
+        { return 0 != ( _wantedCallbacks.load( std::memory_order_relaxed ) & ( 1u << callback ) ); }
+    void countEmitterListeners();
+    void updateWantedCallbacks();
+
+    void deliverLibvlcCallback( Callbacks_e callback, LibvlcValueType valueType, double value );
+    bool throttleEvent( Callbacks_e callback, double value );
+    void flushThrottledEvents();
+
+    void handleLibvlcEvent( const PlayerEvent& );
 
     void currentItemEndReached();
+    void currentMediaChanged();
+
+    int nextItem();
+    void prerollNextItem( libvlc_time_t time );
+    void presentPrerolledItem();
+    void resetPreroll();
 
     void callCallback( Callbacks_e callback,
                        std::initializer_list<v8::Local<v8::Value> > list = std::initializer_list<v8::Local<v8::Value> >() );
+    void flushEventBatch();
 
     void doCallCallback();
-
-    void updateCurrentTime();
+    // Cues are evaluated only for frames of current media.
+    void callFrameReadyCallback( bool checkCues = true );
+    void settleFrameSeek( const char* error = nullptr );
+    // Paused seek waits for its frame, steps > 0 means decoder steps that many frames instead.
+    void startSeek( unsigned steps );
+    void finishSeek();
+    void handleSeekTimeout();
+    void checkCuePoints();
+
+    void updateCurrentTime( libvlc_time_t frameTime );
     void setCurrentTime( libvlc_time_t time );
 
     double rateReverse();
     void setRateReverse( double rateReverse );
+    double trickPlayRate();
 
     double decimalFrame();
 
+    void reshapeVideoOutput();
+
+    void seekTo( libvlc_time_t time );
+    void seekToScrubTime();
+
+    static std::shared_ptr<IndexJob> startIndexJob( const std::string& path,
+                                                    unsigned generation, uv_async_t* async );
+    static void cancelIndexJob( std::shared_ptr<IndexJob>* );
+    void startIndexing( const std::string& mrl );
+    unsigned indexedFrame();
+
+    bool deliverFrameCopy( const FrameBufferPool::Buffer&, libvlc_time_t time, bool checkCues = true );
+    bool deliverCachedFrame( unsigned frame );
+    void cacheCurrentFrame( unsigned frame );
+    void prefetchNext();
+    void handlePrefetchedFrame( const FrameInfo&, libvlc_time_t playbackTime );
+    void cancelPrefetch();
+    void resyncDecoder();
+
+    void startReverse();
+    void stopReverse();
+    void decodeReverseSegment();
+    void handleReverseFrame( const FrameInfo&, libvlc_time_t playbackTime );
+    void presentReverseFrame();
+
+    bool isTrickPlayRate( double rate );
+    void startTrickPlay();
+    void stopTrickPlay();
+    void advanceTrickPlay();
+
+    bool handleLoopFrame( libvlc_time_t playbackTime, unsigned droppedFrames );
+    void startLoopReplay( libvlc_time_t time );
+    void stopLoopReplay();
+    void presentLoopFrame();
+
+    v8::Local<v8::Uint8Array> createFrameBuffer( const VideoFrame&, unsigned slot );
+
 protected:
-    void* onFrameSetup( const RV32VideoFrame& ) override;
-    void* onFrameSetup( const I420VideoFrame& ) override;
-    void onFrameReady() override;
+    std::vector<void*> onFrameSetup( const VideoFrame& ) override;
+    void onFrameReady( const FrameInfo&, unsigned droppedFrames ) override;
     void onFrameCleanup() override;
 
 private:
@@ -177,24 +407,97 @@ private:
         GETTING
     };
 
+    enum class EPrefetchState
+    {
+        IDLE,
+        SEEKING,
+        STEPPING
+    };
+
     static v8::Persistent<v8::Function> _jsConstructor;
     static std::set<JsVlcPlayer*> _instances;
+    static unsigned _lastInstanceId;
+    // Identifies instance for event emitter listeners, which could outlive it.
+    const unsigned _instanceId;
 
-    // Sanity checks are used because LibVLC sometimes sends a previous frame, not the right one that we want.
-    static const unsigned MaxSanityChecks = 5;
     static const libvlc_time_t InvalidTime = ~0;
+    // Backing store is not reused for frame smaller than its size divided by this.
+    static const unsigned MaxFrameStoreWaste = 4;
+    // Paused player steps forward frame by frame instead of seeking up to this distance.
+    static const unsigned MaxFrameSteps = 32;
+    static const unsigned InvalidFrame = ~0u;
+    static const unsigned DefaultPrefetchFrames = 8;
+    // Scrub seek which hasn't shown its frame for this long (ms) is not waited for anymore.
+    static const unsigned MaxScrubSeekWait = 500;
+    // Paused seek which hasn't shown its frame for this long (ms) is given up,
+    // e.g. seek past the last frame never shows any.
+    static const unsigned MaxSeekWait = 3000;
+    // Trick play clock granularity (ms).
+    static const unsigned TrickPlayInterval = 20;
+    // Default memory budget of looped clip (MB).
+    static const unsigned DefaultLoopCacheSize = 512;
 
     libvlc_instance_t* _libvlc;
     vlc::player _player;
 
-    uv_async_t _async;
-    std::mutex _asyncDataGuard;
-    std::deque<std::unique_ptr<AsyncData> > _asyncData;
+    // Events are usually handled long before the ring is full,
+    // it only takes gui thread stuck for a while.
+    static const unsigned PlayerEventsCapacity = 1024;
+
+    uv_async_t* _async;
+    MpmcRing<PlayerEvent, PlayerEventsCapacity> _events;
+    LogArena _logArena;
+    // Events which must be delivered but didn't fit the ring. Nobody waits for room in the ring,
+    // since gui thread could be waiting for libvlc event thread itself (in player().stop() for example).
+    // While it's not empty, following events go there too to keep their order.
+    std::atomic<bool> _overflow;
+    std::mutex _overflowGuard;
+    std::deque<PlayerEvent> _overflowEvents;
 
     v8::UniquePersistent<v8::Value> _jsFrameBuffer;
+    std::vector<v8::UniquePersistent<v8::Value> > _jsFrameBuffers;
+    // Backing stores of frame buffers, kept between frame setups to avoid large allocations.
+    std::vector<v8::UniquePersistent<v8::ArrayBuffer> > _jsFrameStores;
+    v8::UniquePersistent<v8::Function> _jsUint8Array;
+    // Set when current frame was passed to JS, otherwise its lease is returned right away.
+    bool _frameDelivered;
+    // Frames superseded since the last frame passed to JS.
+    unsigned _undeliveredDroppedFrames;
+    // Display time and sequence number of the frame in current slot.
+    FrameInfo _currentFrameInfo;
+
+    // Callbacks get at most this many arguments.
+    static const unsigned MaxCallbackArgs = 5;
 
     v8::UniquePersistent<v8::Function> _jsCallbacks[CB_Max];
     v8::UniquePersistent<v8::Object> _jsEventEmitter;
+    // Looked up once, instead of for every event.
+    v8::UniquePersistent<v8::Function> _jsEmit;
+    v8::UniquePersistent<v8::Array> _jsCallbackNames;
+
+    // If set, libvlc events handled in one handleAsync() are passed to JS with single
+    // EventBatch callback, as (callback index in names array, value) pairs.
+    bool _batchEvents;
+    std::vector<double> _eventBatch;
+
+    // Listeners added to event emitter, per callback, recounted whenever listeners are changed.
+    unsigned _emitterListeners[CB_Max];
+    // Bit per callback which has JS listener or is handled natively.
+    // Checked on libvlc threads, so events nobody needs are not even queued.
+    std::atomic<uint32_t> _wantedCallbacks;
+
+    // If set, TimeChanged and PositionChanged are passed to JS at most once per this many
+    // milliseconds, with the latest value. The held one goes first on pause, stop or end.
+    unsigned _eventThrottleMs;
+    struct ThrottledEvent
+    {
+        Callbacks_e callback;
+        bool pending;
+        double value;
+        std::chrono::steady_clock::time_point lastDelivered;
+    };
+    ThrottledEvent _throttledEvents[2];
+    uv_timer_t* _throttleTimer;
 
     v8::UniquePersistent<v8::Object> _jsInput;
     v8::UniquePersistent<v8::Object> _jsAudio;
@@ -208,35 +511,122 @@ private:
     JsVlcSubtitles* _cppSubtitles;
     JsVlcPlaylist* _cppPlaylist;
 
-    uv_timer_t _errorTimer;
+    uv_timer_t* _errorTimer;
 
     bool _startPlaying;
     bool _startPlayingReverse;
     bool _isPlaying;
     bool _reversePlayback;
 
-    // Accumulated loading time used to apply it when first frame is ready and video is playing.
-    libvlc_time_t _loadingTime;
-    // Estimated playback time (used to get the frame number) to be as much frame-accurate as possible.
+    // Display time of the latest frame (used to get the frame number) to be as much frame-accurate as possible.
     libvlc_time_t _currentTime;
-    // Flag used to seek a frame accurately when video is not playing, applying some sanity checks.
+    // Flag used to seek a frame accurately when video is not playing. In frame-ready callback we avoid
+    // sending frames when video is paused, except the first one displayed at the seeked time.
     bool _performSeek;
-    // In frame-ready callback we avoid sending frames when video is paused. However, to be more
-    // frame-accurate, we allow the callback to send the received frame n-times, since it could be different,
-    // just to make sure the latest one sent is the proper one.
-    unsigned _seekedFrameLoadedSanityChecks;
-
-    // VLC playback time has a low refresh rate, for that reason we estimate the time by ourselves.
-    // This value is used to compare the previous VLC time, and start estimating when it's updated.
-    libvlc_time_t _lastPlaybackTimeFrameReady;
-    // Timestamp used to know how much time has passed from the previous update. That difference is
-    // added to the estimated current time taking into account the playback rate.
-    libvlc_time_t _lastGlobalTimeFrameReady;
+    // Picks the frame of the seek among frames displayed after it.
+    SeekMatcher _seekMatcher;
+    uv_timer_t* _seekTimer;
+    // Pending seekToFrame() promise and the time it waits for.
+    v8::UniquePersistent<v8::Promise::Resolver> _jsSeekResolver;
+    libvlc_time_t _seekTime;
 
     ELoadVideoState _loadVideoState;
     float _bufferingValue;
 
+    // Player state and media length as libvlc reported them, so snapshot() doesn't ask libvlc.
+    // Updated on libvlc event thread.
+    std::atomic<unsigned> _reportedState;
+    std::atomic<libvlc_time_t> _reportedLength;
+    // Fps of current media, 0 until libvlc knows it.
+    double _mediaFps;
+
+    // Start of the latest load() and time it took to show its first frame (ms), -1 until it's shown.
+    std::chrono::steady_clock::time_point _loadStart;
+    double _timeToFirstFrame;
+
+    // Builds index sidecar of media passed to preload(), so indexer of load() only maps it.
+    std::shared_ptr<IndexJob> _preloadJob;
+
+    // Seeks requested while scrubbing wait for the frame of the seek in progress,
+    // and only the latest one is done then.
+    bool _scrubbing;
+    bool _keyframeScrubbing;
+    bool _scrubPending;
+    libvlc_time_t _scrubTime;
+    // Set when the latest scrub seek went to the keyframe instead of scrub time.
+    bool _scrubApproximate;
+    std::chrono::steady_clock::time_point _scrubSeekStart;
+
     // Perform conversions from time to frame using this FPS value. Useful when we don't want to use the
     // internal FPS value, average frame rate, and we prefer using another one, e.g. raw frame rate.
     float _withFps;
+
+    // MRL of media the index, frame cache, loop and cue points belong to.
+    std::string _mediaMrl;
+    // Frame times and keyframes of loaded media, built in background.
+    std::shared_ptr<MediaIndex> _mediaIndex;
+    // Index of current media is taken from it by handleAsync() as soon as it's ready.
+    std::shared_ptr<IndexJob> _indexJob;
+    // Incremented on every load, stop and playlist item change, to drop index of previous media.
+    unsigned _mediaGeneration;
+
+    // Copies of frames around current one, used for frame steps while paused.
+    DecodedFrameCache _frameCache;
+    unsigned _prefetchFrames;
+    v8::UniquePersistent<v8::Value> _jsCachedFrameBuffer;
+    char* _cachedFrameData;
+    std::vector<void*> _frameBufferData;
+    // Frame shown by decoder, which differs from current one after cache hits and prefetch.
+    unsigned _decoderFrame;
+    // Set when decoder was moved away from current frame, so it should be seeked back before playing.
+    bool _decoderMoved;
+    EPrefetchState _prefetchState;
+    // Frame expected from prefetch seek or step, and sequence of the latest frame before it was requested.
+    unsigned _prefetchFrame;
+    unsigned long long _prefetchSequence;
+
+    // Segments decoded forward and presented backwards on timer.
+    ReversePlayback _reverse;
+    uv_timer_t* _reverseTimer;
+    // Seek time of the decoding segment and sequence of the latest frame taken into it.
+    libvlc_time_t _reverseSeekTime;
+    unsigned long long _reverseSequence;
+    bool _reverseStepping;
+
+    // Requested playback rate, libvlc keeps the previous one while trick play is active.
+    double _rate;
+    // Above trick play rate decoder is paused and only keyframes are seeked to,
+    // following media time advanced by the timer.
+    bool _trickPlay;
+    uv_timer_t* _trickPlayTimer;
+    double _trickPlayClock;
+    libvlc_time_t _trickPlayTime;
+    std::chrono::steady_clock::time_point _trickPlayTick;
+    std::chrono::steady_clock::time_point _trickPlaySeekStart;
+
+    // A/B loop, wrapped with seek or replayed from captured frames if they fit the budget.
+    bool _loop;
+    bool _loopCache;
+    LoopClip _loopClip;
+    // Set after wrap seek, until frames from before it are gone.
+    bool _loopWrapped;
+    // Decoder is paused while clip is replayed from memory on timer.
+    bool _loopReplay;
+    uv_timer_t* _loopTimer;
+
+    // Standby pipeline decoding the first frame of the next playlist item when the current one
+    // is about to end, that frame is shown while the main pipeline reopens for that item.
+    PrerollOutput _preroll;
+    // Seconds before the end of current item to start pre-roll at, 0 disables it.
+    double _prerollTime;
+    int _prerollItem;
+    unsigned _prerollHits;
+    unsigned _prerollMisses;
+
+    // Cue points of loaded media, checked for every frame passed to JS.
+    CuePoints _cuePoints;
+    // Time of the latest checked frame, cues between it and the next one are crossed.
+    libvlc_time_t _cueTime;
+    // Set by seeks, which cross nothing, so only cues of the frame seek lands on are hit.
+    bool _cueJump;
 };
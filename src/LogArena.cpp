@@ -0,0 +1,34 @@
+#include "LogArena.h"
+
+#include <stdio.h>
+#include <string.h>
+
+LogArena::LogArena()
+{
+    for( unsigned slot = 0; slot < SlotCount; ++slot )
+        _freeSlots.push( slot );
+}
+
+unsigned LogArena::store( const char* format, va_list args )
+{
+    unsigned slot;
+    if( !_freeSlots.pop( &slot ) )
+        return NoSlot;
+
+    Slot& s = _slots[slot];
+
+    //vsnprintf is a bit of a mess in Microsoft-land, older versions do not guarantee termination
+    vsnprintf( s.message, MessageSize, format, args );
+    s.message[MessageSize - 1] = '\0';
+
+    strncpy( s.format, format, FormatSize - 1 );
+    s.format[FormatSize - 1] = '\0';
+
+    return slot;
+}
+
+void LogArena::release( unsigned slot )
+{
+    //every slot was taken from the ring, so there is always room for it
+    _freeSlots.push( slot );
+}
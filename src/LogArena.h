@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdarg.h>
+
+#include "MpmcRing.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Preallocated slots for log messages, formatted right in libvlc threads
+// and read in gui thread, so logging doesn't allocate.
+// Message longer than slot is truncated.
+class LogArena
+{
+public:
+    static const unsigned NoSlot = ~0u;
+
+    LogArena();
+
+    //could be called from any thread,
+    //returns NoSlot if all slots are taken, then message is lost
+    unsigned store( const char* format, va_list args );
+
+    const char* message( unsigned slot ) const
+        { return _slots[slot].message; }
+    const char* format( unsigned slot ) const
+        { return _slots[slot].format; }
+
+    //could be called from any thread
+    void release( unsigned slot );
+
+private:
+    LogArena( const LogArena& ) = delete;
+    LogArena& operator = ( const LogArena& ) = delete;
+
+private:
+    enum {
+        SlotCount = 128,
+        MessageSize = 384,
+        FormatSize = 128,
+    };
+
+    struct Slot
+    {
+        char message[MessageSize];
+        char format[FormatSize];
+    };
+
+    MpmcRing<unsigned, SlotCount> _freeSlots;
+    Slot _slots[SlotCount];
+};
@@ -0,0 +1,164 @@
+#include "LoopClip.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "MediaIndex.h"
+
+namespace {
+
+//without index frames are considered adjacent if they are closer than this in frame durations
+const double MaxFrameGap = 1.5;
+
+//used if media doesn't report frame rate
+const double DefaultFrameDuration = 1000.0 / 25;
+
+const size_t NoFrame = ~size_t( 0 );
+
+}
+
+LoopClip::LoopClip() :
+    _frameDuration( DefaultFrameDuration ), _in( 0 ), _out( 0 ), _budget( 0 ),
+    _inFrame( 0 ), _outFrame( 0 ), _lastFrame( 0 ),
+    _usedBytes( 0 ), _complete( false ), _overBudget( false ),
+    _clock( 0 ), _shown( NoFrame )
+{
+}
+
+void LoopClip::reset( const std::shared_ptr<MediaIndex>& index, double frameDuration,
+                      int64_t in, int64_t out, size_t budget )
+{
+    _index = index;
+    _frameDuration = frameDuration > 0 ? frameDuration : DefaultFrameDuration;
+    _in = in;
+    _out = out;
+    _budget = budget;
+
+    //loop starts exactly at the frame, so seek to it shows that frame
+    if( _index ) {
+        _inFrame = firstFrameFrom( in );
+        _outFrame = firstFrameFrom( out );
+        if( _inFrame < _index->frameCount() )
+            _in = _index->frameTime( _inFrame ) / 1000;
+    }
+
+    clear();
+    _overBudget = false;
+}
+
+void LoopClip::clear()
+{
+    _frames.clear();
+    _usedBytes = 0;
+    _complete = false;
+    _shown = NoFrame;
+}
+
+unsigned LoopClip::firstFrameFrom( int64_t time ) const
+{
+    const unsigned frame = _index->frameAt( time * 1000 - 1 );
+    return _index->frameTime( frame ) / 1000 >= time ? frame : frame + 1;
+}
+
+void LoopClip::capture( int64_t time, const void* data, size_t size, bool framesLost )
+{
+    if( _complete || _overBudget || time < _in || time >= _out )
+        return;
+
+    bool first;
+    bool adjacent;
+    if( _index ) {
+        //shown frame time is sampled, so it's snapped to the frame
+        const unsigned frame = _index->frameAt( ( time + 1 ) * 1000 - 1 );
+        if( !_frames.empty() && frame == _lastFrame )
+            return;
+
+        time = _index->frameTime( frame ) / 1000;
+        first = frame == _inFrame;
+        adjacent = !_frames.empty() && frame == _lastFrame + 1;
+        _lastFrame = frame;
+    } else {
+        if( !_frames.empty() && time <= _frames.back().time )
+            return;
+
+        first = time < _in + _frameDuration;
+        adjacent = !_frames.empty() && time - _frames.back().time < _frameDuration * MaxFrameGap;
+    }
+
+    if( first ) {
+        clear();
+    } else if( !adjacent || framesLost ) {
+        //frames with gaps can't be replayed, so wait for the next pass
+        clear();
+        return;
+    }
+
+    if( _usedBytes + size > _budget ) {
+        clear();
+        _overBudget = true;
+        return;
+    }
+
+    Frame frame;
+    frame.time = time;
+    frame.buffer = FrameBufferPool::instance().acquire( size );
+    if( !frame.buffer.data() ) {
+        clear();
+        return;
+    }
+
+    memcpy( frame.buffer.data(), data, size );
+    _frames.push_back( std::move( frame ) );
+    _usedBytes += size;
+}
+
+bool LoopClip::finish()
+{
+    if( _complete || _frames.empty() )
+        return _complete;
+
+    const bool last = _index ?
+        _lastFrame + 1 == _outFrame :
+        _out - _frames.back().time < _frameDuration * MaxFrameGap;
+    if( last )
+        _complete = true;
+    else
+        clear();
+
+    return _complete;
+}
+
+void LoopClip::startReplay( int64_t time, Clock::time_point now )
+{
+    _clock = static_cast<double>( std::max( time, _frames.front().time ) );
+    _shown = NoFrame;
+    _lastPresent = now;
+}
+
+const LoopClip::Frame* LoopClip::present( Clock::time_point now, double rate )
+{
+    if( !_complete )
+        return nullptr;
+
+    const double elapsed = std::chrono::duration<double, std::milli>( now - _lastPresent ).count();
+    _lastPresent = now;
+
+    //the last frame lasts up to the end of range, and the first one follows right after it
+    const double start = static_cast<double>( _frames.front().time );
+    const double duration = static_cast<double>( _out ) - start;
+    _clock += elapsed * std::max( rate, 0.0 );
+    if( _clock >= _out )
+        _clock = start + std::fmod( _clock - start, duration );
+
+    auto it = std::upper_bound( _frames.begin(), _frames.end(), _clock,
+        [] ( double time, const Frame& frame ) { return time < frame.time; } );
+    const size_t frame = static_cast<size_t>( it - _frames.begin() ) - 1;
+    if( frame == _shown )
+        return nullptr;
+
+    _shown = frame;
+
+    return &_frames[frame];
+}
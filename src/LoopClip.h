@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "FrameBufferPool.h"
+
+class MediaIndex;
+
+///////////////////////////////////////////////////////////////////////////////
+// Decoded frames of A/B loop range, captured while the range is played
+// for the first time and replayed from memory afterwards.
+// Should be accessed only from gui thread.
+class LoopClip
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame
+    {
+        //milliseconds from media start
+        int64_t time;
+        FrameBufferPool::Buffer buffer;
+    };
+
+    LoopClip();
+
+    //range is [in, out) in milliseconds, index could be null,
+    //then frame continuity is guessed from frame duration
+    void reset( const std::shared_ptr<MediaIndex>& index, double frameDuration,
+                int64_t in, int64_t out, size_t budget );
+    //drops captured frames but keeps the range
+    void clear();
+
+    int64_t in() const
+        { return _in; }
+    int64_t out() const
+        { return _out; }
+    double frameDuration() const
+        { return _frameDuration; }
+
+    //frame shown while playing, capture starts over if frames were lost
+    void capture( int64_t time, const void* data, size_t size, bool framesLost );
+    //called when playback reached the end of the range,
+    //returns true if all frames of range were captured
+    bool finish();
+    bool complete() const
+        { return _complete; }
+
+    //frames of the range don't fit budget, so there is no point to capture them
+    bool overBudget() const
+        { return _overBudget; }
+
+    void startReplay( int64_t time, Clock::time_point now );
+    //returns frame to show now, or null if the shown one is still actual,
+    //wraps from the end of range to its start without gap
+    const Frame* present( Clock::time_point now, double rate );
+
+private:
+    LoopClip( const LoopClip& ) = delete;
+    LoopClip& operator = ( const LoopClip& ) = delete;
+
+    unsigned firstFrameFrom( int64_t time ) const;
+
+private:
+    std::shared_ptr<MediaIndex> _index;
+    double _frameDuration;
+    int64_t _in;
+    int64_t _out;
+    size_t _budget;
+
+    //frames of range if there is index, _outFrame is exclusive
+    unsigned _inFrame;
+    unsigned _outFrame;
+    unsigned _lastFrame;
+
+    //ordered by time
+    std::vector<Frame> _frames;
+    size_t _usedBytes;
+    bool _complete;
+    bool _overBudget;
+
+    double _clock;
+    size_t _shown;
+    Clock::time_point _lastPresent;
+};
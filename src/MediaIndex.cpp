@@ -0,0 +1,758 @@
+#include "MediaIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <direct.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <initializer_list>
+
+namespace {
+
+const char SidecarMagic[8] = { 'W', 'C', 'J', 'S', 'I', 'D', 'X', '\0' };
+const uint32_t SidecarVersion = 1;
+const char SidecarExtension[] = ".wcidx";
+
+//sanity limits for broken or hostile files
+const uint64_t MaxMoovSize = 256 * 1024 * 1024;
+const uint32_t MaxSampleCount = 64 * 1024 * 1024;
+
+struct SidecarHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t frameCount;
+    uint64_t mediaSize;
+    int64_t mediaTime;
+    uint32_t pathSize;
+    uint32_t reserved;
+};
+
+inline size_t align8( size_t size )
+{
+    return ( size + 7 ) & ~static_cast<size_t>( 7 );
+}
+
+inline size_t timesOffset( size_t pathSize )
+{
+    return sizeof( SidecarHeader ) + align8( pathSize );
+}
+
+inline size_t keyframesOffset( size_t pathSize, size_t frameCount )
+{
+    return timesOffset( pathSize ) + frameCount * sizeof( int64_t );
+}
+
+inline size_t sidecarSize( size_t pathSize, size_t frameCount )
+{
+    return keyframesOffset( pathSize, frameCount ) + ( frameCount + 7 ) / 8;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+std::wstring toWide( const std::string& utf8 )
+{
+    const int size = MultiByteToWideChar( CP_UTF8, 0, utf8.data(), static_cast<int>( utf8.size() ), nullptr, 0 );
+    std::wstring wide( size, L'\0' );
+    if( size > 0 )
+        MultiByteToWideChar( CP_UTF8, 0, utf8.data(), static_cast<int>( utf8.size() ), &wide[0], size );
+    return wide;
+}
+
+std::string fromWide( const wchar_t* wide )
+{
+    const int size = WideCharToMultiByte( CP_UTF8, 0, wide, -1, nullptr, 0, nullptr, nullptr );
+    if( size <= 1 )
+        return std::string();
+
+    std::string utf8( size - 1, '\0' );
+    WideCharToMultiByte( CP_UTF8, 0, wide, -1, &utf8[0], size, nullptr, nullptr );
+    return utf8;
+}
+
+FILE* openFile( const std::string& path, const wchar_t* mode )
+{
+    return _wfopen( toWide( path ).c_str(), mode );
+}
+
+bool statFile( const std::string& path, uint64_t* size, int64_t* time )
+{
+    struct _stat64 st;
+    if( 0 != _wstat64( toWide( path ).c_str(), &st ) || !( st.st_mode & _S_IFREG ) )
+        return false;
+
+    *size = static_cast<uint64_t>( st.st_size );
+    *time = static_cast<int64_t>( st.st_mtime );
+    return true;
+}
+
+bool seekFile( FILE* file, uint64_t offset )
+{
+    return 0 == _fseeki64( file, static_cast<__int64>( offset ), SEEK_SET );
+}
+
+void makeDir( const std::string& path )
+{
+    _wmkdir( toWide( path ).c_str() );
+}
+
+bool replaceFile( const std::string& from, const std::string& to )
+{
+    return 0 != MoveFileExW( toWide( from ).c_str(), toWide( to ).c_str(), MOVEFILE_REPLACE_EXISTING );
+}
+
+void removeFile( const std::string& path )
+{
+    _wremove( toWide( path ).c_str() );
+}
+
+const char PathSeparators[] = "/\\";
+#define READ_BINARY L"rb"
+#define WRITE_BINARY L"wb"
+#else
+FILE* openFile( const std::string& path, const char* mode )
+{
+    return fopen( path.c_str(), mode );
+}
+
+bool statFile( const std::string& path, uint64_t* size, int64_t* time )
+{
+    struct stat st;
+    if( 0 != stat( path.c_str(), &st ) || !S_ISREG( st.st_mode ) )
+        return false;
+
+    *size = static_cast<uint64_t>( st.st_size );
+    *time = static_cast<int64_t>( st.st_mtime );
+    return true;
+}
+
+bool seekFile( FILE* file, uint64_t offset )
+{
+    return 0 == fseeko( file, static_cast<off_t>( offset ), SEEK_SET );
+}
+
+void makeDir( const std::string& path )
+{
+    mkdir( path.c_str(), 0755 );
+}
+
+bool replaceFile( const std::string& from, const std::string& to )
+{
+    return 0 == rename( from.c_str(), to.c_str() );
+}
+
+void removeFile( const std::string& path )
+{
+    remove( path.c_str() );
+}
+
+const char PathSeparators[] = "/";
+#define READ_BINARY "rb"
+#define WRITE_BINARY "wb"
+#endif
+
+//creates every missing directory of path, errors are detected on file write
+void makeDirs( const std::string& path )
+{
+    for( size_t pos = path.find_first_of( PathSeparators, 1 );
+         pos != std::string::npos;
+         pos = path.find_first_of( PathSeparators, pos + 1 ) )
+    {
+        makeDir( path.substr( 0, pos ) );
+    }
+    makeDir( path );
+}
+
+std::string sidecarPath( const std::string& cacheDir, const std::string& mediaPath )
+{
+    //FNV-1a, collisions are resolved by path stored in sidecar
+    uint64_t hash = 14695981039346656037ull;
+    for( char c: mediaPath ) {
+        hash ^= static_cast<uint8_t>( c );
+        hash *= 1099511628211ull;
+    }
+
+    char name[17];
+    snprintf( name, sizeof( name ), "%016llx", static_cast<unsigned long long>( hash ) );
+
+    return cacheDir + PathSeparators[0] + name + SidecarExtension;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//ISO BMFF (MP4/MOV) boxes are big endian
+inline uint32_t readU32( const uint8_t* p )
+{
+    return ( static_cast<uint32_t>( p[0] ) << 24 ) | ( static_cast<uint32_t>( p[1] ) << 16 ) |
+           ( static_cast<uint32_t>( p[2] ) << 8 ) | static_cast<uint32_t>( p[3] );
+}
+
+inline uint64_t readU64( const uint8_t* p )
+{
+    return ( static_cast<uint64_t>( readU32( p ) ) << 32 ) | readU32( p + 4 );
+}
+
+constexpr uint32_t fourcc( const char ( &s )[5] )
+{
+    return ( static_cast<uint32_t>( static_cast<uint8_t>( s[0] ) ) << 24 ) |
+           ( static_cast<uint32_t>( static_cast<uint8_t>( s[1] ) ) << 16 ) |
+           ( static_cast<uint32_t>( static_cast<uint8_t>( s[2] ) ) << 8 ) |
+             static_cast<uint32_t>( static_cast<uint8_t>( s[3] ) );
+}
+
+//payload of box
+struct Box
+{
+    const uint8_t* begin;
+    const uint8_t* end;
+
+    size_t size() const
+        { return end - begin; }
+};
+
+bool findChild( const Box& parent, uint32_t type, Box* child, const uint8_t** from = nullptr )
+{
+    const uint8_t* pos = from && *from ? *from : parent.begin;
+    while( parent.end - pos >= 8 ) {
+        uint64_t size = readU32( pos );
+        const uint32_t boxType = readU32( pos + 4 );
+        size_t headerSize = 8;
+
+        if( 1 == size ) {
+            if( parent.end - pos < 16 )
+                return false;
+            size = readU64( pos + 8 );
+            headerSize = 16;
+        } else if( 0 == size ) {
+            size = parent.end - pos;
+        }
+
+        if( size < headerSize || size > static_cast<uint64_t>( parent.end - pos ) )
+            return false;
+
+        const uint8_t* next = pos + size;
+        if( boxType == type ) {
+            child->begin = pos + headerSize;
+            child->end = next;
+            if( from )
+                *from = next;
+            return true;
+        }
+
+        pos = next;
+    }
+
+    return false;
+}
+
+bool findPath( const Box& parent, std::initializer_list<uint32_t> path, Box* child )
+{
+    Box box = parent;
+    for( uint32_t type: path ) {
+        if( !findChild( box, type, &box ) )
+            return false;
+    }
+
+    *child = box;
+    return true;
+}
+
+//timescale from mvhd or mdhd
+uint32_t readTimescale( const Box& header )
+{
+    if( header.size() < 24 )
+        return 0;
+
+    const uint8_t version = header.begin[0];
+    if( 1 == version )
+        return header.size() >= 32 ? readU32( header.begin + 20 ) : 0;
+
+    return readU32( header.begin + 12 );
+}
+
+bool readMoov( FILE* file, uint64_t fileSize, std::vector<uint8_t>* moov )
+{
+    uint64_t offset = 0;
+    while( offset + 8 <= fileSize ) {
+        uint8_t header[16];
+        if( !seekFile( file, offset ) || 1 != fread( header, 8, 1, file ) )
+            return false;
+
+        uint64_t size = readU32( header );
+        const uint32_t type = readU32( header + 4 );
+        uint64_t headerSize = 8;
+
+        if( 1 == size ) {
+            if( 1 != fread( header + 8, 8, 1, file ) )
+                return false;
+            size = readU64( header + 8 );
+            headerSize = 16;
+        } else if( 0 == size ) {
+            size = fileSize - offset;
+        }
+
+        if( size < headerSize || size > fileSize - offset )
+            return false;
+
+        if( fourcc( "moov" ) == type ) {
+            const uint64_t payloadSize = size - headerSize;
+            if( payloadSize > MaxMoovSize )
+                return false;
+
+            moov->resize( static_cast<size_t>( payloadSize ) );
+            return moov->empty() || 1 == fread( moov->data(), moov->size(), 1, file );
+        }
+
+        offset += size;
+    }
+
+    return false;
+}
+
+struct Frame
+{
+    int64_t time;
+    bool keyframe;
+
+    bool operator < ( const Frame& other ) const
+        { return time < other.time; }
+};
+
+//presentation times of samples of the first video track, in microseconds
+bool readVideoFrames( const Box& moov, std::vector<Frame>* frames )
+{
+    Box mvhd;
+    const uint32_t movieTimescale =
+        findChild( moov, fourcc( "mvhd" ), &mvhd ) ? readTimescale( mvhd ) : 0;
+
+    Box trak;
+    const uint8_t* nextTrak = nullptr;
+    while( findChild( moov, fourcc( "trak" ), &trak, &nextTrak ) ) {
+        Box hdlr, mdhd, stbl;
+        if( !findPath( trak, { fourcc( "mdia" ), fourcc( "hdlr" ) }, &hdlr ) ||
+            hdlr.size() < 12 || fourcc( "vide" ) != readU32( hdlr.begin + 8 ) )
+        {
+            continue;
+        }
+
+        if( !findPath( trak, { fourcc( "mdia" ), fourcc( "mdhd" ) }, &mdhd ) ||
+            !findPath( trak, { fourcc( "mdia" ), fourcc( "minf" ), fourcc( "stbl" ) }, &stbl ) )
+        {
+            return false;
+        }
+
+        const uint32_t timescale = readTimescale( mdhd );
+        if( 0 == timescale )
+            return false;
+
+        //decode times
+        Box stts;
+        if( !findChild( stbl, fourcc( "stts" ), &stts ) || stts.size() < 8 )
+            return false;
+
+        const uint32_t sttsCount = readU32( stts.begin + 4 );
+        if( ( stts.size() - 8 ) / 8 < sttsCount )
+            return false;
+
+        std::vector<int64_t> times;
+        int64_t dts = 0;
+        for( uint32_t i = 0; i < sttsCount; ++i ) {
+            const uint32_t sampleCount = readU32( stts.begin + 8 + i * 8 );
+            const uint32_t sampleDelta = readU32( stts.begin + 12 + i * 8 );
+            if( sampleCount > MaxSampleCount - times.size() )
+                return false;
+
+            for( uint32_t s = 0; s < sampleCount; ++s ) {
+                times.push_back( dts );
+                dts += sampleDelta;
+            }
+        }
+
+        //composition offsets, absent if there are no B-frames
+        Box ctts;
+        if( findChild( stbl, fourcc( "ctts" ), &ctts ) && ctts.size() >= 8 ) {
+            const uint32_t cttsCount = readU32( ctts.begin + 4 );
+            if( ( ctts.size() - 8 ) / 8 < cttsCount )
+                return false;
+
+            size_t sample = 0;
+            for( uint32_t i = 0; i < cttsCount && sample < times.size(); ++i ) {
+                const uint32_t sampleCount = readU32( ctts.begin + 8 + i * 8 );
+                //offset is unsigned in version 0, but negative values are written by muxers anyway
+                const int32_t sampleOffset = static_cast<int32_t>( readU32( ctts.begin + 12 + i * 8 ) );
+                for( uint32_t s = 0; s < sampleCount && sample < times.size(); ++s )
+                    times[sample++] += sampleOffset;
+            }
+        }
+
+        //edit list shifts media timeline to presentation one,
+        //empty edits delay start, the first non empty one gives start of media
+        int64_t mediaStart = 0;
+        int64_t emptyDelay = 0;
+        Box elst;
+        if( findPath( trak, { fourcc( "edts" ), fourcc( "elst" ) }, &elst ) && elst.size() >= 8 ) {
+            const bool v1 = 1 == elst.begin[0];
+            const size_t entrySize = v1 ? 20 : 12;
+            const uint32_t elstCount = readU32( elst.begin + 4 );
+            for( uint32_t i = 0; i < elstCount && 8 + ( i + 1 ) * entrySize <= elst.size(); ++i ) {
+                const uint8_t* entry = elst.begin + 8 + i * entrySize;
+                const int64_t segmentDuration =
+                    v1 ? static_cast<int64_t>( readU64( entry ) ) : readU32( entry );
+                const int64_t mediaTime =
+                    v1 ? static_cast<int64_t>( readU64( entry + 8 ) ) : static_cast<int32_t>( readU32( entry + 4 ) );
+
+                if( -1 != mediaTime ) {
+                    mediaStart = mediaTime;
+                    break;
+                }
+
+                if( movieTimescale )
+                    emptyDelay += segmentDuration * 1000000 / movieTimescale;
+            }
+        }
+
+        //sync samples, absent if every sample is sync one
+        Box stss;
+        const bool hasStss = findChild( stbl, fourcc( "stss" ), &stss ) && stss.size() >= 8;
+        std::vector<bool> keyframes( times.size(), !hasStss );
+        if( hasStss ) {
+            const uint32_t stssCount = readU32( stss.begin + 4 );
+            for( uint32_t i = 0; i < stssCount && 8 + ( i + 1 ) * 4 <= stss.size(); ++i ) {
+                const uint32_t sample = readU32( stss.begin + 8 + i * 4 );
+                if( sample >= 1 && sample <= keyframes.size() )
+                    keyframes[sample - 1] = true;
+            }
+        }
+
+        frames->clear();
+        frames->reserve( times.size() );
+        for( size_t i = 0; i < times.size(); ++i ) {
+            const Frame frame = {
+                ( times[i] - mediaStart ) * 1000000 / timescale + emptyDelay,
+                keyframes[i]
+            };
+
+            //samples before start of edit are decoded but never presented
+            if( frame.time >= 0 )
+                frames->push_back( frame );
+        }
+
+        std::stable_sort( frames->begin(), frames->end() );
+
+        return !frames->empty();
+    }
+
+    return false;
+}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+class MediaIndex::MappedFile
+{
+public:
+    static std::unique_ptr<MappedFile> open( const std::string& path );
+
+    ~MappedFile();
+
+    const char* data() const
+        { return static_cast<const char*>( _data ); }
+    size_t size() const
+        { return _size; }
+
+private:
+    MappedFile( void* data, size_t size ) :
+        _data( data ), _size( size ) {}
+
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator = ( const MappedFile& ) = delete;
+
+private:
+    void* _data;
+    size_t _size;
+};
+
+std::unique_ptr<MediaIndex::MappedFile> MediaIndex::MappedFile::open( const std::string& path )
+{
+    std::unique_ptr<MappedFile> mappedFile;
+
+#ifdef _WIN32
+    HANDLE file =
+        CreateFileW( toWide( path ).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                     nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+    if( INVALID_HANDLE_VALUE == file )
+        return mappedFile;
+
+    LARGE_INTEGER size;
+    if( GetFileSizeEx( file, &size ) && size.QuadPart > 0 &&
+        static_cast<uint64_t>( size.QuadPart ) <= SIZE_MAX )
+    {
+        //view keeps mapping and file alive after handles are closed
+        HANDLE mapping = CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        if( mapping ) {
+            void* data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+            if( data )
+                mappedFile.reset( new MappedFile( data, static_cast<size_t>( size.QuadPart ) ) );
+            CloseHandle( mapping );
+        }
+    }
+
+    CloseHandle( file );
+#else
+    const int fd = ::open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+        return mappedFile;
+
+    struct stat st;
+    if( 0 == fstat( fd, &st ) && st.st_size > 0 ) {
+        //mapping stays valid after descriptor is closed
+        void* data = mmap( nullptr, static_cast<size_t>( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( MAP_FAILED != data )
+            mappedFile.reset( new MappedFile( data, static_cast<size_t>( st.st_size ) ) );
+    }
+
+    ::close( fd );
+#endif
+
+    return mappedFile;
+}
+
+MediaIndex::MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    UnmapViewOfFile( _data );
+#else
+    munmap( _data, _size );
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool MediaIndex::mrlToPath( const std::string& mrl, std::string* path )
+{
+    static const char FileScheme[] = "file://";
+    const size_t fileSchemeSize = sizeof( FileScheme ) - 1;
+
+    if( 0 != mrl.compare( 0, fileSchemeSize, FileScheme ) ) {
+        //plain path is accepted by libvlc as well
+        if( mrl.empty() || std::string::npos != mrl.find( "://" ) )
+            return false;
+
+        *path = mrl;
+        return true;
+    }
+
+    //only local files, i.e. with empty host
+    if( mrl.size() <= fileSchemeSize || '/' != mrl[fileSchemeSize] )
+        return false;
+
+    std::string decoded;
+    for( size_t i = fileSchemeSize; i < mrl.size(); ++i ) {
+        if( '%' == mrl[i] && i + 2 < mrl.size() &&
+            isxdigit( static_cast<unsigned char>( mrl[i + 1] ) ) &&
+            isxdigit( static_cast<unsigned char>( mrl[i + 2] ) ) )
+        {
+            decoded += static_cast<char>( strtol( mrl.substr( i + 1, 2 ).c_str(), nullptr, 16 ) );
+            i += 2;
+        } else {
+            decoded += mrl[i];
+        }
+    }
+
+#ifdef _WIN32
+    // "/C:/dir/file" -> "C:/dir/file"
+    if( decoded.size() >= 3 && ':' == decoded[2] )
+        decoded.erase( 0, 1 );
+#endif
+
+    *path = decoded;
+    return true;
+}
+
+std::string MediaIndex::defaultCacheDir()
+{
+#ifdef _WIN32
+    const wchar_t* localAppData = _wgetenv( L"LOCALAPPDATA" );
+    if( localAppData && *localAppData )
+        return fromWide( localAppData ) + "\\WebChimera.js\\index";
+#else
+    const char* home = getenv( "HOME" );
+#ifdef __APPLE__
+    if( home && *home )
+        return std::string( home ) + "/Library/Caches/WebChimera.js/index";
+#else
+    const char* cacheHome = getenv( "XDG_CACHE_HOME" );
+    if( cacheHome && *cacheHome )
+        return std::string( cacheHome ) + "/webchimera.js/index";
+    if( home && *home )
+        return std::string( home ) + "/.cache/webchimera.js/index";
+#endif
+#endif
+
+    return std::string();
+}
+
+std::shared_ptr<MediaIndex> MediaIndex::build( const std::string& path,
+                                               const std::atomic<bool>* cancelled )
+{
+    std::shared_ptr<MediaIndex> index;
+
+    uint64_t mediaSize;
+    int64_t mediaTime;
+    if( !statFile( path, &mediaSize, &mediaTime ) )
+        return index;
+
+    FILE* file = openFile( path, READ_BINARY );
+    if( !file )
+        return index;
+
+    std::vector<uint8_t> moovData;
+    const bool moovRead = readMoov( file, mediaSize, &moovData );
+    fclose( file );
+
+    if( cancelled && *cancelled )
+        return index;
+
+    std::vector<Frame> frames;
+    const Box moov = { moovData.data(), moovData.data() + moovData.size() };
+    if( !moovRead || !readVideoFrames( moov, &frames ) )
+        return index;
+
+    if( cancelled && *cancelled )
+        return index;
+
+    index.reset( new MediaIndex );
+
+    index->_data.assign( sidecarSize( path.size(), frames.size() ), '\0' );
+    char* data = index->_data.data();
+
+    SidecarHeader* header = reinterpret_cast<SidecarHeader*>( data );
+    memcpy( header->magic, SidecarMagic, sizeof( SidecarMagic ) );
+    header->version = SidecarVersion;
+    header->frameCount = static_cast<uint32_t>( frames.size() );
+    header->mediaSize = mediaSize;
+    header->mediaTime = mediaTime;
+    header->pathSize = static_cast<uint32_t>( path.size() );
+
+    memcpy( data + sizeof( SidecarHeader ), path.data(), path.size() );
+
+    int64_t* times = reinterpret_cast<int64_t*>( data + timesOffset( path.size() ) );
+    uint8_t* keyframes = reinterpret_cast<uint8_t*>( data + keyframesOffset( path.size(), frames.size() ) );
+    for( size_t i = 0; i < frames.size(); ++i ) {
+        times[i] = frames[i].time;
+        if( frames[i].keyframe )
+            keyframes[i / 8] |= 1 << ( i % 8 );
+    }
+
+    if( !index->attach( index->_data.data(), index->_data.size() ) )
+        index.reset();
+
+    return index;
+}
+
+std::shared_ptr<MediaIndex> MediaIndex::open( const std::string& path, const std::string& cacheDir,
+                                              const std::atomic<bool>* cancelled )
+{
+    uint64_t mediaSize;
+    int64_t mediaTime;
+    if( !statFile( path, &mediaSize, &mediaTime ) )
+        return std::shared_ptr<MediaIndex>();
+
+    const std::string sidecar = cacheDir.empty() ? std::string() : sidecarPath( cacheDir, path );
+
+    if( !sidecar.empty() ) {
+        std::unique_ptr<MappedFile> mappedFile = MappedFile::open( sidecar );
+        if( mappedFile ) {
+            std::shared_ptr<MediaIndex> index( new MediaIndex );
+            const SidecarHeader* header = reinterpret_cast<const SidecarHeader*>( mappedFile->data() );
+            if( index->attach( mappedFile->data(), mappedFile->size() ) &&
+                header->mediaSize == mediaSize && header->mediaTime == mediaTime &&
+                header->pathSize == path.size() &&
+                0 == memcmp( mappedFile->data() + sizeof( SidecarHeader ), path.data(), path.size() ) )
+            {
+                index->_mappedFile = std::move( mappedFile );
+                return index;
+            }
+        }
+    }
+
+    std::shared_ptr<MediaIndex> index = build( path, cancelled );
+    if( !index || sidecar.empty() )
+        return index;
+
+    //written to temporary file first, to never expose partially written sidecar
+    const std::string tmpSidecar =
+        sidecar + "." + std::to_string( std::chrono::steady_clock::now().time_since_epoch().count() ) + ".tmp";
+
+    makeDirs( cacheDir );
+
+    FILE* file = openFile( tmpSidecar, WRITE_BINARY );
+    if( !file )
+        return index;
+
+    const bool written = 1 == fwrite( index->_data.data(), index->_data.size(), 1, file );
+    const bool closed = 0 == fclose( file );
+    if( !written || !closed || !replaceFile( tmpSidecar, sidecar ) )
+        removeFile( tmpSidecar );
+
+    return index;
+}
+
+MediaIndex::MediaIndex() :
+    _frameCount( 0 ), _times( nullptr ), _keyframes( nullptr )
+{
+}
+
+MediaIndex::~MediaIndex()
+{
+}
+
+bool MediaIndex::attach( const char* data, size_t size )
+{
+    if( size < sizeof( SidecarHeader ) )
+        return false;
+
+    const SidecarHeader* header = reinterpret_cast<const SidecarHeader*>( data );
+    if( 0 != memcmp( header->magic, SidecarMagic, sizeof( SidecarMagic ) ) ||
+        SidecarVersion != header->version ||
+        0 == header->frameCount ||
+        sidecarSize( header->pathSize, header->frameCount ) != size )
+    {
+        return false;
+    }
+
+    _frameCount = header->frameCount;
+    _times = reinterpret_cast<const int64_t*>( data + timesOffset( header->pathSize ) );
+    _keyframes = reinterpret_cast<const uint8_t*>( data + keyframesOffset( header->pathSize, _frameCount ) );
+
+    return true;
+}
+
+unsigned MediaIndex::frameAt( int64_t time ) const
+{
+    const int64_t* next = std::upper_bound( _times, _times + _frameCount, time );
+
+    return next == _times ? 0 : static_cast<unsigned>( next - _times - 1 );
+}
+
+unsigned MediaIndex::keyframeBefore( unsigned frame ) const
+{
+    while( frame > 0 && !isKeyframe( frame ) )
+        --frame;
+
+    return frame;
+}
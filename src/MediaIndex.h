@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Presentation time and keyframe flag of every video frame of local media file.
+// Built from MP4/MOV sample tables and cached in memory mapped sidecar files,
+// keyed by media path, size and modification time.
+class MediaIndex
+{
+public:
+    //returns false if mrl doesn't point to local file
+    static bool mrlToPath( const std::string& mrl, std::string* path );
+
+    //platform specific per user cache directory
+    static std::string defaultCacheDir();
+
+    //parses media file, returns null if it's not MP4/MOV file with video track,
+    //or if cancelled was set before parsing finished
+    static std::shared_ptr<MediaIndex> build( const std::string& path,
+                                              const std::atomic<bool>* cancelled = nullptr );
+
+    //maps up to date sidecar from cacheDir if any,
+    //otherwise builds index and tries to save it to cacheDir
+    static std::shared_ptr<MediaIndex> open( const std::string& path, const std::string& cacheDir,
+                                             const std::atomic<bool>* cancelled = nullptr );
+
+    ~MediaIndex();
+
+    unsigned frameCount() const
+        { return _frameCount; }
+    //microseconds from media start
+    int64_t frameTime( unsigned frame ) const
+        { return _times[frame]; }
+    bool isKeyframe( unsigned frame ) const
+        { return 0 != ( _keyframes[frame / 8] & ( 1 << ( frame % 8 ) ) ); }
+
+    //last frame presented at or before time, or 0 if there are no such frames
+    unsigned frameAt( int64_t time ) const;
+    unsigned keyframeBefore( unsigned frame ) const;
+    //count of frames decoder should decode to show frame after seek
+    unsigned seekCost( unsigned frame ) const
+        { return frame - keyframeBefore( frame ) + 1; }
+    //count of frames to step forward from current frame to target one,
+    //or 0 if seek is not more expensive since there is keyframe in between
+    unsigned stepsTo( unsigned current, unsigned target ) const
+        { return target > current && keyframeBefore( target ) <= current ? target - current : 0; }
+
+private:
+    class MappedFile;
+
+    MediaIndex();
+
+    MediaIndex( const MediaIndex& ) = delete;
+    MediaIndex& operator = ( const MediaIndex& ) = delete;
+
+    bool attach( const char* data, size_t size );
+
+private:
+    //index is kept in the same layout as in sidecar file,
+    //either in _data or in _mappedFile
+    std::vector<char> _data;
+    std::unique_ptr<MappedFile> _mappedFile;
+
+    unsigned _frameCount;
+    const int64_t* _times;
+    const uint8_t* _keyframes;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixed capacity, allocation free, lock free queue
+// for any number of producer and consumer threads.
+// Every cell has sequence number telling whether it's free for the producer
+// or filled for the consumer of the current lap.
+template<typename T, unsigned Capacity>
+class MpmcRing
+{
+    static_assert( Capacity > 1 && 0 == ( Capacity & ( Capacity - 1 ) ),
+                   "Capacity should be power of two" );
+    static_assert( std::is_pod<T>::value,
+                   "MpmcRing is intended for POD items only" );
+
+public:
+    MpmcRing() :
+        _head( 0 ), _tail( 0 )
+    {
+        for( unsigned i = 0; i < Capacity; ++i )
+            _cells[i].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    bool push( const T& item )
+    {
+        Cell* cell;
+        unsigned tail = _tail.load( std::memory_order_relaxed );
+        for( ;; ) {
+            cell = &_cells[tail & ( Capacity - 1 )];
+            const int lag =
+                static_cast<int>( cell->sequence.load( std::memory_order_acquire ) - tail );
+            if( 0 == lag ) {
+                if( _tail.compare_exchange_weak( tail, tail + 1, std::memory_order_relaxed ) )
+                    break;
+            } else if( lag < 0 ) {
+                //cell is not consumed yet since the previous lap
+                return false;
+            } else {
+                tail = _tail.load( std::memory_order_relaxed );
+            }
+        }
+
+        cell->item = item;
+        cell->sequence.store( tail + 1, std::memory_order_release );
+
+        return true;
+    }
+
+    bool pop( T* item )
+    {
+        Cell* cell;
+        unsigned head = _head.load( std::memory_order_relaxed );
+        for( ;; ) {
+            cell = &_cells[head & ( Capacity - 1 )];
+            const int lag =
+                static_cast<int>( cell->sequence.load( std::memory_order_acquire ) - ( head + 1 ) );
+            if( 0 == lag ) {
+                if( _head.compare_exchange_weak( head, head + 1, std::memory_order_relaxed ) )
+                    break;
+            } else if( lag < 0 ) {
+                //cell is not filled yet
+                return false;
+            } else {
+                head = _head.load( std::memory_order_relaxed );
+            }
+        }
+
+        *item = cell->item;
+        cell->sequence.store( head + Capacity, std::memory_order_release );
+
+        return true;
+    }
+
+private:
+    enum { CacheLineSize = 64 };
+
+    struct Cell
+    {
+        std::atomic<unsigned> sequence;
+        T item;
+    };
+
+    //head and tail live on different cache lines to avoid false sharing
+    std::atomic<unsigned> _head;
+    char _headPadding[CacheLineSize - sizeof( std::atomic<unsigned> )];
+    std::atomic<unsigned> _tail;
+    char _tailPadding[CacheLineSize - sizeof( std::atomic<unsigned> )];
+
+    Cell _cells[Capacity];
+};
@@ -0,0 +1,191 @@
+#include "PlaneScaler.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "WorkerPool.h"
+
+namespace {
+
+const int WeightBits = 14;
+const int WeightOne = 1 << WeightBits;
+//horizontal pass keeps 6 fractional bits, so 8 bit samples still fit uint16_t
+const int RowShift = WeightBits - 6;
+const int OutputShift = WeightBits + 6;
+
+//planes smaller than that are scaled on calling thread only
+const unsigned MinBandSamples = 1280 * 180;
+
+}
+
+PlaneScaler::PlaneScaler() :
+    _channels( 0 ), _width( 0 ), _height( 0 ),
+    _horizontal(), _vertical()
+{
+}
+
+void PlaneScaler::setupFilter( unsigned sourceSize, double regionStart, double regionSize,
+                               unsigned size, Filter* filter )
+{
+    regionStart = std::max( 0.0, std::min( regionStart, static_cast<double>( sourceSize ) ) );
+    regionSize = std::max( 0.0, std::min( regionSize, sourceSize - regionStart ) );
+
+    //distance between target samples in source samples
+    const double step = regionSize / size;
+    //downscaling widens filter to cover every source sample
+    const double support = std::max( 1.0, step );
+    const unsigned span = static_cast<unsigned>( ceil( 2 * support ) ) + 1;
+    const unsigned taps = std::min( sourceSize, span );
+
+    filter->taps = taps;
+    filter->starts.resize( size );
+    filter->weights.assign( size * taps, 0 );
+
+    std::vector<double> weights( taps );
+    for( unsigned i = 0; i < size; ++i ) {
+        const double center = regionStart + ( i + 0.5 ) * step - 0.5;
+        const int first = static_cast<int>( floor( center - support ) ) + 1;
+        //window is kept inside plane, edge samples are repeated outside of it
+        const int start = std::max( 0, std::min( first, static_cast<int>( sourceSize - taps ) ) );
+
+        std::fill( weights.begin(), weights.end(), 0.0 );
+        double total = 0;
+        for( unsigned k = 0; k < span; ++k ) {
+            const int position = first + static_cast<int>( k );
+            const double weight = 1.0 - fabs( position - center ) / support;
+            if( weight <= 0 )
+                continue;
+
+            const int clamped = std::max( 0, std::min( position, static_cast<int>( sourceSize ) - 1 ) );
+            weights[clamped - start] += weight;
+            total += weight;
+        }
+
+        if( total <= 0 ) {
+            const int nearest = static_cast<int>( floor( center + 0.5 ) );
+            weights[std::max( 0, std::min( nearest, static_cast<int>( sourceSize ) - 1 ) ) - start] = 1;
+            total = 1;
+        }
+
+        //rounding error goes to the largest weight, so weights always sum up to exactly one
+        int16_t* quantized = &filter->weights[i * taps];
+        int sum = 0;
+        unsigned largest = 0;
+        for( unsigned k = 0; k < taps; ++k ) {
+            quantized[k] = static_cast<int16_t>( floor( weights[k] / total * WeightOne + 0.5 ) );
+            sum += quantized[k];
+            if( quantized[k] > quantized[largest] )
+                largest = k;
+        }
+        quantized[largest] = static_cast<int16_t>( quantized[largest] + WeightOne - sum );
+
+        filter->starts[i] = static_cast<unsigned>( start );
+    }
+}
+
+void PlaneScaler::setup( unsigned channels,
+                         unsigned sourceWidth, unsigned sourceHeight,
+                         double regionX, double regionY, double regionWidth, double regionHeight,
+                         unsigned width, unsigned height )
+{
+    _channels = channels;
+    _width = width;
+    _height = height;
+
+    if( 0 == channels || 0 == sourceWidth || 0 == sourceHeight || 0 == width || 0 == height ) {
+        _width = _height = 0;
+        return;
+    }
+
+    setupFilter( sourceWidth, regionX, regionWidth, width, &_horizontal );
+    setupFilter( sourceHeight, regionY, regionHeight, height, &_vertical );
+}
+
+void PlaneScaler::scaleRow( const uint8_t* source, uint16_t* row ) const
+{
+    const unsigned taps = _horizontal.taps;
+    const int16_t* weights = _horizontal.weights.data();
+
+    for( unsigned x = 0; x < _width; ++x, weights += taps ) {
+        const uint8_t* from = source + _horizontal.starts[x] * _channels;
+        for( unsigned channel = 0; channel < _channels; ++channel ) {
+            int sum = 1 << ( RowShift - 1 );
+            for( unsigned k = 0; k < taps; ++k )
+                sum += weights[k] * from[k * _channels + channel];
+            *row++ = static_cast<uint16_t>( sum >> RowShift );
+        }
+    }
+}
+
+void PlaneScaler::scaleRows( const uint8_t* source, unsigned sourcePitch,
+                             uint8_t* target, unsigned targetPitch,
+                             unsigned beginRow, unsigned endRow,
+                             uint16_t* window ) const
+{
+    const unsigned taps = _vertical.taps;
+    const unsigned rowSize = _width * _channels;
+
+    const uint16_t* rows[64];
+    std::vector<const uint16_t*> manyRows;
+    const uint16_t** tapRows = rows;
+    if( taps > sizeof( rows ) / sizeof( rows[0] ) ) {
+        manyRows.resize( taps );
+        tapRows = manyRows.data();
+    }
+
+    //source row r is kept in window row r % taps,
+    //starts never decrease, so every source row is scaled horizontally only once per band
+    unsigned scaledEnd = beginRow < endRow ? _vertical.starts[beginRow] : 0;
+
+    for( unsigned y = beginRow; y < endRow; ++y ) {
+        const unsigned start = _vertical.starts[y];
+        for( unsigned row = std::max( scaledEnd, start ); row < start + taps; ++row )
+            scaleRow( source + row * sourcePitch, window + ( row % taps ) * rowSize );
+        scaledEnd = std::max( scaledEnd, start + taps );
+
+        for( unsigned k = 0; k < taps; ++k )
+            tapRows[k] = window + ( ( start + k ) % taps ) * rowSize;
+
+        const int16_t* weights = &_vertical.weights[y * taps];
+        uint8_t* to = target + y * targetPitch;
+        for( unsigned x = 0; x < rowSize; ++x ) {
+            int sum = 1 << ( OutputShift - 1 );
+            for( unsigned k = 0; k < taps; ++k )
+                sum += weights[k] * tapRows[k][x];
+            to[x] = static_cast<uint8_t>( std::min( sum >> OutputShift, 255 ) );
+        }
+    }
+}
+
+void PlaneScaler::scale( const uint8_t* source, unsigned sourcePitch,
+                         uint8_t* target, unsigned targetPitch,
+                         WorkerPool* pool )
+{
+    if( 0 == _width || 0 == _height )
+        return;
+
+    const unsigned rowSize = _width * _channels;
+    const unsigned windowSize = _vertical.taps * rowSize;
+
+    const unsigned bands =
+        pool ? std::max( 1u, std::min( pool->concurrency(), rowSize * _height / MinBandSamples ) ) : 1;
+
+    if( _windows.size() < bands * windowSize )
+        _windows.resize( bands * windowSize );
+
+    if( bands <= 1 ) {
+        scaleRows( source, sourcePitch, target, targetPitch, 0, _height, _windows.data() );
+        return;
+    }
+
+    const unsigned bandRows = ( _height + bands - 1 ) / bands;
+
+    pool->run( bands,
+        [&] ( unsigned band ) {
+            const unsigned beginRow = std::min( band * bandRows, _height );
+            const unsigned endRow = std::min( beginRow + bandRows, _height );
+            scaleRows( source, sourcePitch, target, targetPitch, beginRow, endRow,
+                       _windows.data() + band * windowSize );
+        } );
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+class WorkerPool; //#include "WorkerPool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Separable resampler of one 8 bit plane, interleaved channels are scaled independently.
+// Downscaling averages all covered source samples (triangle filter widened by scale),
+// upscaling interpolates linearly. Weights are fixed point (14 fractional bits).
+class PlaneScaler
+{
+public:
+    PlaneScaler();
+
+    //maps region of source plane (in samples, could be fractional) to whole target plane,
+    //region is clamped to source plane
+    void setup( unsigned channels,
+                unsigned sourceWidth, unsigned sourceHeight,
+                double regionX, double regionY, double regionWidth, double regionHeight,
+                unsigned width, unsigned height );
+
+    unsigned width() const
+        { return _width; }
+    unsigned height() const
+        { return _height; }
+
+    //splits large planes into row bands executed on pool (if any),
+    //should not be called concurrently for the same scaler
+    void scale( const uint8_t* source, unsigned sourcePitch,
+                uint8_t* target, unsigned targetPitch,
+                WorkerPool* pool );
+
+private:
+    struct Filter
+    {
+        //every target sample is weighted sum of taps source samples starting at starts[i]
+        unsigned taps;
+        std::vector<unsigned> starts;
+        std::vector<int16_t> weights;
+    };
+
+    static void setupFilter( unsigned sourceSize, double regionStart, double regionSize,
+                             unsigned size, Filter* );
+
+    void scaleRows( const uint8_t* source, unsigned sourcePitch,
+                    uint8_t* target, unsigned targetPitch,
+                    unsigned beginRow, unsigned endRow,
+                    uint16_t* window ) const;
+    void scaleRow( const uint8_t* source, uint16_t* row ) const;
+
+private:
+    unsigned _channels;
+    unsigned _width;
+    unsigned _height;
+    Filter _horizontal;
+    Filter _vertical;
+    //horizontally scaled source rows, _vertical.taps rows per band
+    std::vector<uint16_t> _windows;
+};
@@ -0,0 +1,129 @@
+#include "PrerollOutput.h"
+
+#include <string.h>
+
+namespace {
+
+//standby pipeline should never be heard
+void discardAudio( void*, const void*, unsigned, int64_t )
+{
+}
+
+}
+
+PrerollOutput::PrerollOutput() :
+    _started( false ), _ready( false ),
+    _framePixelFormat( PixelFormat::I420 ), _frameWidth( 0 ), _frameHeight( 0 )
+{
+}
+
+PrerollOutput::~PrerollOutput()
+{
+    close();
+}
+
+bool PrerollOutput::open( libvlc_instance_t* libvlc )
+{
+    if( !_player.open( libvlc ) )
+        return false;
+
+    libvlc_media_player_t* mp = _player.get_mp();
+    libvlc_audio_set_callbacks( mp, discardAudio, nullptr, nullptr, nullptr, nullptr, nullptr );
+    libvlc_audio_set_format( mp, "S16N", 44100, 2 );
+
+    return VlcVideoOutput::open( &_player );
+}
+
+void PrerollOutput::close()
+{
+    if( !_player.is_open() )
+        return;
+
+    stop();
+
+    VlcVideoOutput::close();
+    _player.close();
+}
+
+void PrerollOutput::start( const vlc::media& media, VlcVideoOutput& settingsFrom )
+{
+    stop();
+
+    if( !_player.is_open() )
+        return;
+
+    VlcVideoOutput::copyOutputSettings( settingsFrom );
+
+    _started = true;
+    _player.set_media( media );
+    _player.play();
+}
+
+void PrerollOutput::stop()
+{
+    _started = false;
+    _ready = false;
+    _frame.reset();
+
+    //decoder could wait for leased frames
+    VlcVideoOutput::releaseAllFrames();
+
+    if( _player.is_open() )
+        _player.stop();
+}
+
+bool PrerollOutput::matches( const VideoFrame& videoFrame ) const
+{
+    return _ready &&
+           videoFrame.pixelFormat() == _framePixelFormat &&
+           videoFrame.width() == _frameWidth &&
+           videoFrame.height() == _frameHeight &&
+           videoFrame.size() == _frame.size();
+}
+
+std::vector<void*> PrerollOutput::onFrameSetup( const VideoFrame& videoFrame )
+{
+    //every slot gets own part of buffer, so decoder doesn't overwrite frame being copied
+    _buffer = FrameBufferPool::instance().acquire( videoFrame.size() * videoFrame.slotCount() );
+
+    _framePixelFormat = videoFrame.pixelFormat();
+    _frameWidth = videoFrame.width();
+    _frameHeight = videoFrame.height();
+
+    std::vector<void*> slots;
+    if( !_buffer.data() )
+        return slots;
+
+    for( unsigned slot = 0; slot < videoFrame.slotCount(); ++slot )
+        slots.push_back( static_cast<char*>( _buffer.data() ) + slot * videoFrame.size() );
+
+    return slots;
+}
+
+void PrerollOutput::onFrameReady( const FrameInfo&, unsigned )
+{
+    const VideoFrame* videoFrame = VlcVideoOutput::currentVideoFrame();
+    if( !_started || _ready || !videoFrame || !_buffer.data() ) {
+        VlcVideoOutput::releaseFrame( currentFrameSlot() );
+        return;
+    }
+
+    _frame = FrameBufferPool::instance().acquire( videoFrame->size() );
+    if( _frame.data() )
+        memcpy( _frame.data(),
+                static_cast<const char*>( _buffer.data() ) + currentFrameSlot() * videoFrame->size(),
+                videoFrame->size() );
+
+    VlcVideoOutput::releaseFrame( currentFrameSlot() );
+
+    //frame is all that is needed, so decoder resources are freed right away
+    if( _frame.data() ) {
+        _ready = true;
+        _player.stop();
+    }
+}
+
+void PrerollOutput::onFrameCleanup()
+{
+    _buffer.reset();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <libvlc_wrapper/vlc_player.h>
+
+#include "VlcVideoOutput.h"
+#include "FrameBufferPool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Standby pipeline decoding the first frame of media, to have it ready
+// before the current media ends. Video output settings are copied from the
+// main output, so the frame could be shown in its buffers as is.
+// Should be accessed only from gui thread.
+class PrerollOutput :
+    private VlcVideoOutput
+{
+public:
+    PrerollOutput();
+    ~PrerollOutput();
+
+    bool open( libvlc_instance_t* );
+    void close();
+
+    //decoder is stopped as soon as the first frame is displayed
+    void start( const vlc::media& media, VlcVideoOutput& settingsFrom );
+    void stop();
+
+    bool started() const
+        { return _started; }
+    bool ready() const
+        { return _ready; }
+
+    //true if frame has the same layout as frames of videoFrame
+    bool matches( const VideoFrame& videoFrame ) const;
+    const FrameBufferPool::Buffer& frame() const
+        { return _frame; }
+
+protected:
+    std::vector<void*> onFrameSetup( const VideoFrame& ) override;
+    void onFrameReady( const FrameInfo&, unsigned droppedFrames ) override;
+    void onFrameCleanup() override;
+
+private:
+    vlc::basic_player _player;
+
+    bool _started;
+    bool _ready;
+
+    //decoder output, only one slot is used
+    FrameBufferPool::Buffer _buffer;
+
+    FrameBufferPool::Buffer _frame;
+    PixelFormat _framePixelFormat;
+    unsigned _frameWidth;
+    unsigned _frameHeight;
+};
@@ -0,0 +1,190 @@
+#include "ReversePlayback.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "MediaIndex.h"
+
+namespace {
+
+//both segments together, enough for ~30 frames of 1080p RGBA
+const size_t MaxBufferedBytes = 256 * 1024 * 1024;
+
+//longer GOPs are split, and every part is decoded from the keyframe
+const unsigned MaxSegmentFrames = 300;
+const unsigned MinSegmentFrames = 2;
+
+//used if media doesn't report frame rate
+const double DefaultFrameDuration = 1000.0 / 25;
+
+const double FpsWindowSeconds = 1.0;
+
+}
+
+ReversePlayback::ReversePlayback() :
+    _active( false ), _frameDuration( DefaultFrameDuration ), _segmentFrames( 0 ),
+    _nextSegmentEnd( 0 ), _decoding( false ), _pendingFrames( 0 ), _decodePosition( 0 ),
+    _shownTime( 0 ), _clock( 0 ), _started( false ), _fpsWindowFrames( 0 ), _fps( 0 )
+{
+}
+
+void ReversePlayback::start( const std::shared_ptr<MediaIndex>& index, double frameDuration,
+                             int64_t time, size_t frameSize )
+{
+    stop();
+
+    _active = true;
+    _index = index;
+    _frameDuration = frameDuration > 0 ? frameDuration : DefaultFrameDuration;
+
+    const size_t fitFrames = frameSize ? MaxBufferedBytes / 2 / frameSize : MaxSegmentFrames;
+    _segmentFrames = static_cast<unsigned>(
+        std::max<size_t>( MinSegmentFrames, std::min<size_t>( fitFrames, MaxSegmentFrames ) ) );
+
+    //the last frame presented at or before time is the shown one
+    _nextSegmentEnd = _index ? _index->frameAt( ( time + 1 ) * 1000 - 1 ) : time;
+
+    _shownTime = time;
+    _clock = static_cast<double>( time );
+    _fps = 0;
+}
+
+void ReversePlayback::stop()
+{
+    _active = false;
+    _index.reset();
+    _decoding = false;
+    _pendingFrames = 0;
+    _decoded.clear();
+    _presented.clear();
+    _started = false;
+    _fpsWindowFrames = 0;
+}
+
+bool ReversePlayback::beginSegment( int64_t* seekTime )
+{
+    if( !_active || _decoding || !_decoded.empty() || _nextSegmentEnd <= 0 )
+        return false;
+
+    if( _index ) {
+        const unsigned end = static_cast<unsigned>( _nextSegmentEnd );
+        const unsigned begin =
+            std::max( _index->keyframeBefore( end - 1 ), end > _segmentFrames ? end - _segmentFrames : 0 );
+
+        _pendingFrames = end - begin;
+        _decodePosition = begin;
+        _nextSegmentEnd = begin;
+        *seekTime = _index->frameTime( begin ) / 1000;
+    } else {
+        const int64_t segmentDuration = static_cast<int64_t>( _segmentFrames * _frameDuration );
+        const int64_t begin = std::max<int64_t>( 0, _nextSegmentEnd - segmentDuration );
+
+        _pendingFrames = std::max( 1u,
+            static_cast<unsigned>( ( _nextSegmentEnd - begin ) / _frameDuration + 0.5 ) );
+        _decodePosition = static_cast<double>( begin );
+        _nextSegmentEnd = begin;
+        *seekTime = begin;
+    }
+
+    _decoding = true;
+
+    return true;
+}
+
+bool ReversePlayback::addFrame( const void* data, size_t size )
+{
+    if( !_decoding )
+        return false;
+
+    Frame frame;
+    if( _index ) {
+        frame.time = _index->frameTime( static_cast<unsigned>( _decodePosition ) ) / 1000;
+        _decodePosition += 1;
+    } else {
+        frame.time = static_cast<int64_t>( _decodePosition );
+        _decodePosition += _frameDuration;
+    }
+
+    frame.buffer = FrameBufferPool::instance().acquire( size );
+    if( frame.buffer.data() ) {
+        memcpy( frame.buffer.data(), data, size );
+        _decoded.push_back( std::move( frame ) );
+    } else {
+        //out of memory, so rest of segment is just skipped
+        _pendingFrames = 1;
+    }
+
+    if( --_pendingFrames > 0 )
+        return true;
+
+    _decoding = false;
+
+    return false;
+}
+
+const ReversePlayback::Frame* ReversePlayback::present( Clock::time_point now, double rate )
+{
+    if( !_active )
+        return nullptr;
+
+    const double elapsed = _started ?
+        std::chrono::duration<double, std::milli>( now - _lastPresent ).count() : 0;
+    if( !_started ) {
+        _started = true;
+        _fpsWindowStart = now;
+    }
+    _lastPresent = now;
+
+    measureFps( now );
+
+    double clock = _clock - elapsed * std::max( rate, 0.0 );
+
+    //shown frame could be in one of the preceding segments
+    while( _presented.empty() || clock < _presented.front().time ) {
+        if( !_decoding && !_decoded.empty() ) {
+            _presented.swap( _decoded );
+            _decoded.clear();
+            continue;
+        }
+
+        //nothing to show yet, so clock doesn't run
+        if( _presented.empty() )
+            return nullptr;
+
+        //decoder is late or media start is reached
+        clock = static_cast<double>( _presented.front().time );
+        break;
+    }
+
+    _clock = clock;
+
+    //frame shown at clock is the last one presented at or before it
+    auto it = std::upper_bound( _presented.begin(), _presented.end(), clock,
+        [] ( double time, const Frame& frame ) { return time < frame.time; } );
+    const Frame& frame = *( it - 1 );
+    if( frame.time >= _shownTime )
+        return nullptr;
+
+    _shownTime = frame.time;
+    ++_fpsWindowFrames;
+
+    return &frame;
+}
+
+bool ReversePlayback::finished() const
+{
+    return _active && _nextSegmentEnd <= 0 && !_decoding && _decoded.empty() &&
+           ( _presented.empty() || _shownTime <= _presented.front().time );
+}
+
+void ReversePlayback::measureFps( Clock::time_point now )
+{
+    const double seconds = std::chrono::duration<double>( now - _fpsWindowStart ).count();
+    if( seconds < FpsWindowSeconds )
+        return;
+
+    _fps = _fpsWindowFrames / seconds;
+    _fpsWindowFrames = 0;
+    _fpsWindowStart = now;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "FrameBufferPool.h"
+
+class MediaIndex;
+
+///////////////////////////////////////////////////////////////////////////////
+// Reverse playback from frames decoded forward. Media is split to segments
+// ending at GOP boundaries (or of fixed duration if there is no index),
+// every segment is decoded from its first frame into memory and presented
+// backwards while the preceding segment is decoded.
+// At most two segments are kept in memory. Should be accessed only from gui thread.
+class ReversePlayback
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame
+    {
+        //milliseconds from media start
+        int64_t time;
+        FrameBufferPool::Buffer buffer;
+    };
+
+    ReversePlayback();
+
+    //time is of the frame shown now, playback starts from the one before it,
+    //index could be null
+    void start( const std::shared_ptr<MediaIndex>& index, double frameDuration,
+                int64_t time, size_t frameSize );
+    void stop();
+
+    bool active() const
+        { return _active; }
+    double frameDuration() const
+        { return _frameDuration; }
+
+    //returns false if segment is decoding already, decoded one waits for presentation
+    //or media start was reached, otherwise decoder should be seeked to seekTime
+    bool beginSegment( int64_t* seekTime );
+    bool decoding() const
+        { return _decoding; }
+    //copies frame shown by decoder, returns true if decoder should step to the next one
+    bool addFrame( const void* data, size_t size );
+
+    //returns frame to show now, or null if the shown one is still actual,
+    //presentation clock waits while decoder is late
+    const Frame* present( Clock::time_point now, double rate );
+    //the first frame of media was shown
+    bool finished() const;
+
+    //frames actually shown per second
+    double fps() const
+        { return _fps; }
+
+private:
+    ReversePlayback( const ReversePlayback& ) = delete;
+    ReversePlayback& operator = ( const ReversePlayback& ) = delete;
+
+    void measureFps( Clock::time_point now );
+
+private:
+    bool _active;
+
+    std::shared_ptr<MediaIndex> _index;
+    double _frameDuration;
+    unsigned _segmentFrames;
+
+    //exclusive end of the next segment to decode,
+    //frame number if there is index, time otherwise
+    int64_t _nextSegmentEnd;
+
+    bool _decoding;
+    unsigned _pendingFrames;
+    //next frame to decode, frame number if there is index, time otherwise
+    double _decodePosition;
+    std::vector<Frame> _decoded;
+
+    //ordered by time
+    std::vector<Frame> _presented;
+    int64_t _shownTime;
+    double _clock;
+    bool _started;
+    Clock::time_point _lastPresent;
+
+    Clock::time_point _fpsWindowStart;
+    unsigned _fpsWindowFrames;
+    double _fps;
+};
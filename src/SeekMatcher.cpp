@@ -0,0 +1,42 @@
+#include "SeekMatcher.h"
+
+SeekMatcher::SeekMatcher() :
+    _sequence( 0 ), _steps( 0 ), _tolerance( 0 ), _timeReported( false )
+{
+}
+
+void SeekMatcher::start( unsigned long long sequence, unsigned steps, int64_t tolerance )
+{
+    _sequence = sequence;
+    _steps = steps;
+    _tolerance = tolerance;
+    _timeReported = false;
+}
+
+void SeekMatcher::timeReported( int64_t time, int64_t target )
+{
+    const int64_t distance = time > target ? time - target : target - time;
+
+    //reported time is rounded the same way as frame time, so it's up to a frame away
+    if( distance <= 2 * _tolerance )
+        _timeReported = true;
+}
+
+bool SeekMatcher::matches( int64_t frameTime, unsigned long long frameSequence, int64_t target ) const
+{
+    if( !displayedAfter( frameSequence ) )
+        return false;
+
+    //every step displays exactly one frame, so the last step gives the seeked one
+    if( _steps > 0 )
+        return frameSequence >= _sequence + _steps;
+
+    const int64_t distance = frameTime > target ? frameTime - target : target - frameTime;
+
+    return _timeReported || distance <= _tolerance;
+}
+
+bool SeekMatcher::matchesReported( unsigned long long frameSequence ) const
+{
+    return 0 == _steps && _timeReported && displayedAfter( frameSequence );
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Tells which frame displayed by paused decoder is the one seek asked for.
+// Decoder could still display frames from before the seek, and the time stamped on the seeked
+// frame could differ from the requested one: position seeks are rounded, and frame could be
+// displayed before libvlc reports time of the seek.
+// Should be accessed only from gui thread.
+class SeekMatcher
+{
+public:
+    SeekMatcher();
+
+    //frames up to sequence were displayed before the seek,
+    //steps > 0 means decoder steps that many frames forward instead of seeking,
+    //otherwise frame within tolerance (ms) from the target is the seeked one
+    void start( unsigned long long sequence, unsigned steps, int64_t tolerance );
+
+    //libvlc reported time after the seek request, times far from the target are not of this seek
+    void timeReported( int64_t time, int64_t target );
+
+    //true if frame is the seeked one
+    bool matches( int64_t frameTime, unsigned long long frameSequence, int64_t target ) const;
+    //true if frame displayed before the time was reported is the seeked one
+    bool matchesReported( unsigned long long frameSequence ) const;
+
+private:
+    bool displayedAfter( unsigned long long frameSequence ) const
+        { return frameSequence > _sequence; }
+
+private:
+    unsigned long long _sequence;
+    unsigned _steps;
+    int64_t _tolerance;
+    bool _timeReported;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixed capacity, allocation free, lock free queue
+// for exactly one producer thread and exactly one consumer thread.
+template<typename T, unsigned Capacity>
+class SpscRing
+{
+    static_assert( Capacity > 0 && 0 == ( Capacity & ( Capacity - 1 ) ),
+                   "Capacity should be power of two" );
+    static_assert( std::is_pod<T>::value,
+                   "SpscRing is intended for POD items only" );
+
+public:
+    SpscRing() :
+        _head( 0 ), _tail( 0 ) {}
+
+    //should be called only from producer thread
+    bool push( const T& item )
+    {
+        const unsigned tail = _tail.load( std::memory_order_relaxed );
+        if( tail - _head.load( std::memory_order_acquire ) == Capacity )
+            return false;
+
+        _items[tail & ( Capacity - 1 )] = item;
+        _tail.store( tail + 1, std::memory_order_release );
+
+        return true;
+    }
+
+    //should be called only from consumer thread
+    bool pop( T* item )
+    {
+        const unsigned head = _head.load( std::memory_order_relaxed );
+        if( head == _tail.load( std::memory_order_acquire ) )
+            return false;
+
+        *item = _items[head & ( Capacity - 1 )];
+        _head.store( head + 1, std::memory_order_release );
+
+        return true;
+    }
+
+    bool empty() const
+    {
+        return _head.load( std::memory_order_acquire ) ==
+               _tail.load( std::memory_order_acquire );
+    }
+
+private:
+    enum { CacheLineSize = 64 };
+
+    //head and tail live on different cache lines to avoid false sharing
+    std::atomic<unsigned> _head;
+    char _headPadding[CacheLineSize - sizeof( std::atomic<unsigned> )];
+    std::atomic<unsigned> _tail;
+    char _tailPadding[CacheLineSize - sizeof( std::atomic<unsigned> )];
+
+    T _items[Capacity];
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <uv.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// libuv keeps using handle until close callback is called,
+// so handles owned by objects which could be destroyed right after closing them
+// are allocated separately and freed from close callback.
+template<typename Handle>
+void CloseUvHandle( Handle** handle )
+{
+    if( !*handle )
+        return;
+
+    ( *handle )->data = nullptr;
+    uv_close( reinterpret_cast<uv_handle_t*>( *handle ),
+        [] ( uv_handle_t* handle ) {
+            delete reinterpret_cast<Handle*>( handle );
+        }
+    );
+
+    //closed exactly once
+    *handle = nullptr;
+}
@@ -3,328 +3,1016 @@
 #include <string.h>
 
 #include <cassert>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "WorkerPool.h"
+#include "MediaIndex.h"
 
 ///////////////////////////////////////////////////////////////////////////////
-VlcVideoOutput::VideoFrame::VideoFrame() :
-    _width( 0 ), _height( 0 ), _size( 0 ),
-    _frameBuffer( nullptr )
+namespace {
+
+// Upper limit for FrameBufferPolicy::Block, to not stall libvlc forever
+// if JS side forgot to release leased frames.
+const std::chrono::milliseconds MaxBlockTime( 500 );
+
+const unsigned NoFrame = static_cast<unsigned>( -1 );
+
+inline void* slotToPicture( unsigned slot )
 {
+    return reinterpret_cast<void*>( static_cast<uintptr_t>( slot ) + 1 );
 }
 
-VlcVideoOutput::VideoFrame::~VideoFrame()
+inline unsigned pictureToSlot( void* picture )
 {
+    return static_cast<unsigned>( reinterpret_cast<uintptr_t>( picture ) - 1 );
 }
 
-void VlcVideoOutput::VideoFrame::waitBuffer()
+}
+
+///////////////////////////////////////////////////////////////////////////////
+VlcVideoOutput::VideoFrame::VideoFrame( PixelFormat pixelFormat, unsigned slotCount, FrameBufferPolicy policy,
+                                        const RGBAConversion& conversion, const OutputGeometry& geometry,
+                                        unsigned rowAlignment ) :
+    _convert( conversion.enabled && PixelFormat::I420 == pixelFormat ),
+    _pixelFormat( _convert ? PixelFormat::RGBA : pixelFormat ),
+    _decodeFormat( pixelFormat ),
+    _width( 0 ), _height( 0 ), _decodeWidth( 0 ), _decodeHeight( 0 ),
+    _rowAlignment( rowAlignment ),
+    _layout(), _decodeLayout(),
+    _geometry( geometry ),
+    _scale( false ), _scaledWidth( 0 ), _scaledHeight( 0 ),
+    _crop( geometry.crop.width > 0 && geometry.crop.height > 0 ),
+    _cropX( 0 ), _cropY( 0 ),
+    _scalerX( 0 ), _scalerY( 0 ), _scaleLayout(),
+    _colorMatrix( conversion.matrix ), _colorRange( conversion.range ),
+    _conversionKernel( _convert ? BestConversionKernel() : ConversionKernel::Scalar ),
+    _coefficients(),
+    _decoded( false ),
+    _ring( slotCount, policy, MaxBlockTime )
+{
+    assert( 0 == ( _rowAlignment & ( _rowAlignment - 1 ) ) && _rowAlignment >= MinRowAlignment );
+}
+
+VlcVideoOutput::VideoFrame::VideoFrame( const VideoFrame& from, const OutputGeometry& geometry,
+                                        unsigned slotCount, FrameBufferPolicy policy ) :
+    VideoFrame( from._decodeFormat, slotCount, policy,
+                { from._convert, from._colorMatrix, from._colorRange },
+                geometry, from._rowAlignment )
 {
-    std::unique_lock<std::mutex> lock( _guard );
-    while( !_frameBuffer )
-        _waiter.wait( lock );
+    setup( from._decodeWidth, from._decodeHeight );
+
+    //decoder could lock picture before frame buffers are set
+    if( !usesDecodeBuffer() )
+        _scratchBuffer = FrameBufferPool::instance().acquire( _decodeLayout.size );
 }
 
-void VlcVideoOutput::VideoFrame::setFrameBuffer( void* frameBuffer )
+VlcVideoOutput::VideoFrame::~VideoFrame()
 {
-    std::unique_lock<std::mutex> lock( _guard );
-    _frameBuffer = frameBuffer;
-    _waiter.notify_one();
 }
 
-void VlcVideoOutput::VideoFrame::video_unlock_cb( void* picture, void *const * planes )
+void VlcVideoOutput::VideoFrame::waitBuffer()
 {
-};
+    _ring.waitBuffers();
+}
 
-void VlcVideoOutput::VideoFrame::video_cleanup_cb()
+void VlcVideoOutput::VideoFrame::setFrameBuffers( const std::vector<void*>& frameBuffers,
+                                                  const FrameInfo* leased )
 {
+    //converted, scaled and cropped frames are always decoded to _decodeBuffer
+    if( frameBuffers.size() > 1 && !usesDecodeBuffer() && !_scratchBuffer.data() )
+        _scratchBuffer = FrameBufferPool::instance().acquire( _decodeLayout.size );
+
+    _ring.setBuffers( frameBuffers, leased );
 }
 
-///////////////////////////////////////////////////////////////////////////////
-unsigned VlcVideoOutput::RV32VideoFrame::video_format_cb( char* chroma,
-                                                          unsigned* width, unsigned* height,
-                                                          unsigned* pitches, unsigned* lines )
+void* VlcVideoOutput::VideoFrame::video_lock_cb( void** planes )
 {
-    _width = *width;
-    _height = *height;
+    char* buffer;
+    const unsigned slot = _ring.acquire( &buffer );
+    if( !buffer )
+        buffer = _scratchBuffer.data();
 
-    memcpy( chroma, vlc::DEF_CHROMA, sizeof( vlc::DEF_CHROMA ) - 1 );
-    *pitches = *width * vlc::DEF_PIXEL_BYTES;
-    *lines = *height;
+    if( usesDecodeBuffer() )
+        buffer = _decodeBuffer.data();
 
-    _size = *pitches * *lines;
+    for( unsigned plane = 0; plane < _decodeLayout.count; ++plane )
+        planes[plane] = buffer + _decodeLayout.offsets[plane];
 
-    return 1;
+    return slotToPicture( slot );
 }
 
-void* VlcVideoOutput::RV32VideoFrame::video_lock_cb( void** planes )
+void VlcVideoOutput::VideoFrame::video_unlock_cb( void* picture )
 {
-    *planes = _frameBuffer;
+    if( !usesDecodeBuffer() )
+        return;
 
-    return nullptr;
+    _decoded = true;
+
+    char* buffer = _ring.buffer( pictureToSlot( picture ) );
+
+    //frame decoded to scratch slot will be dropped, so there is no need to convert it
+    if( !buffer )
+        return;
+
+    //slot is acquired but not displayed yet, so it's not accessible from JS yet
+    present( _decodeBuffer.data(), buffer );
 }
 
-void VlcVideoOutput::RV32VideoFrame::fillBlack()
+void VlcVideoOutput::VideoFrame::present( const char* decoded, char* buffer )
 {
-    if( _frameBuffer ) {
-        memset( _frameBuffer, 0, size() );
+    //origin could be changed concurrently by setCropOrigin()
+    const unsigned cropX = _cropX;
+    const unsigned cropY = _cropY;
+
+    const char* source = decoded;
+    const PlaneLayout* sourceLayout = &_decodeLayout;
+    unsigned x = cropX;
+    unsigned y = cropY;
+
+    if( _scale ) {
+        if( cropX != _scalerX || cropY != _scalerY )
+            ( this->*_decodeLayout.setupScalers )( cropX, cropY );
+
+        if( !_convert ) {
+            scalePlanes( decoded, buffer, _layout );
+            return;
+        }
+
+        //scaled picture is converted as is
+        scalePlanes( decoded, _scaleBuffer.data(), _scaleLayout );
+        source = _scaleBuffer.data();
+        sourceLayout = &_scaleLayout;
+        x = y = 0;
+    } else if( !_convert ) {
+        if( _crop )
+            ( this->*_decodeLayout.copyCrop )( decoded, buffer, cropX, cropY );
+        else
+            memcpy( buffer, decoded, _layout.size );
+        return;
     }
+
+    //crop origin is always even for I420
+    const uint8_t* sourceBuffer = reinterpret_cast<const uint8_t*>( source );
+    const I420Image image = {
+        sourceBuffer + sourceLayout->offsets[0] + y * sourceLayout->pitches[0] + x,
+        sourceLayout->pitches[0],
+        sourceBuffer + sourceLayout->offsets[1] + y / 2 * sourceLayout->pitches[1] + x / 2,
+        sourceLayout->pitches[1],
+        sourceBuffer + sourceLayout->offsets[2] + y / 2 * sourceLayout->pitches[2] + x / 2,
+        sourceLayout->pitches[2],
+    };
+
+    ConvertI420ToRGBA( image,
+                       reinterpret_cast<uint8_t*>( buffer ), _layout.pitches[0],
+                       _width, _height,
+                       _coefficients, _conversionKernel,
+                       &WorkerPool::instance() );
 }
 
-///////////////////////////////////////////////////////////////////////////////
-VlcVideoOutput::I420VideoFrame::I420VideoFrame() :
-    _uPlaneOffset( 0 ), _vPlaneOffset( 0 )
+void VlcVideoOutput::VideoFrame::scalePlanes( const char* source, char* buffer,
+                                              const PlaneLayout& layout )
 {
+    for( unsigned plane = 0; plane < _decodeLayout.count; ++plane ) {
+        _scalers[plane].scale(
+            reinterpret_cast<const uint8_t*>( source + _decodeLayout.offsets[plane] ),
+            _decodeLayout.pitches[plane],
+            reinterpret_cast<uint8_t*>( buffer + layout.offsets[plane] ),
+            layout.pitches[plane],
+            &WorkerPool::instance() );
+    }
 }
 
-unsigned VlcVideoOutput::I420VideoFrame::video_format_cb( char* chroma,
-                                                          unsigned* width, unsigned* height,
-                                                          unsigned* pitches, unsigned* lines )
+bool VlcVideoOutput::VideoFrame::copyPicture( unsigned slot, char* picture, FrameInfo* info )
 {
-    _width = *width;
-    _height = *height;
-
-    const char CHROMA[] = "I420";
-
-    memcpy( chroma, CHROMA, sizeof( CHROMA ) - 1 );
+    if( !_ring.displayedInfo( slot, info ) )
+        return false;
 
-    const unsigned evenWidth = *width + ( *width & 1 );
-    const unsigned evenHeight = *height + ( *height & 1 );
+    if( usesDecodeBuffer() ) {
+        //the latest decoded picture, it's not older than the one in slot
+        if( !_decoded )
+            return false;
+        memcpy( picture, _decodeBuffer.data(), _decodeLayout.size );
+    } else {
+        memcpy( picture, _ring.buffer( slot ), _decodeLayout.size );
+    }
 
-    pitches[0] = evenWidth; if( pitches[0] % 4 ) pitches[0] += 4 - pitches[0] % 4;
-    pitches[1] = evenWidth / 2; if( pitches[1] % 4 ) pitches[1] += 4 - pitches[1] % 4;
-    pitches[2] = pitches[1];
+    return true;
+}
 
-    assert( 0 == pitches[0] % 4 && 0 == pitches[1] % 4 && 0 == pitches[2] % 4 );
+bool VlcVideoOutput::VideoFrame::video_display_cb( void* picture, const FrameInfo& info )
+{
+    return _ring.display( pictureToSlot( picture ), info );
+}
 
-    lines[0] = evenHeight;
-    lines[1] = evenHeight / 2;
-    lines[2] = lines[1];
+void VlcVideoOutput::VideoFrame::video_cleanup_cb()
+{
+}
 
-    _uPlaneOffset = pitches[0] * lines[0];
-    _vPlaneOffset = _uPlaneOffset + pitches[1] * lines[1];
+bool VlcVideoOutput::VideoFrame::leaseReadyFrame( unsigned* slot, FrameInfo* info )
+{
+    return _ring.lease( slot, info );
+}
 
-    _size = pitches[0] * lines[0] +
-            pitches[1] * lines[1] +
-            pitches[2] * lines[2];
+void VlcVideoOutput::VideoFrame::releaseFrame( unsigned slot )
+{
+    _ring.release( slot );
+}
 
-    return 3;
+void VlcVideoOutput::VideoFrame::releaseAllFrames()
+{
+    _ring.releaseAll();
 }
 
-void* VlcVideoOutput::I420VideoFrame::video_lock_cb( void** planes )
+void VlcVideoOutput::VideoFrame::setCropOrigin( unsigned x, unsigned y )
 {
-    char* buffer = static_cast<char*>( _frameBuffer );
+    if( !_crop )
+        return;
 
-    planes[0] = buffer;
-    planes[1] = buffer + _uPlaneOffset;
-    planes[2] = buffer + _vPlaneOffset;
+    x = std::min( x, _scaledWidth - _width );
+    y = std::min( y, _scaledHeight - _height );
 
-    return nullptr;
+    //scaled region could start anywhere
+    if( _decodeLayout.subsampled && !_scale ) {
+        x &= ~1u;
+        y &= ~1u;
+    }
+
+    _cropX = x;
+    _cropY = y;
 }
 
-void VlcVideoOutput::I420VideoFrame::video_unlock_cb( void * picture, void * const * planes )
+unsigned VlcVideoOutput::VideoFrame::takeSkippedFrames()
 {
-    VideoFrame::video_unlock_cb( picture, planes );
+    return _ring.takeSkippedFrames();
 }
 
-void VlcVideoOutput::I420VideoFrame::fillBlack()
+void VlcVideoOutput::VideoFrame::fillBlack()
 {
-    if( _frameBuffer ) {
-        char* buffer = static_cast<char*>( _frameBuffer );
-        memset( buffer, 0x0, _uPlaneOffset );
-        memset( buffer + _uPlaneOffset, 0x80, _vPlaneOffset - _uPlaneOffset );
-        memset( buffer + _vPlaneOffset, 0x80, size() - _vPlaneOffset );
+    if( !_layout.fillBlack )
+        return;
+
+    for( unsigned slot = 0; slot < _ring.slotCount(); ++slot ) {
+        if( char* buffer = _ring.buffer( slot ) )
+            ( this->*_layout.fillBlack )( buffer );
     }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::VideoEvent
-{
-    virtual void process( VlcVideoOutput* ) = 0;
+// Every specialization describes one pixel format:
+// chroma passed to libvlc, plane count, minimal pitch and line count of every plane,
+// bytes per sample of every plane (interleaved channels are scaled independently),
+// and how plane should be filled to get black picture.
+// EvenSize means chroma planes are subsampled, so luma plane size should be rounded up to even.
+
+template<>
+struct VlcVideoOutput::FormatTraits<VlcVideoOutput::PixelFormat::RV32>
+{
+    enum { PlaneCount = 1, EvenSize = 0 };
+
+    static const char* chroma()
+        { return vlc::DEF_CHROMA; }
+    static unsigned pitch( unsigned /*plane*/, unsigned width )
+        { return width * vlc::DEF_PIXEL_BYTES; }
+    static unsigned sampleBytes( unsigned /*plane*/ )
+        { return vlc::DEF_PIXEL_BYTES; }
+    static unsigned lines( unsigned /*plane*/, unsigned height )
+        { return height; }
+    static void fillBlack( unsigned /*plane*/, char* buffer, unsigned size )
+        { memset( buffer, 0, size ); }
 };
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::RV32FrameSetupEvent : public VlcVideoOutput::VideoEvent
-{
-    RV32FrameSetupEvent( const std::shared_ptr<RV32VideoFrame>& videoFrame ) :
-        _videoFrame( videoFrame ) {}
+template<>
+struct VlcVideoOutput::FormatTraits<VlcVideoOutput::PixelFormat::RGBA>
+{
+    enum { PlaneCount = 1, EvenSize = 0 };
+
+    static const char* chroma()
+        { return "RGBA"; }
+    static unsigned pitch( unsigned /*plane*/, unsigned width )
+        { return width * 4; }
+    static unsigned sampleBytes( unsigned /*plane*/ )
+        { return 4; }
+    static unsigned lines( unsigned /*plane*/, unsigned height )
+        { return height; }
+    //opaque black, to be usable as Canvas ImageData as is
+    static void fillBlack( unsigned /*plane*/, char* buffer, unsigned size )
+    {
+        memset( buffer, 0, size );
+        for( unsigned i = 3; i < size; i += 4 )
+            buffer[i] = '\xFF';
+    }
+};
 
-    void process( VlcVideoOutput* ) override;
+template<>
+struct VlcVideoOutput::FormatTraits<VlcVideoOutput::PixelFormat::I420>
+{
+    enum { PlaneCount = 3, EvenSize = 1 };
+
+    static const char* chroma()
+        { return "I420"; }
+    static unsigned pitch( unsigned plane, unsigned width )
+        { return 0 == plane ? width : width / 2; }
+    static unsigned sampleBytes( unsigned /*plane*/ )
+        { return 1; }
+    static unsigned lines( unsigned plane, unsigned height )
+        { return 0 == plane ? height : height / 2; }
+    static void fillBlack( unsigned plane, char* buffer, unsigned size )
+        { memset( buffer, 0 == plane ? 0x0 : 0x80, size ); }
+};
 
-    std::weak_ptr<RV32VideoFrame> _videoFrame;
+template<>
+struct VlcVideoOutput::FormatTraits<VlcVideoOutput::PixelFormat::NV12>
+{
+    enum { PlaneCount = 2, EvenSize = 1 };
+
+    static const char* chroma()
+        { return "NV12"; }
+    //second plane is interleaved UV with half resolution, so it has the same pitch
+    static unsigned pitch( unsigned /*plane*/, unsigned width )
+        { return width; }
+    static unsigned sampleBytes( unsigned plane )
+        { return 0 == plane ? 1 : 2; }
+    static unsigned lines( unsigned plane, unsigned height )
+        { return 0 == plane ? height : height / 2; }
+    static void fillBlack( unsigned plane, char* buffer, unsigned size )
+        { memset( buffer, 0 == plane ? 0x0 : 0x80, size ); }
 };
 
-void VlcVideoOutput::RV32FrameSetupEvent::process( VlcVideoOutput* videoOutput )
+template<>
+struct VlcVideoOutput::FormatTraits<VlcVideoOutput::PixelFormat::GREY>
+{
+    enum { PlaneCount = 1, EvenSize = 0 };
+
+    static const char* chroma()
+        { return "GREY"; }
+    static unsigned pitch( unsigned /*plane*/, unsigned width )
+        { return width; }
+    static unsigned sampleBytes( unsigned /*plane*/ )
+        { return 1; }
+    static unsigned lines( unsigned /*plane*/, unsigned height )
+        { return height; }
+    static void fillBlack( unsigned /*plane*/, char* buffer, unsigned size )
+        { memset( buffer, 0x0, size ); }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+template<typename Traits>
+const char* VlcVideoOutput::VideoFrame::setupLayout( unsigned width, unsigned height,
+                                                     PlaneLayout* layout ) const
 {
-    std::shared_ptr<RV32VideoFrame> videoFrame = _videoFrame.lock();
+    static_assert( Traits::PlaneCount <= MaxPlanes, "Too many planes" );
 
-    if( !videoFrame )
-        return;
+    const unsigned planeWidth = Traits::EvenSize ? width + ( width & 1 ) : width;
+    const unsigned planeHeight = Traits::EvenSize ? height + ( height & 1 ) : height;
+
+    layout->size = 0;
+    for( unsigned plane = 0; plane < Traits::PlaneCount; ++plane ) {
+        unsigned pitch = Traits::pitch( plane, planeWidth );
+        pitch = ( pitch + _rowAlignment - 1 ) & ~( _rowAlignment - 1 );
+
+        assert( 0 == pitch % 4 );
 
-    videoOutput->_currentVideoFrame = videoFrame;
+        layout->offsets[plane] = layout->size;
+        layout->pitches[plane] = pitch;
+        layout->lines[plane] = Traits::lines( plane, planeHeight );
 
-    void* buffer = videoOutput->onFrameSetup( *videoFrame );
-    if( buffer )
-        videoFrame->setFrameBuffer( buffer );
+        layout->size += layout->pitches[plane] * layout->lines[plane];
+    }
+
+    layout->count = Traits::PlaneCount;
+    layout->chroma = Traits::chroma();
+    layout->subsampled = 0 != Traits::EvenSize;
+    layout->fillBlack = &VideoFrame::fillBlack<Traits>;
+    layout->copyCrop = &VideoFrame::copyCrop<Traits>;
+    layout->setupScalers = &VideoFrame::setupScalers<Traits>;
+
+    return Traits::chroma();
 }
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::I420FrameSetupEvent : public VlcVideoOutput::VideoEvent
+template<typename Traits>
+void VlcVideoOutput::VideoFrame::fillBlack( char* buffer ) const
 {
-    I420FrameSetupEvent( const std::shared_ptr<I420VideoFrame>& videoFrame ) :
-        _videoFrame( videoFrame ) {}
+    for( unsigned plane = 0; plane < Traits::PlaneCount; ++plane ) {
+        Traits::fillBlack( plane,
+                           buffer + _layout.offsets[plane],
+                           _layout.pitches[plane] * _layout.lines[plane] );
+    }
+}
 
-    void process( VlcVideoOutput* ) override;
+//pitch() and lines() of traits are used also to get byte offset of column and row in every plane
+template<typename Traits>
+void VlcVideoOutput::VideoFrame::copyCrop( const char* source, char* buffer,
+                                           unsigned x, unsigned y ) const
+{
+    for( unsigned plane = 0; plane < Traits::PlaneCount; ++plane ) {
+        const unsigned sourcePitch = _decodeLayout.pitches[plane];
+        const unsigned pitch = _layout.pitches[plane];
+        const unsigned rowSize = Traits::pitch( plane, _width );
 
-    std::weak_ptr<I420VideoFrame> _videoFrame;
-};
+        const char* from = source + _decodeLayout.offsets[plane] +
+                           Traits::lines( plane, y ) * sourcePitch + Traits::pitch( plane, x );
+        char* to = buffer + _layout.offsets[plane];
+
+        for( unsigned line = 0; line < _layout.lines[plane]; ++line ) {
+            memcpy( to, from, rowSize );
+            from += sourcePitch;
+            to += pitch;
+        }
+    }
+}
 
-void VlcVideoOutput::I420FrameSetupEvent::process( VlcVideoOutput* videoOutput )
+template<typename Traits>
+void VlcVideoOutput::VideoFrame::setupScalers( unsigned x, unsigned y )
 {
-    std::shared_ptr<I420VideoFrame> videoFrame = _videoFrame.lock();
+    const unsigned planeWidth = Traits::EvenSize ? _decodeWidth + ( _decodeWidth & 1 ) : _decodeWidth;
+    const unsigned planeHeight = Traits::EvenSize ? _decodeHeight + ( _decodeHeight & 1 ) : _decodeHeight;
+    const unsigned width = Traits::EvenSize ? _width + ( _width & 1 ) : _width;
+    const unsigned height = Traits::EvenSize ? _height + ( _height & 1 ) : _height;
 
-    if( !videoFrame )
-        return;
+    //decoded samples per scaled sample
+    const double scaleX = static_cast<double>( _decodeWidth ) / _scaledWidth;
+    const double scaleY = static_cast<double>( _decodeHeight ) / _scaledHeight;
+
+    for( unsigned plane = 0; plane < Traits::PlaneCount; ++plane ) {
+        const unsigned sampleBytes = Traits::sampleBytes( plane );
+        const unsigned sourceWidth = Traits::pitch( plane, planeWidth ) / sampleBytes;
+        const unsigned sourceHeight = Traits::lines( plane, planeHeight );
+
+        //chroma planes are subsampled
+        const double planeScaleX = scaleX * sourceWidth / planeWidth;
+        const double planeScaleY = scaleY * sourceHeight / planeHeight;
 
-    videoOutput->_currentVideoFrame = videoFrame;
+        _scalers[plane].setup( sampleBytes, sourceWidth, sourceHeight,
+                               x * planeScaleX, y * planeScaleY,
+                               width * planeScaleX, height * planeScaleY,
+                               Traits::pitch( plane, width ) / sampleBytes,
+                               Traits::lines( plane, height ) );
+    }
 
-    void* buffer = videoOutput->onFrameSetup( *videoFrame );
-    if( buffer )
-        videoFrame->setFrameBuffer( buffer );
+    _scalerX = x;
+    _scalerY = y;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::FrameReadyEvent : public VlcVideoOutput::VideoEvent
+const char* VlcVideoOutput::VideoFrame::setupLayout( PixelFormat pixelFormat,
+                                                     unsigned width, unsigned height,
+                                                     PlaneLayout* layout ) const
 {
-    void process( VlcVideoOutput* ) override;
-};
+    switch( pixelFormat ) {
+        case PixelFormat::RV32:
+            return setupLayout<FormatTraits<PixelFormat::RV32> >( width, height, layout );
+        case PixelFormat::I420:
+            return setupLayout<FormatTraits<PixelFormat::I420> >( width, height, layout );
+        case PixelFormat::RGBA:
+            return setupLayout<FormatTraits<PixelFormat::RGBA> >( width, height, layout );
+        case PixelFormat::NV12:
+            return setupLayout<FormatTraits<PixelFormat::NV12> >( width, height, layout );
+        case PixelFormat::GREY:
+            return setupLayout<FormatTraits<PixelFormat::GREY> >( width, height, layout );
+    }
+
+    assert( false );
+    return nullptr;
+}
 
-void VlcVideoOutput::FrameReadyEvent::process( VlcVideoOutput* videoOutput )
+bool VlcVideoOutput::VideoFrame::setup( unsigned decodeWidth, unsigned decodeHeight )
 {
-    if( videoOutput->_waitingFrame.test_and_set() ) //FIXME! use memory_order
-        return;
+    _decodeWidth = decodeWidth;
+    _decodeHeight = decodeHeight;
+
+    if( !setupLayout( _decodeFormat, _decodeWidth, _decodeHeight, &_decodeLayout ) )
+        return false;
+
+    _scaledWidth = _decodeWidth;
+    _scaledHeight = _decodeHeight;
+    fitOutputSize( _geometry, &_scaledWidth, &_scaledHeight );
+    _scale = _scaledWidth != _decodeWidth || _scaledHeight != _decodeHeight;
 
-    videoOutput->onFrameReady();
+    _width = _scaledWidth;
+    _height = _scaledHeight;
+    if( _crop ) {
+        _width = std::min( _geometry.crop.width, _scaledWidth );
+        _height = std::min( _geometry.crop.height, _scaledHeight );
+        if( _decodeLayout.subsampled ) {
+            _width = std::max( 2u, _width & ~1u );
+            _height = std::max( 2u, _height & ~1u );
+        }
+        setCropOrigin( _geometry.crop.x, _geometry.crop.y );
+    }
+
+    if( usesDecodeBuffer() ) {
+        setupLayout( _pixelFormat, _width, _height, &_layout );
+        _decodeBuffer = FrameBufferPool::instance().acquire( _decodeLayout.size );
+    } else {
+        _layout = _decodeLayout;
+    }
+
+    if( _scale ) {
+        ( this->*_decodeLayout.setupScalers )( _cropX, _cropY );
+        if( _convert ) {
+            setupLayout( _decodeFormat, _width, _height, &_scaleLayout );
+            _scaleBuffer = FrameBufferPool::instance().acquire( _scaleLayout.size );
+        }
+    }
+
+    if( _convert )
+        _coefficients = MakeYuvToRgbCoefficients( _colorMatrix, _colorRange, _decodeHeight );
+
+    return true;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-struct VlcVideoOutput::FrameCleanupEvent : public VlcVideoOutput::VideoEvent
+bool VlcVideoOutput::VideoFrame::hasShape( const OutputGeometry& geometry ) const
 {
-    void process( VlcVideoOutput* ) override;
-};
+    return geometry.width == _geometry.width && geometry.height == _geometry.height &&
+           geometry.keepAspect == _geometry.keepAspect &&
+           geometry.crop.width == _geometry.crop.width &&
+           geometry.crop.height == _geometry.crop.height;
+}
 
-void VlcVideoOutput::FrameCleanupEvent::process( VlcVideoOutput* videoOutput )
+unsigned VlcVideoOutput::VideoFrame::video_format_cb( char* chroma,
+                                                      unsigned* width, unsigned* height,
+                                                      unsigned* pitches, unsigned* lines )
 {
-    if( videoOutput->_currentVideoFrame ) {
-        videoOutput->onFrameCleanup();
-        videoOutput->_currentVideoFrame.reset();
+    if( !setup( *width, *height ) )
+        return 0;
+
+    memcpy( chroma, _decodeLayout.chroma, 4 );
+
+    for( unsigned plane = 0; plane < _decodeLayout.count; ++plane ) {
+        pitches[plane] = _decodeLayout.pitches[plane];
+        lines[plane] = _decodeLayout.lines[plane];
     }
+
+    return _decodeLayout.count;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+const unsigned VlcVideoOutput::MaxFrameBufferCount;
+const unsigned VlcVideoOutput::MinRowAlignment;
+const unsigned VlcVideoOutput::MaxRowAlignment;
+
 VlcVideoOutput::VlcVideoOutput() :
-    _pixelFormat( PixelFormat::I420 )
+    _pixelFormat( PixelFormat::I420 ),
+    _frameBufferCount( 1 ),
+    _frameBufferPolicy( FrameBufferPolicy::DropOldest ),
+    _rowAlignment( MinRowAlignment ),
+    _rgbaConversion( false ),
+    _colorMatrix( ColorMatrix::Auto ),
+    _colorRange( ColorRange::Limited ),
+    _clock( { -1, std::chrono::steady_clock::time_point(), 1.0f, false } ),
+    _displaySequence( 0 ),
+    _displayFrame( NoFrame ),
+    _geometry( { 0, 0, true, { 0, 0, 0, 0 } } ),
+    _currentFrameSlot( 0 )
 {
     uv_loop_t* loop = uv_default_loop();
 
-    uv_async_init( loop, &_async,
+    _async = new uv_async_t;
+    uv_async_init( loop, _async,
         [] ( uv_async_t* handle ) {
             if( handle->data )
                 reinterpret_cast<VlcVideoOutput*>( handle->data )->handleAsync();
         }
     );
-    _async.data = this;
-
-    _waitingFrame.test_and_set(); //FIXME! use memory_order
+    _async->data = this;
 }
 
 VlcVideoOutput::~VlcVideoOutput()
 {
-    uv_close( reinterpret_cast<uv_handle_t*>( &_async ), 0 );
-    _async.data = nullptr;
+    CloseUvHandle( &_async );
+}
+
+bool VlcVideoOutput::open( vlc::basic_player* player )
+{
+    return vlc::basic_vmem_wrapper::open( player );
+}
+
+void VlcVideoOutput::close()
+{
+    //decoder could wait for leased frames
+    releaseAllFrames();
+
+    vlc::basic_vmem_wrapper::close();
+}
+
+void VlcVideoOutput::setFrameBufferCount( unsigned count )
+{
+    _frameBufferCount = std::max( 1u, std::min( count, MaxFrameBufferCount ) );
+}
+
+void VlcVideoOutput::setRowAlignment( unsigned alignment )
+{
+    if( alignment < MinRowAlignment || alignment > MaxRowAlignment ||
+        0 != ( alignment & ( alignment - 1 ) ) )
+    {
+        return;
+    }
+
+    _rowAlignment = alignment;
+}
+
+void VlcVideoOutput::copyOutputSettings( VlcVideoOutput& from )
+{
+    _pixelFormat = from._pixelFormat;
+    _rowAlignment = from._rowAlignment.load();
+    _rgbaConversion = from._rgbaConversion.load();
+    _colorMatrix = from._colorMatrix.load();
+    _colorRange = from._colorRange.load();
+
+    OutputGeometry geometry;
+    {
+        std::lock_guard<std::mutex> lock( from._geometryGuard );
+        geometry = from._geometry;
+    }
+
+    std::lock_guard<std::mutex> lock( _geometryGuard );
+    _geometry = geometry;
+}
+
+bool VlcVideoOutput::setOutputSize( unsigned width, unsigned height, bool keepAspect )
+{
+    std::lock_guard<std::mutex> lock( _geometryGuard );
+
+    if( width == _geometry.width && height == _geometry.height && keepAspect == _geometry.keepAspect )
+        return false;
+
+    _geometry.width = width;
+    _geometry.height = height;
+    _geometry.keepAspect = keepAspect;
+
+    return true;
+}
+
+bool VlcVideoOutput::setCropRegion( unsigned x, unsigned y, unsigned width, unsigned height )
+{
+    std::lock_guard<std::mutex> lock( _geometryGuard );
+
+    if( 0 == width || 0 == height )
+        x = y = width = height = 0;
+
+    const bool resized = width != _geometry.crop.width || height != _geometry.crop.height;
+
+    _geometry.crop.x = x;
+    _geometry.crop.y = y;
+    _geometry.crop.width = width;
+    _geometry.crop.height = height;
+
+    //panning doesn't change frame size, so there is no need to recreate frame
+    if( !resized && _currentVideoFrame )
+        _currentVideoFrame->setCropOrigin( x, y );
+
+    return resized;
+}
+
+void VlcVideoOutput::fitOutputSize( const OutputGeometry& geometry, unsigned* width, unsigned* height )
+{
+    if( 0 == geometry.width || 0 == geometry.height || 0 == *width || 0 == *height )
+        return;
+
+    if( !geometry.keepAspect ) {
+        *width = geometry.width;
+        *height = geometry.height;
+        return;
+    }
+
+    const double scale =
+        std::min( static_cast<double>( geometry.width ) / *width,
+                  static_cast<double>( geometry.height ) / *height );
+
+    //with kept aspect ratio video is never upscaled
+    if( scale >= 1.0 )
+        return;
+
+    *width = std::max( 1u, std::min( geometry.width, static_cast<unsigned>( *width * scale + 0.5 ) ) );
+    *height = std::max( 1u, std::min( geometry.height, static_cast<unsigned>( *height * scale + 0.5 ) ) );
 }
 
 unsigned VlcVideoOutput::video_format_cb( char* chroma,
                                           unsigned* width, unsigned* height,
                                           unsigned* pitches, unsigned* lines )
 {
-    std::unique_ptr<VideoEvent> frameSetupEvent;
-    switch( _pixelFormat ) {
-        case PixelFormat::RV32: {
-            std::shared_ptr<RV32VideoFrame> videoFrame( new RV32VideoFrame() );
-            frameSetupEvent.reset( new RV32FrameSetupEvent( videoFrame ) );
-            _videoFrame = videoFrame;
-            break;
-        }
-        case PixelFormat::I420:
-        default: {
-            std::shared_ptr<I420VideoFrame> videoFrame( new I420VideoFrame() );
-            frameSetupEvent.reset( new I420FrameSetupEvent( videoFrame ) );
-            _videoFrame = videoFrame;
-            break;
-        }
-    }
+    const unsigned frameBufferCount = _frameBufferCount;
+    const FrameBufferPolicy frameBufferPolicy = _frameBufferPolicy;
+
+    OutputGeometry geometry;
+    _geometryGuard.lock();
+    geometry = _geometry;
+    _geometryGuard.unlock();
+
+    const RGBAConversion conversion = { _rgbaConversion, _colorMatrix, _colorRange };
 
-    const unsigned planeCount = _videoFrame->video_format_cb( chroma,
-                                                              width, height,
-                                                              pitches, lines );
+    //decoder always outputs source size, so geometry changes don't need new video output,
+    //VideoFrame scales and crops decoded pictures itself
+    std::shared_ptr<VideoFrame> videoFrame(
+        new VideoFrame( _pixelFormat, frameBufferCount, frameBufferPolicy,
+                        conversion, geometry, _rowAlignment ) );
 
-    _guard.lock();
-    _videoEvents.push_back( std::move( frameSetupEvent ) );
-    _guard.unlock();
-    uv_async_send( &_async );
+    const unsigned planeCount = videoFrame->video_format_cb( chroma,
+                                                             width, height,
+                                                             pitches, lines );
 
-    _videoFrame->waitBuffer();
+    _frameSwapGuard.lock();
+    _videoFrame = videoFrame;
+    _frameSwapGuard.unlock();
+
+    std::atomic_store( &_setupVideoFrame, videoFrame );
+
+    const VideoEvent frameSetupEvent = { VideoEvent::FrameSetup };
+    pushEvent( frameSetupEvent );
+
+    videoFrame->waitBuffer();
 
     return planeCount;
 }
 
 void VlcVideoOutput::video_cleanup_cb()
 {
-    _videoFrame->video_cleanup_cb();
+    _frameSwapGuard.lock();
+    std::shared_ptr<VideoFrame> videoFrame = _videoFrame;
+    _frameSwapGuard.unlock();
+
+    videoFrame->video_cleanup_cb();
+    _lockedVideoFrame.reset();
 
-    _guard.lock();
-    _videoEvents.emplace_back( new FrameCleanupEvent );
-    _guard.unlock();
-    uv_async_send( &_async );
+    const VideoEvent frameCleanupEvent = { VideoEvent::FrameCleanup };
+    pushEvent( frameCleanupEvent );
 }
 
 void* VlcVideoOutput::video_lock_cb( void** planes )
 {
-    return _videoFrame->video_lock_cb( planes );
+    //released in video_unlock_cb(), vmem always calls both for every picture
+    _frameSwapGuard.lock();
+    _lockedVideoFrame = _videoFrame;
+
+    return _lockedVideoFrame->video_lock_cb( planes );
+}
+
+void VlcVideoOutput::video_unlock_cb( void* picture, void *const * /*planes*/ )
+{
+    _lockedVideoFrame->video_unlock_cb( picture );
+
+    _frameSwapGuard.unlock();
+}
+
+void VlcVideoOutput::video_display_cb( void* picture )
+{
+    //sequence is incremented even for skipped pictures to make them visible as gaps
+    const FrameInfo info = { samplePlaybackTime(), ++_displaySequence };
+
+    //frame could be already reshaped, then picture is just skipped
+    if( _lockedVideoFrame->video_display_cb( picture, info ) )
+        notifyFrameReady();
+}
+
+void VlcVideoOutput::setPlaybackTime( libvlc_time_t time )
+{
+    std::lock_guard<std::mutex> lock( _clockGuard );
+
+    _clock.time = time;
+    _clock.changed = std::chrono::steady_clock::now();
+}
+
+void VlcVideoOutput::setPlaybackPlaying( bool playing )
+{
+    std::lock_guard<std::mutex> lock( _clockGuard );
+
+    if( playing == _clock.playing )
+        return;
+
+    //extrapolation starts from the moment playback was resumed
+    _clock.playing = playing;
+    _clock.changed = std::chrono::steady_clock::now();
+}
+
+void VlcVideoOutput::setPlaybackRate( float rate )
+{
+    std::lock_guard<std::mutex> lock( _clockGuard );
+
+    _clock.rate = rate;
 }
 
-void VlcVideoOutput::video_unlock_cb( void* picture, void *const * planes )
+void VlcVideoOutput::setFrameIndex( const std::shared_ptr<MediaIndex>& index )
 {
-    _videoFrame->video_unlock_cb( picture, planes );
+    std::lock_guard<std::mutex> lock( _clockGuard );
+
+    _frameIndex = index;
 }
 
-void VlcVideoOutput::video_display_cb( void* /*picture*/ )
+libvlc_time_t VlcVideoOutput::samplePlaybackTime()
 {
-    notifyFrameReady();
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    PlaybackClock clock;
+    std::shared_ptr<MediaIndex> index;
+    _clockGuard.lock();
+    clock = _clock;
+    index = _frameIndex;
+    _clockGuard.unlock();
+
+    if( index != _displayIndex ) {
+        _displayIndex = index;
+        _displayFrame = NoFrame;
+    }
+
+    if( clock.time < 0 )
+        return clock.time;
+
+    libvlc_time_t time = clock.time;
+    if( clock.playing ) {
+        //libvlc updates time only a few times per second,
+        //so it's extrapolated in between to get distinct time for every picture
+        const std::chrono::milliseconds::rep elapsed =
+            std::chrono::duration_cast<std::chrono::milliseconds>( now - clock.changed ).count();
+        time += static_cast<libvlc_time_t>( elapsed * clock.rate );
+    }
+
+    if( !index || 0 == index->frameCount() )
+        return time;
+
+    //index times are in microseconds
+    const int64_t estimate = time * 1000;
+    const unsigned frameCount = index->frameCount();
+
+    unsigned frame = index->frameAt( estimate );
+    if( frame + 1 < frameCount &&
+        index->frameTime( frame + 1 ) - estimate < estimate - index->frameTime( frame ) )
+    {
+        ++frame;
+    }
+
+    //while playing every picture is the next frame as long as estimate is within
+    //one frame from it, so extrapolation jitter never repeats or skips frame times
+    if( clock.playing && NoFrame != _displayFrame && _displayFrame + 1 < frameCount ) {
+        const unsigned next = _displayFrame + 1;
+        const int64_t duration = index->frameTime( next ) - index->frameTime( _displayFrame );
+        const int64_t distance = index->frameTime( next ) - estimate;
+        if( distance <= duration && -distance <= duration )
+            frame = next;
+    }
+
+    _displayFrame = frame;
+
+    return index->frameTime( frame ) / 1000;
 }
 
 void VlcVideoOutput::notifyFrameReady()
 {
-    _waitingFrame.clear(); //FIXME! use memory_order
+    //only first frame since last delivery queues event
+    if( !_frameCoalescer.frameDisplayed() )
+        return;
 
-    _guard.lock();
-    _videoEvents.emplace_back( new FrameReadyEvent );
-    _guard.unlock();
-    uv_async_send( &_async );
+    //if queue is full gui thread is behind anyway, it will pick up
+    //pending frames with handleAsync() after draining the queue
+    const VideoEvent frameReadyEvent = { VideoEvent::FrameReady };
+    if( _videoEvents.push( frameReadyEvent ) )
+        uv_async_send( _async );
+}
+
+void VlcVideoOutput::pushEvent( const VideoEvent& event )
+{
+    //frame setup and cleanup events should never be lost,
+    //but since only few events could be in flight it's not expected to wait here
+    while( !_videoEvents.push( event ) ) {
+        uv_async_send( _async );
+        std::this_thread::yield();
+    }
+
+    uv_async_send( _async );
 }
 
 void VlcVideoOutput::handleAsync()
 {
-    while( !_videoEvents.empty() ) {
-        std::deque<std::unique_ptr<VideoEvent> > tmpEvents;
-        _guard.lock();
-        _videoEvents.swap( tmpEvents );
-        _guard.unlock();
-        for( const auto& i: tmpEvents ) {
-            i->process( this );
+    VideoEvent event;
+    while( _videoEvents.pop( &event ) ) {
+        switch( event.type ) {
+            case VideoEvent::FrameSetup:
+                handleFrameSetup();
+                break;
+            case VideoEvent::FrameReady:
+                deliverReadyFrame();
+                break;
+            case VideoEvent::FrameCleanup:
+                _frameCoalescer.discard();
+                if( _currentVideoFrame ) {
+                    _currentVideoFrame->releaseAllFrames();
+                    onFrameCleanup();
+                    _currentVideoFrame.reset();
+                }
+                break;
         }
     }
+
+    //FrameReady event could be dropped by full queue
+    if( _frameCoalescer.pending() )
+        deliverReadyFrame();
+}
+
+void VlcVideoOutput::handleFrameSetup()
+{
+    std::shared_ptr<VideoFrame> videoFrame =
+        std::atomic_exchange( &_setupVideoFrame, std::shared_ptr<VideoFrame>() );
+
+    if( !videoFrame )
+        return;
+
+    _currentVideoFrame = videoFrame;
+    _currentFrameSlot = 0;
+
+    const std::vector<void*> buffers = onFrameSetup( *videoFrame );
+
+    if( buffers.size() == videoFrame->slotCount() )
+        videoFrame->setFrameBuffers( buffers );
+
+    OutputGeometry geometry;
+    _geometryGuard.lock();
+    geometry = _geometry;
+    _geometryGuard.unlock();
+
+    //geometry could be changed after decoder picked it up
+    if( videoFrame->hasShape( geometry ) )
+        videoFrame->setCropOrigin( geometry.crop.x, geometry.crop.y );
+    else
+        reshapeVideoFrame();
+}
+
+bool VlcVideoOutput::reshapeVideoFrame()
+{
+    if( !_currentVideoFrame )
+        return false;
+
+    OutputGeometry geometry;
+    _geometryGuard.lock();
+    geometry = _geometry;
+    _geometryGuard.unlock();
+
+    std::shared_ptr<VideoFrame> videoFrame(
+        new VideoFrame( *_currentVideoFrame, geometry, _frameBufferCount, _frameBufferPolicy ) );
+
+    FrameBufferPool::Buffer picture =
+        FrameBufferPool::instance().acquire( _currentVideoFrame->_decodeLayout.size );
+    FrameInfo info = { -1, 0 };
+    bool hasPicture;
+
+    //decoder could wait for leased frames with _frameSwapGuard locked
+    _currentVideoFrame->releaseAllFrames();
+
+    _frameSwapGuard.lock();
+    //decoder already set up another frame, it will get here with FrameSetup event
+    if( _videoFrame != _currentVideoFrame ) {
+        _frameSwapGuard.unlock();
+        return false;
+    }
+    hasPicture = _currentVideoFrame->copyPicture( _currentFrameSlot, picture.data(), &info );
+    _videoFrame = videoFrame;
+    _frameSwapGuard.unlock();
+
+    _currentVideoFrame = videoFrame;
+    _currentFrameSlot = 0;
+
+    const std::vector<void*> buffers = onFrameSetup( *videoFrame );
+    if( buffers.size() != videoFrame->slotCount() )
+        return false;
+
+    //new slots are not accessible from decoder until setFrameBuffers()
+    if( hasPicture )
+        videoFrame->present( picture.data(), static_cast<char*>( buffers[0] ) );
+
+    videoFrame->setFrameBuffers( buffers, hasPicture ? &info : nullptr );
+
+    return hasPicture;
+}
+
+bool VlcVideoOutput::deliverReadyFrame()
+{
+    //frames not leased last time are still counted here
+    const unsigned pendingFrames = _frameCoalescer.take();
+    if( 0 == pendingFrames || !_currentVideoFrame )
+        return false;
+
+    FrameInfo info;
+    if( !_currentVideoFrame->leaseReadyFrame( &_currentFrameSlot, &info ) ) {
+        _frameCoalescer.undelivered( pendingFrames );
+        return false;
+    }
+
+    //every pending frame except the newest one was superseded
+    const unsigned droppedFrames =
+        _frameCoalescer.delivered( pendingFrames, _currentVideoFrame->takeSkippedFrames() );
+
+    onFrameReady( info, droppedFrames );
+
+    return true;
+}
+
+void VlcVideoOutput::releaseFrame( unsigned slot )
+{
+    if( _currentVideoFrame )
+        _currentVideoFrame->releaseFrame( slot );
 }
 
-bool VlcVideoOutput::isFrameReady()
+void VlcVideoOutput::releaseAllFrames()
 {
-    return !_waitingFrame.test_and_set(); //FIXME! use memory_order
+    if( _currentVideoFrame )
+        _currentVideoFrame->releaseAllFrames();
 }
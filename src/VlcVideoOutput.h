@@ -1,15 +1,27 @@
 #pragma once
 
-#include <deque>
+#include <vector>
 #include <memory>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
+#include <chrono>
 
 #include <uv.h>
 
+#include <vlc/vlc.h>
 #include <libvlc_wrapper/vlc_vmem.h>
 
+#include "SpscRing.h"
+#include "ColorConversion.h"
+#include "FrameBufferPool.h"
+#include "FrameCoalescer.h"
+#include "FrameRing.h"
+#include "PlaneScaler.h"
+#include "UvHandle.h"
+
+class MediaIndex; //#include "MediaIndex.h"
+
 ///////////////////////////////////////////////////////////////////////////////
 class VlcVideoOutput :
     private vlc::basic_vmem_wrapper
@@ -18,13 +30,16 @@ protected:
     VlcVideoOutput();
     ~VlcVideoOutput();
 
-    using vlc::basic_vmem_wrapper::open;
-    using vlc::basic_vmem_wrapper::close;
+    bool open( vlc::basic_player* player );
+    void close();
 
     enum class PixelFormat
     {
         RV32 = 0,
         I420,
+        RGBA,
+        NV12,
+        GREY,
     };
 
     PixelFormat pixelFormat() const
@@ -32,27 +47,154 @@ protected:
     void setPixelFormat( PixelFormat format )
         { _pixelFormat = format; }
 
+    //what decoder should do when all frame buffers are leased
+    typedef FrameRing::Policy FrameBufferPolicy;
+
+    static const unsigned MaxFrameBufferCount = 16;
+
+    unsigned frameBufferCount() const
+        { return _frameBufferCount; }
+    void setFrameBufferCount( unsigned count );
+
+    //pitch of every plane is multiple of row alignment,
+    //power of two between MinRowAlignment and MaxRowAlignment, applied on next frame setup
+    static const unsigned MinRowAlignment = 4;
+    static const unsigned MaxRowAlignment = FrameBufferPool::Alignment;
+
+    unsigned rowAlignment() const
+        { return _rowAlignment; }
+    void setRowAlignment( unsigned alignment );
+
+    FrameBufferPolicy frameBufferPolicy() const
+        { return _frameBufferPolicy; }
+    void setFrameBufferPolicy( FrameBufferPolicy policy )
+        { _frameBufferPolicy = policy; }
+
+    //0 width or height means source size, otherwise VideoFrame scales every decoded
+    //picture to fit requested size, since decoder keeps source size for the whole media,
+    //returns true if geometry was changed, new geometry is applied by reshapeVideoFrame()
+    bool setOutputSize( unsigned width, unsigned height, bool keepAspect );
+
+    //region is in coordinates of video scaled to output size, 0 width or height disables crop,
+    //origin change is applied to the current frame immediately,
+    //returns true if cropped frame size was changed, new size is applied by reshapeVideoFrame()
+    bool setCropRegion( unsigned x, unsigned y, unsigned width, unsigned height );
+
+    //if enabled, I420 is requested from libvlc but converted to RGBA by VideoFrame itself,
+    //all these settings are applied on next frame setup
+    bool rgbaConversion() const
+        { return _rgbaConversion; }
+    void setRGBAConversion( bool enabled )
+        { _rgbaConversion = enabled; }
+
+    ColorMatrix colorMatrix() const
+        { return _colorMatrix; }
+    void setColorMatrix( ColorMatrix matrix )
+        { _colorMatrix = matrix; }
+
+    ColorRange colorRange() const
+        { return _colorRange; }
+    void setColorRange( ColorRange range )
+        { _colorRange = range; }
+
+    //pixel format, row alignment, conversion and geometry, applied on next frame setup
+    void copyOutputSettings( VlcVideoOutput& from );
+
+    //recreates current frame with current geometry without touching decoder,
+    //calls onFrameSetup() and renders the picture of currentFrameSlot() to the new slot 0,
+    //returns true if picture was rendered, then slot 0 is leased and becomes currentFrameSlot()
+    bool reshapeVideoFrame();
+
     class VideoFrame;
-    class RV32VideoFrame;
-    class I420VideoFrame;
 
-    //should return pointer to buffer for video frame
-    virtual void* onFrameSetup( const RV32VideoFrame& ) = 0;
-    virtual void* onFrameSetup( const I420VideoFrame& ) = 0;
-    virtual void onFrameReady() = 0;
+    //playback clock, used to stamp displayed pictures, since libvlc can't be called from
+    //vmem callbacks (libvlc_media_player_stop() holds player lock while it waits for vout),
+    //should be fed from media player events and rate changes, could be called from any thread
+    void setPlaybackTime( libvlc_time_t time );
+    void setPlaybackPlaying( bool playing );
+    void setPlaybackRate( float rate );
+    //presentation times of media frames, displayed pictures are stamped with the nearest one,
+    //null if media is not indexed
+    void setFrameIndex( const std::shared_ptr<MediaIndex>& index );
+
+    //time is playback clock when picture was displayed: the latest time reported by libvlc,
+    //extrapolated with wall clock while playing, -1 if unknown,
+    //for indexed media it's snapped to presentation time of the frame, so it's picture PTS
+    typedef FrameRing::FrameInfo FrameInfo;
+
+    //should return one buffer per VideoFrame::slotCount()
+    virtual std::vector<void*> onFrameSetup( const VideoFrame& ) = 0;
+    //frame in currentFrameSlot() is leased until releaseFrame(),
+    //droppedFrames is count of frames superseded since previous call
+    virtual void onFrameReady( const FrameInfo&, unsigned droppedFrames ) = 0;
     virtual void onFrameCleanup() = 0;
 
-    //will reset current flag state
-    bool isFrameReady();
+    //calls onFrameReady() if decoder displayed any frame since last call
+    bool deliverReadyFrame();
+
+    //total count of frames never passed to onFrameReady()
+    unsigned long long droppedFrames() const
+        { return _frameCoalescer.droppedFrames(); }
+    void resetDroppedFrames()
+        { _frameCoalescer.resetDroppedFrames(); }
+
+    //null until first onFrameSetup() and after onFrameCleanup()
+    const VideoFrame* currentVideoFrame() const
+        { return _currentVideoFrame.get(); }
+    unsigned currentFrameSlot() const
+        { return _currentFrameSlot; }
+    void releaseFrame( unsigned slot );
+    void releaseAllFrames();
 
 private:
-    struct VideoEvent;
-    struct RV32FrameSetupEvent;
-    struct I420FrameSetupEvent;
-    struct FrameReadyEvent;
-    struct FrameCleanupEvent;
+    struct VideoEvent
+    {
+        enum Type
+        {
+            FrameSetup,
+            FrameReady,
+            FrameCleanup,
+        };
+
+        Type type;
+    };
 
+    //FrameReady events are coalesced and FrameSetup waits for gui thread,
+    //so only a few events could be in flight at any moment
+    static const unsigned VideoEventsCapacity = 16;
+
+    struct CropRegion
+    {
+        unsigned x;
+        unsigned y;
+        unsigned width;
+        unsigned height;
+    };
+
+    struct OutputGeometry
+    {
+        unsigned width;
+        unsigned height;
+        bool keepAspect;
+        CropRegion crop;
+    };
+
+    static void fitOutputSize( const OutputGeometry&, unsigned* width, unsigned* height );
+
+    struct RGBAConversion
+    {
+        bool enabled;
+        ColorMatrix matrix;
+        ColorRange range;
+    };
+
+    void pushEvent( const VideoEvent& );
     void handleAsync();
+    void handleFrameSetup();
+
+    //compile-time description of pixel format layout,
+    //specializations live in VlcVideoOutput.cpp
+    template<PixelFormat> struct FormatTraits;
 
 private:
     unsigned video_format_cb( char* chroma,
@@ -65,94 +207,217 @@ private:
     void video_display_cb( void* picture ) override;
 
     void notifyFrameReady();
+    libvlc_time_t samplePlaybackTime();
 
 private:
     PixelFormat _pixelFormat; //FIXME! maybe we need std::atomic here
-    std::shared_ptr<VideoFrame> _videoFrame; //should be accessed only from decode thread
+    std::atomic<unsigned> _frameBufferCount;
+    std::atomic<FrameBufferPolicy> _frameBufferPolicy;
+    std::atomic<unsigned> _rowAlignment;
+    std::atomic<bool> _rgbaConversion;
+    std::atomic<ColorMatrix> _colorMatrix;
+    std::atomic<ColorRange> _colorRange;
+
+    struct PlaybackClock
+    {
+        libvlc_time_t time;
+        std::chrono::steady_clock::time_point changed;
+        float rate;
+        bool playing;
+    };
+
+    std::mutex _clockGuard;
+    PlaybackClock _clock;
+    std::shared_ptr<MediaIndex> _frameIndex;
+
+    //should be accessed only from libvlc vout thread
+    unsigned long long _displaySequence;
+    std::shared_ptr<MediaIndex> _displayIndex;
+    unsigned _displayFrame; //frame of _displayIndex the latest picture was stamped with
+
+    std::mutex _geometryGuard;
+    OutputGeometry _geometry;
+    //decoder holds it from video_lock_cb() to video_unlock_cb(),
+    //so reshapeVideoFrame() never replaces frame with picture half way decoded
+    std::mutex _frameSwapGuard;
+    std::shared_ptr<VideoFrame> _videoFrame; //should be changed only with _frameSwapGuard locked
+    std::shared_ptr<VideoFrame> _lockedVideoFrame; //should be accessed only from decode thread
+    std::shared_ptr<VideoFrame> _setupVideoFrame; //should be accessed only with std::atomic_* functions
     std::shared_ptr<VideoFrame> _currentVideoFrame; //should be accessed only from gui thread
 
-    uv_async_t _async;
-    std::mutex _guard;
-    std::deque<std::unique_ptr<VideoEvent> > _videoEvents;
+    uv_async_t* _async;
+    //all video callbacks producing events are called from libvlc vout thread
+    SpscRing<VideoEvent, VideoEventsCapacity> _videoEvents;
+
+    //frames displayed by decoder since last onFrameReady() call
+    FrameCoalescer _frameCoalescer;
 
-    std::atomic_flag _waitingFrame;
+    //should be accessed only from gui thread
+    unsigned _currentFrameSlot;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 class VlcVideoOutput::VideoFrame
 {
-protected:
-    VideoFrame();
-    virtual ~VideoFrame();
-
 public:
+    static const unsigned MaxPlanes = 3;
+
+    VideoFrame( PixelFormat pixelFormat, unsigned slotCount, FrameBufferPolicy policy,
+                const RGBAConversion& conversion, const OutputGeometry& geometry,
+                unsigned rowAlignment );
+    //the same decoder format as from, but with another geometry
+    VideoFrame( const VideoFrame& from, const OutputGeometry& geometry,
+                unsigned slotCount, FrameBufferPolicy policy );
+    ~VideoFrame();
+
+    //format of frame buffers, RGBA if frame is converted
+    PixelFormat pixelFormat() const
+        { return _pixelFormat; }
     unsigned width() const
         { return _width; }
     unsigned height() const
         { return _height; }
     unsigned size() const
-        { return _size; }
+        { return _layout.size; }
+    unsigned slotCount() const
+        { return _ring.slotCount(); }
+
+    unsigned planeCount() const
+        { return _layout.count; }
+    unsigned planeOffset( unsigned plane ) const
+        { return _layout.offsets[plane]; }
+    unsigned planePitch( unsigned plane ) const
+        { return _layout.pitches[plane]; }
+    unsigned planeLines( unsigned plane ) const
+        { return _layout.lines[plane]; }
+
+    bool converted() const
+        { return _convert; }
+    bool cropped() const
+        { return _crop; }
+    bool scaled() const
+        { return _scale; }
+
+    //could be called from any thread, origin is adjusted to keep region inside scaled picture
+    void setCropOrigin( unsigned x, unsigned y );
+    ConversionKernel conversionKernel() const
+        { return _conversionKernel; }
 
     void waitBuffer();
-    void setFrameBuffer( void* frameBuffer );
-
-protected:
-    virtual unsigned video_format_cb( char* chroma,
-                                      unsigned* width, unsigned* height,
-                                      unsigned* pitches, unsigned* lines ) = 0;
+    //if leased is not null, slot 0 already has picture and is leased
+    void setFrameBuffers( const std::vector<void*>& frameBuffers, const FrameInfo* leased = nullptr );
 
-    virtual void* video_lock_cb( void** planes ) = 0;
-    virtual void video_unlock_cb( void* picture, void *const * planes );
-    void video_cleanup_cb();
+    //leases newest displayed frame, older displayed but not leased frames are dropped
+    bool leaseReadyFrame( unsigned* slot, FrameInfo* info );
+    void releaseFrame( unsigned slot );
+    void releaseAllFrames();
 
-    virtual void fillBlack() = 0;
+    //count of frames decoded to scratch buffer since last call
+    unsigned takeSkippedFrames();
 
-    friend VlcVideoOutput;
-
-protected:
-    unsigned _width;
-    unsigned _height;
-    unsigned _size;
-
-    std::mutex _guard;
-    std::condition_variable _waiter;
-    void* _frameBuffer;
-};
-
-///////////////////////////////////////////////////////////////////////////////
-class VlcVideoOutput::RV32VideoFrame : public VideoFrame
-{
-public:
-    void fillBlack() override;
+    void fillBlack();
 
 private:
+    //returns false if decode format is not supported
+    bool setup( unsigned decodeWidth, unsigned decodeHeight );
+    //true if frame has the same size as frame set up with geometry
+    bool hasShape( const OutputGeometry& geometry ) const;
+
     unsigned video_format_cb( char* chroma,
                               unsigned* width, unsigned* height,
-                              unsigned* pitches, unsigned* line ) override;
-    void* video_lock_cb( void** planes ) override;
-};
+                              unsigned* pitches, unsigned* lines );
 
-///////////////////////////////////////////////////////////////////////////////
-class VlcVideoOutput::I420VideoFrame : public VideoFrame
-{
-public:
-    I420VideoFrame();
+    void* video_lock_cb( void** planes );
+    void video_unlock_cb( void* picture );
+    //returns false if frame should not be delivered
+    bool video_display_cb( void* picture, const FrameInfo& info );
+    void video_cleanup_cb();
 
-    unsigned uPlaneOffset() const
-        { return _uPlaneOffset; }
-    unsigned vPlaneOffset() const
-        { return _vPlaneOffset; }
+    //decoder writes to _decodeBuffer instead of frame buffers
+    bool usesDecodeBuffer() const
+        { return _convert || _crop || _scale; }
+    //renders picture with _decodeLayout to frame buffer
+    void present( const char* decoded, char* buffer );
+    //copies picture of slot with _decodeLayout, fails if nothing was displayed to slot yet,
+    //decoder should not be between video_lock_cb() and video_unlock_cb()
+    bool copyPicture( unsigned slot, char* picture, FrameInfo* info );
 
-    void fillBlack() override;
+    struct PlaneLayout
+    {
+        const char* chroma;
+        unsigned count;
+        unsigned offsets[MaxPlanes];
+        unsigned pitches[MaxPlanes];
+        unsigned lines[MaxPlanes];
+        unsigned size;
+        //chroma planes are subsampled, so crop origin and size should be even
+        bool subsampled;
+        void ( VideoFrame::*fillBlack )( char* buffer ) const;
+        void ( VideoFrame::*copyCrop )( const char* source, char* buffer,
+                                        unsigned x, unsigned y ) const;
+        void ( VideoFrame::*setupScalers )( unsigned x, unsigned y );
+    };
 
-private:
-    unsigned video_format_cb( char* chroma,
-                              unsigned* width, unsigned* height,
-                              unsigned* pitches, unsigned* lines ) override;
-    void* video_lock_cb( void** planes ) override;
-    void video_unlock_cb( void* picture, void *const * planes ) override;
+    //returns chroma for libvlc
+    const char* setupLayout( PixelFormat, unsigned width, unsigned height, PlaneLayout* ) const;
+    template<typename Traits>
+    const char* setupLayout( unsigned width, unsigned height, PlaneLayout* ) const;
+    template<typename Traits>
+    void fillBlack( char* buffer ) const;
+    //copies region of _decodeLayout picture to _layout picture
+    template<typename Traits>
+    void copyCrop( const char* source, char* buffer, unsigned x, unsigned y ) const;
+    //maps region of scaled picture at x, y to _decodeLayout picture
+    template<typename Traits>
+    void setupScalers( unsigned x, unsigned y );
+    //scales every plane of _decodeLayout picture to picture with layout
+    void scalePlanes( const char* source, char* buffer, const PlaneLayout& layout );
+
+    friend VlcVideoOutput;
 
 private:
-    unsigned _uPlaneOffset;
-    unsigned _vPlaneOffset;
+    const bool _convert;
+    const PixelFormat _pixelFormat;
+    const PixelFormat _decodeFormat;
+    unsigned _width;
+    unsigned _height;
+    unsigned _decodeWidth;
+    unsigned _decodeHeight;
+    const unsigned _rowAlignment;
+
+    //layout of frame buffers
+    PlaneLayout _layout;
+    //layout of buffers decoder writes to, differs from _layout only if frame is converted,
+    //scaled or cropped
+    PlaneLayout _decodeLayout;
+
+    const OutputGeometry _geometry;
+    //source size fit to output size, crop region is in these coordinates
+    bool _scale;
+    unsigned _scaledWidth;
+    unsigned _scaledHeight;
+    const bool _crop;
+    std::atomic<unsigned> _cropX;
+    std::atomic<unsigned> _cropY;
+
+    //one scaler per plane, set up for crop origin _scalerX, _scalerY
+    PlaneScaler _scalers[MaxPlanes];
+    unsigned _scalerX;
+    unsigned _scalerY;
+    //decode format picture of output size, converted after scaling
+    PlaneLayout _scaleLayout;
+    FrameBufferPool::Buffer _scaleBuffer;
+
+    const ColorMatrix _colorMatrix;
+    const ColorRange _colorRange;
+    const ConversionKernel _conversionKernel;
+    YuvToRgbCoefficients _coefficients;
+    //vmem keeps only one picture in flight, so one decode buffer is enough
+    FrameBufferPool::Buffer _decodeBuffer;
+    //true once decoder unlocked picture in _decodeBuffer, guarded by _frameSwapGuard
+    bool _decoded;
+
+    FrameRing _ring;
+    //used by decoder when there are no free slots and frame has to be dropped
+    FrameBufferPool::Buffer _scratchBuffer;
 };
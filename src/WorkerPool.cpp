@@ -0,0 +1,109 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+namespace {
+//conversion bands are memory bound, so there is no point to occupy all cores
+const unsigned MaxWorkersCount = 3;
+}
+
+struct WorkerPool::Job
+{
+    const std::function<void( unsigned )>* task;
+    unsigned count;
+    std::atomic<unsigned> next;
+    unsigned finished; //guarded by WorkerPool::_guard
+};
+
+WorkerPool& WorkerPool::instance()
+{
+    static WorkerPool pool(
+        std::min( std::max( std::thread::hardware_concurrency(), 1u ) - 1, MaxWorkersCount ) );
+    return pool;
+}
+
+WorkerPool::WorkerPool( unsigned workersCount ) :
+    _stopping( false )
+{
+    _workers.reserve( workersCount );
+    for( unsigned i = 0; i < workersCount; ++i )
+        _workers.emplace_back( &WorkerPool::workerMain, this );
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock( _guard );
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+
+    for( std::thread& worker: _workers )
+        worker.join();
+}
+
+void WorkerPool::run( unsigned count, const std::function<void( unsigned )>& task )
+{
+    if( count <= 1 || _workers.empty() ) {
+        for( unsigned i = 0; i < count; ++i )
+            task( i );
+        return;
+    }
+
+    Job job;
+    job.task = &task;
+    job.count = count;
+    job.next = 0;
+    job.finished = 0;
+
+    {
+        std::lock_guard<std::mutex> lock( _guard );
+        _jobs.push_back( &job );
+    }
+    _wakeup.notify_all();
+
+    unsigned finished = 0;
+    for( unsigned i = job.next.fetch_add( 1 ); i < count; i = job.next.fetch_add( 1 ) ) {
+        task( i );
+        ++finished;
+    }
+
+    std::unique_lock<std::mutex> lock( _guard );
+
+    //after that no worker will be able to pick this job
+    auto it = std::find( _jobs.begin(), _jobs.end(), &job );
+    if( it != _jobs.end() )
+        _jobs.erase( it );
+
+    job.finished += finished;
+    while( job.finished < count )
+        _jobFinished.wait( lock );
+}
+
+void WorkerPool::workerMain()
+{
+    std::unique_lock<std::mutex> lock( _guard );
+
+    for( ;; ) {
+        while( !_stopping && _jobs.empty() )
+            _wakeup.wait( lock );
+
+        if( _stopping )
+            return;
+
+        Job* job = _jobs.front();
+        const unsigned index = job->next.fetch_add( 1 );
+        if( index >= job->count ) {
+            //all tasks of the job are taken already
+            _jobs.pop_front();
+            continue;
+        }
+
+        lock.unlock();
+        ( *job->task )( index );
+        lock.lock();
+
+        if( ++job->finished == job->count )
+            _jobFinished.notify_all();
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Small process wide pool of worker threads
+// shared by all players to split per frame work into bands.
+class WorkerPool
+{
+public:
+    static WorkerPool& instance();
+
+    ~WorkerPool();
+
+    //workers count + calling thread
+    unsigned concurrency() const
+        { return static_cast<unsigned>( _workers.size() ) + 1; }
+
+    //calls task( index ) for every index in [0, count),
+    //calling thread participates and blocks until all tasks are finished
+    void run( unsigned count, const std::function<void( unsigned )>& task );
+
+private:
+    explicit WorkerPool( unsigned workersCount );
+
+    WorkerPool( const WorkerPool& ) = delete;
+    WorkerPool& operator = ( const WorkerPool& ) = delete;
+
+    struct Job;
+
+    void workerMain();
+
+private:
+    std::vector<std::thread> _workers;
+
+    std::mutex _guard;
+    std::condition_variable _wakeup;
+    std::condition_variable _jobFinished;
+    std::deque<Job*> _jobs;
+    bool _stopping;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdio.h>
+
+// Minimal checks for standalone unit tests, failures are reported and counted,
+// so one run shows all of them.
+
+inline unsigned& failedChecks()
+{
+    static unsigned failed = 0;
+    return failed;
+}
+
+#define CHECK( condition ) \
+    do { \
+        if( !( condition ) ) { \
+            fprintf( stderr, "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #condition ); \
+            ++failedChecks(); \
+        } \
+    } while( 0 )
+
+// For integral values, both are printed on failure.
+#define CHECK_EQ( actual, expected ) \
+    do { \
+        const long long actualValue = static_cast<long long>( actual ); \
+        const long long expectedValue = static_cast<long long>( expected ); \
+        if( actualValue != expectedValue ) { \
+            fprintf( stderr, "%s:%d: CHECK_EQ( %s, %s ) failed: %lld != %lld\n", \
+                     __FILE__, __LINE__, #actual, #expected, actualValue, expectedValue ); \
+            ++failedChecks(); \
+        } \
+    } while( 0 )
+
+inline int checksResult( const char* name )
+{
+    if( failedChecks() ) {
+        fprintf( stderr, "%s: %u checks failed\n", name, failedChecks() );
+        return 1;
+    }
+
+    printf( "%s: passed\n", name );
+    return 0;
+}
@@ -0,0 +1,133 @@
+// CuePoints: placement of cues and crossed()/landed() ranges.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CuePoints.h"
+#include "MediaIndex.h"
+
+#include "Check.h"
+#include "Mp4Fixture.h"
+
+namespace {
+
+typedef std::vector<std::string> Ids;
+
+Ids crossed( const CuePoints& cues, int64_t from, int64_t to )
+{
+    Ids ids;
+    cues.crossed( from, to, &ids );
+    return ids;
+}
+
+Ids landed( const CuePoints& cues, int64_t time, int64_t duration )
+{
+    Ids ids;
+    cues.landed( time, duration, &ids );
+    return ids;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void testCrossed()
+{
+    CuePoints cues;
+    CHECK( cues.empty() );
+
+    cues.add( "b", 200, false );
+    cues.add( "a", 100, false );
+    //frame 5 at 40 ms per frame, the same time as "b" but added later
+    cues.add( "f", 5, true );
+    cues.resolve( nullptr, 40 );
+    CHECK( !cues.empty() );
+
+    CHECK( crossed( cues, 0, 300 ) == Ids( { "a", "b", "f" } ) );
+    //cue at "from" was passed already
+    CHECK( crossed( cues, 100, 200 ) == Ids( { "b", "f" } ) );
+    CHECK( crossed( cues, 99, 100 ) == Ids( { "a" } ) );
+    CHECK( crossed( cues, 101, 199 ).empty() );
+    CHECK( crossed( cues, 100, 100 ).empty() );
+
+    //backwards cues are passed in reverse order, "to" is included
+    CHECK( crossed( cues, 300, 0 ) == Ids( { "f", "b", "a" } ) );
+    CHECK( crossed( cues, 200, 100 ) == Ids( { "a" } ) );
+    CHECK( crossed( cues, 201, 200 ) == Ids( { "f", "b" } ) );
+}
+
+void testLanded()
+{
+    CuePoints cues;
+    cues.add( "a", 100, false );
+    cues.add( "b", 140, false );
+    cues.resolve( nullptr, 40 );
+
+    //[time, time + duration)
+    CHECK( landed( cues, 100, 40 ) == Ids( { "a" } ) );
+    CHECK( landed( cues, 60, 41 ) == Ids( { "a" } ) );
+    CHECK( landed( cues, 60, 40 ).empty() );
+    CHECK( landed( cues, 100, 41 ) == Ids( { "a", "b" } ) );
+    CHECK( landed( cues, 141, 40 ).empty() );
+    CHECK( landed( cues, 0, 0 ).empty() );
+}
+
+void testEdit()
+{
+    CuePoints cues;
+    cues.add( "a", 100, false );
+    cues.add( "b", 200, false );
+    //same id replaces cue, negative position is clamped
+    cues.add( "a", 300, false );
+    cues.add( "c", -50, false );
+    cues.resolve( nullptr, 40 );
+
+    CHECK( crossed( cues, -1, 1000 ) == Ids( { "c", "b", "a" } ) );
+
+    CHECK( cues.remove( "b" ) );
+    CHECK( !cues.remove( "b" ) );
+    cues.resolve( nullptr, 40 );
+    CHECK( crossed( cues, -1, 1000 ) == Ids( { "c", "a" } ) );
+
+    cues.clear();
+    CHECK( cues.empty() );
+    CHECK( crossed( cues, -1, 1000 ).empty() );
+}
+
+void testFramePlacement()
+{
+    CuePoints cues;
+    cues.add( "f", 3, true );
+    cues.add( "last", 100, true );
+
+    //without index frames are placed by frame duration, and follow its changes
+    cues.resolve( nullptr, 40 );
+    CHECK( landed( cues, 120, 1 ) == Ids( { "f" } ) );
+    cues.resolve( nullptr, 1000.0 / 30 );
+    CHECK( landed( cues, 100, 1 ) == Ids( { "f" } ) );
+
+    //index places frames at their exact times, frames after the last one are clamped to it
+    Mp4Track track;
+    track.stts = { { 2, 40 }, { 3, 20 } };
+    const char mediaPath[] = "cue_points_test.mp4";
+    CHECK( writeFile( mediaPath, makeMp4( { track } ) ) );
+    std::shared_ptr<MediaIndex> index = MediaIndex::build( mediaPath );
+    remove( mediaPath );
+    CHECK( index );
+    if( !index )
+        return;
+
+    cues.resolve( index, 40 );
+    CHECK( landed( cues, 100, 1 ) == Ids( { "f" } ) );
+    CHECK( landed( cues, 120, 1 ) == Ids( { "last" } ) );
+}
+
+}
+
+int main()
+{
+    testCrossed();
+    testLanded();
+    testEdit();
+    testFramePlacement();
+
+    return checksResult( "cue_points_test" );
+}
@@ -0,0 +1,164 @@
+// DecodedFrameCache: copies, hit/miss counters, LRU eviction and budget changes.
+
+#include <vector>
+
+#include "DecodedFrameCache.h"
+
+#include "Check.h"
+
+namespace {
+
+const size_t FrameSize = 64;
+
+//frame content is its time, to check frames are copied
+void insert( DecodedFrameCache& cache, int64_t time, size_t size = FrameSize )
+{
+    std::vector<unsigned char> data( size, static_cast<unsigned char>( time ) );
+    cache.insert( time, data.data(), data.size() );
+}
+
+//content of cached frame, -1 if it's not cached
+int cached( DecodedFrameCache& cache, int64_t time )
+{
+    const FrameBufferPool::Buffer* buffer = cache.find( time );
+    return buffer ? static_cast<unsigned char>( buffer->data()[buffer->size() - 1] ) : -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void testDisabled()
+{
+    DecodedFrameCache cache;
+    CHECK_EQ( cache.budget(), 0 );
+    CHECK_EQ( cache.capacity( FrameSize ), 0 );
+
+    insert( cache, 40 );
+    CHECK( !cache.contains( 40 ) );
+    CHECK_EQ( cache.usedBytes(), 0 );
+}
+
+void testFind()
+{
+    DecodedFrameCache cache;
+    cache.setBudget( 4 * FrameSize );
+    CHECK_EQ( cache.capacity( FrameSize ), 4 );
+    CHECK_EQ( cache.capacity( 0 ), 0 );
+
+    insert( cache, 40 );
+    insert( cache, 80 );
+    CHECK_EQ( cache.usedBytes(), 2 * FrameSize );
+
+    CHECK_EQ( cached( cache, 40 ), 40 );
+    CHECK_EQ( cached( cache, 80 ), 80 );
+    CHECK_EQ( cached( cache, 120 ), -1 );
+    CHECK_EQ( cache.hits(), 2 );
+    CHECK_EQ( cache.misses(), 1 );
+
+    //contains() is not counted
+    CHECK( cache.contains( 40 ) );
+    CHECK( !cache.contains( 120 ) );
+    CHECK_EQ( cache.hits(), 2 );
+    CHECK_EQ( cache.misses(), 1 );
+
+    //frame is copied, so source could be reused right away
+    const FrameBufferPool::Buffer* buffer = cache.find( 40 );
+    CHECK( buffer && buffer->size() == FrameSize );
+}
+
+void testEviction()
+{
+    DecodedFrameCache cache;
+    cache.setBudget( 3 * FrameSize );
+
+    insert( cache, 1 );
+    insert( cache, 2 );
+    insert( cache, 3 );
+
+    //found frame becomes the most recently used one
+    CHECK_EQ( cached( cache, 1 ), 1 );
+    insert( cache, 4 );
+    CHECK( cache.contains( 1 ) );
+    CHECK( !cache.contains( 2 ) );
+    CHECK( cache.contains( 3 ) );
+    CHECK( cache.contains( 4 ) );
+    CHECK_EQ( cache.usedBytes(), 3 * FrameSize );
+
+    //contains() doesn't change order, so 3 is evicted next
+    CHECK( cache.contains( 3 ) );
+    insert( cache, 5 );
+    CHECK( !cache.contains( 3 ) );
+    CHECK( cache.contains( 1 ) );
+
+    //frame larger than budget is never cached
+    insert( cache, 6, 4 * FrameSize );
+    CHECK( !cache.contains( 6 ) );
+    CHECK_EQ( cache.usedBytes(), 3 * FrameSize );
+}
+
+void testReinsert()
+{
+    DecodedFrameCache cache;
+    cache.setBudget( 3 * FrameSize );
+
+    insert( cache, 1 );
+    insert( cache, 2 );
+
+    //the same frame decoded again replaces the cached copy
+    std::vector<unsigned char> data( FrameSize, 99 );
+    cache.insert( 1, data.data(), data.size() );
+    CHECK_EQ( cache.usedBytes(), 2 * FrameSize );
+    CHECK_EQ( cached( cache, 1 ), 99 );
+
+    //and becomes the most recently used one
+    insert( cache, 3 );
+    insert( cache, 4 );
+    CHECK( cache.contains( 1 ) );
+    CHECK( !cache.contains( 2 ) );
+
+    //frame of another size, e.g. after output size change
+    insert( cache, 1, 2 * FrameSize );
+    CHECK( cache.contains( 1 ) );
+    CHECK_EQ( cache.usedBytes(), 3 * FrameSize );
+    CHECK_EQ( cache.find( 1 )->size(), 2 * FrameSize );
+}
+
+void testBudget()
+{
+    DecodedFrameCache cache;
+    cache.setBudget( 4 * FrameSize );
+
+    for( int64_t time = 1; time <= 4; ++time )
+        insert( cache, time );
+
+    //the least recently used frames are evicted
+    cache.setBudget( 2 * FrameSize );
+    CHECK( !cache.contains( 1 ) );
+    CHECK( !cache.contains( 2 ) );
+    CHECK( cache.contains( 3 ) );
+    CHECK( cache.contains( 4 ) );
+    CHECK_EQ( cache.usedBytes(), 2 * FrameSize );
+
+    cache.clear();
+    CHECK( !cache.contains( 3 ) );
+    CHECK( !cache.contains( 4 ) );
+    CHECK_EQ( cache.usedBytes(), 0 );
+    CHECK_EQ( cache.budget(), 2 * FrameSize );
+
+    //0 disables cache
+    insert( cache, 5 );
+    cache.setBudget( 0 );
+    CHECK( !cache.contains( 5 ) );
+    CHECK_EQ( cache.usedBytes(), 0 );
+}
+
+}
+
+int main()
+{
+    testDisabled();
+    testFind();
+    testEviction();
+    testReinsert();
+    testBudget();
+
+    return checksResult( "decoded_frame_cache_test" );
+}
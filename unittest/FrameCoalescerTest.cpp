@@ -0,0 +1,85 @@
+// FrameCoalescer: one notification per delivery, dropped frames accounting.
+
+#include "FrameCoalescer.h"
+
+#include "Check.h"
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+void testCoalescing()
+{
+    FrameCoalescer coalescer;
+    CHECK( !coalescer.pending() );
+    CHECK_EQ( coalescer.take(), 0 );
+
+    //only the first frame notifies gui thread
+    CHECK( coalescer.frameDisplayed() );
+    CHECK( !coalescer.frameDisplayed() );
+    CHECK( !coalescer.frameDisplayed() );
+    CHECK( coalescer.pending() );
+
+    CHECK_EQ( coalescer.take(), 3 );
+    CHECK( !coalescer.pending() );
+    //the newest frame is delivered, two superseded ones are dropped
+    CHECK_EQ( coalescer.delivered( 3, 0 ), 2 );
+    CHECK_EQ( coalescer.droppedFrames(), 2 );
+
+    //next frame notifies again
+    CHECK( coalescer.frameDisplayed() );
+    CHECK_EQ( coalescer.take(), 1 );
+    CHECK_EQ( coalescer.delivered( 1, 0 ), 0 );
+    CHECK_EQ( coalescer.droppedFrames(), 2 );
+}
+
+void testSkipped()
+{
+    FrameCoalescer coalescer;
+
+    //frames skipped by decoder never got pending, but they are dropped too
+    CHECK( coalescer.frameDisplayed() );
+    CHECK_EQ( coalescer.delivered( coalescer.take(), 4 ), 4 );
+    CHECK_EQ( coalescer.droppedFrames(), 4 );
+
+    coalescer.resetDroppedFrames();
+    CHECK_EQ( coalescer.droppedFrames(), 0 );
+}
+
+void testUndelivered()
+{
+    FrameCoalescer coalescer;
+
+    CHECK( coalescer.frameDisplayed() );
+    CHECK( !coalescer.frameDisplayed() );
+    CHECK_EQ( coalescer.take(), 2 );
+    //no frame could be leased, so they wait for the next delivery
+    coalescer.undelivered( 2 );
+    CHECK( !coalescer.pending() );
+    CHECK_EQ( coalescer.droppedFrames(), 0 );
+
+    //and the next frame still notifies gui thread
+    CHECK( coalescer.frameDisplayed() );
+    CHECK_EQ( coalescer.take(), 3 );
+    CHECK_EQ( coalescer.delivered( 3, 0 ), 2 );
+    CHECK_EQ( coalescer.droppedFrames(), 2 );
+
+    //undelivered frames are dropped on cleanup
+    CHECK( coalescer.frameDisplayed() );
+    coalescer.undelivered( coalescer.take() );
+    coalescer.discard();
+    CHECK_EQ( coalescer.droppedFrames(), 3 );
+    CHECK_EQ( coalescer.take(), 0 );
+    coalescer.discard();
+    CHECK_EQ( coalescer.droppedFrames(), 3 );
+}
+
+}
+
+int main()
+{
+    testCoalescing();
+    testSkipped();
+    testUndelivered();
+
+    return checksResult( "frame_coalescer_test" );
+}
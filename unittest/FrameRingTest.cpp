@@ -0,0 +1,265 @@
+// FrameRing: slot ring between decoder and gui thread, leases and full ring policies.
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "FrameRing.h"
+
+#include "Check.h"
+
+namespace {
+
+typedef FrameRing::Policy Policy;
+
+const std::chrono::milliseconds BlockTime( 50 );
+
+struct Buffers
+{
+    Buffers( unsigned count ) :
+        storage( count ), pointers( count )
+    {
+        for( unsigned i = 0; i < count; ++i )
+            pointers[i] = &storage[i];
+    }
+
+    std::vector<char> storage;
+    std::vector<void*> pointers;
+};
+
+unsigned acquire( FrameRing& ring )
+{
+    char* buffer = nullptr;
+    return ring.acquire( &buffer );
+}
+
+//decodes and displays picture with sequence, returns slot it was displayed to
+unsigned decode( FrameRing& ring, unsigned long long sequence )
+{
+    const unsigned slot = acquire( ring );
+    const FrameRing::FrameInfo info = { static_cast<int64_t>( sequence * 40 ), sequence };
+    ring.display( slot, info );
+    return slot;
+}
+
+unsigned leased( FrameRing& ring, unsigned long long* sequence = nullptr )
+{
+    unsigned slot;
+    FrameRing::FrameInfo info;
+    if( !ring.lease( &slot, &info ) )
+        return ring.scratchSlot();
+    if( sequence )
+        *sequence = info.sequence;
+    return slot;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void testBeforeBuffers()
+{
+    FrameRing ring( 2, Policy::Block, BlockTime );
+    CHECK_EQ( ring.scratchSlot(), 2 );
+
+    //decoder could start before buffers are set, such pictures are dropped
+    char sentinel = 0;
+    char* buffer = &sentinel;
+    CHECK_EQ( ring.acquire( &buffer ), ring.scratchSlot() );
+    CHECK( !buffer );
+    CHECK( !ring.display( ring.scratchSlot(), { 0, 1 } ) );
+    CHECK( !ring.display( ring.scratchSlot(), { 40, 2 } ) );
+    CHECK_EQ( ring.takeSkippedFrames(), 2 );
+    CHECK_EQ( ring.takeSkippedFrames(), 0 );
+    CHECK_EQ( leased( ring ), ring.scratchSlot() );
+
+    Buffers buffers( 2 );
+    ring.setBuffers( buffers.pointers );
+    ring.waitBuffers();
+    CHECK_EQ( ring.acquire( &buffer ), 0 );
+    CHECK( buffer == &buffers.storage[0] );
+}
+
+void testRing()
+{
+    FrameRing ring( 3, Policy::Block, BlockTime );
+    Buffers buffers( 3 );
+    ring.setBuffers( buffers.pointers );
+
+    FrameRing::FrameInfo info;
+    CHECK( !ring.displayedInfo( 0, &info ) );
+    //nothing displayed yet
+    CHECK_EQ( leased( ring ), ring.scratchSlot() );
+
+    CHECK_EQ( decode( ring, 1 ), 0 );
+    CHECK_EQ( decode( ring, 2 ), 1 );
+    CHECK( ring.displayedInfo( 1, &info ) );
+    CHECK_EQ( info.sequence, 2 );
+    CHECK_EQ( info.time, 80 );
+
+    //the newest picture is leased, older one is freed
+    unsigned long long sequence = 0;
+    CHECK_EQ( leased( ring, &sequence ), 1 );
+    CHECK_EQ( sequence, 2 );
+    CHECK_EQ( decode( ring, 3 ), 0 );
+    CHECK_EQ( decode( ring, 4 ), 2 );
+
+    ring.release( 1 );
+    CHECK_EQ( leased( ring, &sequence ), 2 );
+    CHECK_EQ( sequence, 4 );
+    CHECK_EQ( decode( ring, 5 ), 0 );
+    CHECK_EQ( decode( ring, 6 ), 1 );
+
+    //release of not leased slot is ignored
+    ring.release( 0 );
+    CHECK_EQ( leased( ring, &sequence ), 1 );
+    CHECK_EQ( sequence, 6 );
+}
+
+void testReuseUndisplayed()
+{
+    FrameRing ring( 2, Policy::DropNewest, BlockTime );
+    Buffers buffers( 2 );
+    ring.setBuffers( buffers.pointers );
+
+    //vmem keeps only one picture in flight
+    CHECK_EQ( acquire( ring ), 0 );
+    CHECK_EQ( acquire( ring ), 0 );
+    CHECK_EQ( decode( ring, 1 ), 0 );
+    CHECK_EQ( acquire( ring ), 1 );
+}
+
+void testSingleSlot()
+{
+    FrameRing ring( 1, Policy::Block, BlockTime );
+    Buffers buffers( 1 );
+    ring.setBuffers( buffers.pointers );
+
+    //single buffer is shared, so decoder never waits and gui thread always gets it
+    CHECK_EQ( decode( ring, 1 ), 0 );
+    CHECK_EQ( leased( ring ), 0 );
+    CHECK_EQ( decode( ring, 2 ), 0 );
+    unsigned long long sequence = 0;
+    CHECK_EQ( leased( ring, &sequence ), 0 );
+    CHECK_EQ( sequence, 2 );
+    CHECK_EQ( ring.takeSkippedFrames(), 0 );
+}
+
+void testLeasedOnSetup()
+{
+    FrameRing ring( 2, Policy::DropNewest, BlockTime );
+    Buffers buffers( 2 );
+    const FrameRing::FrameInfo info = { 400, 10 };
+    ring.setBuffers( buffers.pointers, &info );
+
+    FrameRing::FrameInfo displayed;
+    CHECK( ring.displayedInfo( 0, &displayed ) );
+    CHECK_EQ( displayed.sequence, 10 );
+    CHECK_EQ( displayed.time, 400 );
+
+    //slot 0 is still leased
+    CHECK_EQ( decode( ring, 11 ), 1 );
+    CHECK_EQ( acquire( ring ), ring.scratchSlot() );
+    ring.release( 0 );
+    CHECK_EQ( acquire( ring ), 0 );
+}
+
+void testDropOldest()
+{
+    FrameRing ring( 3, Policy::DropOldest, BlockTime );
+    Buffers buffers( 3 );
+    ring.setBuffers( buffers.pointers );
+
+    CHECK_EQ( decode( ring, 1 ), 0 );
+    CHECK_EQ( leased( ring ), 0 );
+    CHECK_EQ( decode( ring, 2 ), 1 );
+    CHECK_EQ( decode( ring, 3 ), 2 );
+
+    //the oldest displayed picture is overwritten, leased one is kept
+    CHECK_EQ( decode( ring, 4 ), 1 );
+    CHECK_EQ( decode( ring, 5 ), 2 );
+    CHECK_EQ( ring.takeSkippedFrames(), 0 );
+
+    unsigned long long sequence = 0;
+    ring.release( 0 );
+    CHECK_EQ( leased( ring, &sequence ), 2 );
+    CHECK_EQ( sequence, 5 );
+
+    //every slot is leased
+    FrameRing single( 2, Policy::DropOldest, BlockTime );
+    Buffers singleBuffers( 2 );
+    single.setBuffers( singleBuffers.pointers );
+    CHECK_EQ( decode( single, 1 ), 0 );
+    CHECK_EQ( leased( single ), 0 );
+    CHECK_EQ( decode( single, 2 ), 1 );
+    CHECK_EQ( leased( single ), 1 );
+    CHECK_EQ( decode( single, 3 ), single.scratchSlot() );
+    CHECK_EQ( single.takeSkippedFrames(), 1 );
+}
+
+void testDropNewest()
+{
+    FrameRing ring( 2, Policy::DropNewest, BlockTime );
+    Buffers buffers( 2 );
+    ring.setBuffers( buffers.pointers );
+
+    CHECK_EQ( decode( ring, 1 ), 0 );
+    CHECK_EQ( leased( ring ), 0 );
+    CHECK_EQ( decode( ring, 2 ), 1 );
+
+    //new pictures are dropped while displayed one waits for lease
+    CHECK_EQ( decode( ring, 3 ), ring.scratchSlot() );
+    CHECK_EQ( decode( ring, 4 ), ring.scratchSlot() );
+    CHECK_EQ( ring.takeSkippedFrames(), 2 );
+
+    unsigned long long sequence = 0;
+    ring.release( 0 );
+    CHECK_EQ( leased( ring, &sequence ), 1 );
+    CHECK_EQ( sequence, 2 );
+}
+
+void testBlock()
+{
+    FrameRing ring( 2, Policy::Block, BlockTime );
+    Buffers buffers( 2 );
+    ring.setBuffers( buffers.pointers );
+
+    CHECK_EQ( decode( ring, 1 ), 0 );
+    CHECK_EQ( leased( ring ), 0 );
+    CHECK_EQ( decode( ring, 2 ), 1 );
+
+    //decoder waits at most block time, then picture is dropped
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CHECK_EQ( decode( ring, 3 ), ring.scratchSlot() );
+    CHECK( std::chrono::steady_clock::now() - start >= BlockTime );
+    CHECK_EQ( ring.takeSkippedFrames(), 1 );
+
+    //lease of displayed picture frees the one leased before
+    std::thread gui( [&ring] () {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        ring.release( 0 );
+    } );
+    CHECK_EQ( decode( ring, 4 ), 0 );
+    gui.join();
+
+    //releaseAll() frees everything except slot decoder writes to
+    CHECK_EQ( leased( ring ), 0 );
+    CHECK_EQ( acquire( ring ), 1 );
+    ring.releaseAll();
+    CHECK_EQ( leased( ring ), ring.scratchSlot() );
+    CHECK( ring.display( 1, { 200, 5 } ) );
+    CHECK_EQ( leased( ring ), 1 );
+}
+
+}
+
+int main()
+{
+    testBeforeBuffers();
+    testRing();
+    testReuseUndisplayed();
+    testSingleSlot();
+    testLeasedOnSetup();
+    testDropOldest();
+    testDropNewest();
+    testBlock();
+
+    return checksResult( "frame_ring_test" );
+}
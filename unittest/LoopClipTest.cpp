@@ -0,0 +1,184 @@
+// LoopClip: capture of A/B range and its gapless replay.
+
+#include <memory>
+#include <vector>
+
+#include "LoopClip.h"
+#include "MediaIndex.h"
+
+#include "Check.h"
+#include "Mp4Fixture.h"
+
+namespace {
+
+typedef LoopClip::Clock Clock;
+
+const size_t FrameSize = 16;
+const size_t Budget = 1024 * 1024;
+
+//frame content is its time, to check frames are copied
+void capture( LoopClip& clip, int64_t time, bool framesLost = false )
+{
+    std::vector<unsigned char> data( FrameSize, static_cast<unsigned char>( time ) );
+    clip.capture( time, data.data(), data.size(), framesLost );
+}
+
+int64_t presented( LoopClip& clip, Clock::time_point now, double rate = 1.0 )
+{
+    const LoopClip::Frame* frame = clip.present( now, rate );
+    return frame ? frame->time : -1;
+}
+
+Clock::time_point after( Clock::time_point time, int ms )
+{
+    return time + std::chrono::milliseconds( ms );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void testReplay()
+{
+    LoopClip clip;
+    clip.reset( nullptr, 40, 0, 200, Budget );
+
+    const Clock::time_point start = Clock::now();
+    //not captured yet
+    CHECK_EQ( presented( clip, start ), -1 );
+
+    for( int64_t time = 0; time < 200; time += 40 )
+        capture( clip, time );
+    //outside of range
+    capture( clip, 200 );
+
+    CHECK( clip.finish() );
+    CHECK( clip.complete() );
+
+    clip.startReplay( 0, start );
+    const LoopClip::Frame* frame = clip.present( start, 1.0 );
+    CHECK( frame );
+    if( frame ) {
+        CHECK_EQ( frame->time, 0 );
+        CHECK_EQ( frame->buffer.size(), FrameSize );
+    }
+    CHECK_EQ( presented( clip, after( start, 20 ) ), -1 );
+    //shown frame is still actual
+    CHECK_EQ( presented( clip, after( start, 39 ) ), -1 );
+    const LoopClip::Frame* second = clip.present( after( start, 40 ), 1.0 );
+    CHECK( second && 40 == second->buffer.data()[0] );
+    //the last frame lasts up to the end of range, then replay wraps without gap
+    CHECK_EQ( presented( clip, after( start, 199 ) ), 160 );
+    CHECK_EQ( presented( clip, after( start, 210 ) ), 0 );
+
+    //rate scales clock, 0 holds it
+    clip.startReplay( 0, start );
+    CHECK_EQ( presented( clip, start, 2.0 ), 0 );
+    CHECK_EQ( presented( clip, after( start, 40 ), 2.0 ), 80 );
+    CHECK_EQ( presented( clip, after( start, 1000 ), 0.0 ), -1 );
+
+    //replay starts at the nearest captured frame
+    clip.startReplay( 130, start );
+    CHECK_EQ( presented( clip, start ), 120 );
+}
+
+void testGaps()
+{
+    LoopClip clip;
+    clip.reset( nullptr, 40, 0, 200, Budget );
+
+    //frames with gap can't be replayed
+    capture( clip, 0 );
+    capture( clip, 40 );
+    capture( clip, 120 );
+    capture( clip, 160 );
+    CHECK( !clip.finish() );
+    CHECK( !clip.complete() );
+
+    //lost frames too
+    capture( clip, 0 );
+    capture( clip, 40, true );
+    capture( clip, 80 );
+    capture( clip, 120 );
+    capture( clip, 160 );
+    CHECK( !clip.finish() );
+
+    //capture stopped before the end of range
+    capture( clip, 0 );
+    capture( clip, 40 );
+    CHECK( !clip.finish() );
+
+    //next pass starts over from the first frame
+    for( int64_t time = 0; time < 200; time += 40 )
+        capture( clip, time );
+    CHECK( clip.finish() );
+
+    //complete clip is not recaptured
+    capture( clip, 0 );
+    CHECK( clip.complete() );
+}
+
+void testBudget()
+{
+    LoopClip clip;
+    clip.reset( nullptr, 40, 0, 200, FrameSize * 3 );
+
+    for( int64_t time = 0; time < 200; time += 40 )
+        capture( clip, time );
+    CHECK( clip.overBudget() );
+    CHECK( !clip.finish() );
+
+    //the range is kept, but budget flag is reset
+    clip.reset( nullptr, 40, 0, 200, Budget );
+    CHECK( !clip.overBudget() );
+    CHECK_EQ( clip.in(), 0 );
+    CHECK_EQ( clip.out(), 200 );
+}
+
+void testIndex()
+{
+    Mp4Track track;
+    track.stts = { { 10, 40 } };
+    const char mediaPath[] = "loop_clip_test.mp4";
+    CHECK( writeFile( mediaPath, makeMp4( { track } ) ) );
+    std::shared_ptr<MediaIndex> index = MediaIndex::build( mediaPath );
+    remove( mediaPath );
+    CHECK( index );
+    if( !index )
+        return;
+
+    //loop starts exactly at the first frame of range
+    LoopClip clip;
+    clip.reset( index, 40, 50, 200, Budget );
+    CHECK_EQ( clip.in(), 80 );
+    CHECK_EQ( clip.out(), 200 );
+
+    //sampled times are snapped to frames, repeated frames are skipped
+    capture( clip, 80 );
+    capture( clip, 121 );
+    capture( clip, 130 );
+    capture( clip, 160 );
+    CHECK( clip.finish() );
+
+    const Clock::time_point start = Clock::now();
+    clip.startReplay( 0, start );
+    CHECK_EQ( presented( clip, start ), 80 );
+    CHECK_EQ( presented( clip, after( start, 40 ) ), 120 );
+    CHECK_EQ( presented( clip, after( start, 80 ) ), 160 );
+    CHECK_EQ( presented( clip, after( start, 120 ) ), 80 );
+
+    //missing frame of index
+    clip.reset( index, 40, 50, 200, Budget );
+    capture( clip, 80 );
+    capture( clip, 160 );
+    CHECK( !clip.finish() );
+}
+
+}
+
+int main()
+{
+    testReplay();
+    testGaps();
+    testBudget();
+    testIndex();
+
+    return checksResult( "loop_clip_test" );
+}
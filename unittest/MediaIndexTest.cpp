@@ -0,0 +1,367 @@
+// MediaIndex: sample table parsing, sidecar round-trip and frame lookups.
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <sys/utime.h>
+#else
+    #include <utime.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MediaIndex.h"
+
+#include "Check.h"
+#include "Mp4Fixture.h"
+
+namespace {
+
+const char MediaPath[] = "media_index_test.mp4";
+
+std::shared_ptr<MediaIndex> buildIndex( const std::vector<Mp4Track>& tracks, uint32_t movieTimescale = 1000 )
+{
+    if( !writeFile( MediaPath, makeMp4( tracks, movieTimescale ) ) )
+        return std::shared_ptr<MediaIndex>();
+
+    return MediaIndex::build( MediaPath );
+}
+
+std::shared_ptr<MediaIndex> buildIndex( const Mp4Track& track, uint32_t movieTimescale = 1000 )
+{
+    return buildIndex( std::vector<Mp4Track>( 1, track ), movieTimescale );
+}
+
+void setModificationTime( const char* path, time_t time )
+{
+#ifdef _WIN32
+    struct _utimbuf times = { time, time };
+    _utime( path, &times );
+#else
+    struct utimbuf times = { time, time };
+    utime( path, &times );
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void testStts()
+{
+    Mp4Track track;
+    track.stts = { { 3, 40 }, { 2, 20 } };
+
+    std::shared_ptr<MediaIndex> index = buildIndex( track );
+    CHECK( index );
+    if( !index )
+        return;
+
+    CHECK_EQ( index->frameCount(), 5 );
+    const int64_t times[] = { 0, 40000, 80000, 120000, 140000 };
+    for( unsigned i = 0; i < 5; ++i ) {
+        CHECK_EQ( index->frameTime( i ), times[i] );
+        //no stss means every sample is sync one
+        CHECK( index->isKeyframe( i ) );
+    }
+
+    //media timescale is converted to microseconds
+    track.timescale = 90000;
+    track.stts = { { 2, 3000 } };
+    index = buildIndex( track );
+    CHECK( index );
+    if( index ) {
+        CHECK_EQ( index->frameTime( 0 ), 0 );
+        CHECK_EQ( index->frameTime( 1 ), 33333 );
+    }
+}
+
+void testCtts()
+{
+    //I P B B in decode order, presented as I B B P
+    Mp4Track track;
+    track.stts = { { 4, 40 } };
+    track.ctts = { { 1, 40 }, { 1, 120 }, { 2, 0 } };
+    track.hasStss = true;
+    track.stss = { 1 };
+
+    std::shared_ptr<MediaIndex> index = buildIndex( track );
+    CHECK( index );
+    if( !index )
+        return;
+
+    CHECK_EQ( index->frameCount(), 4 );
+    const int64_t times[] = { 40000, 80000, 120000, 160000 };
+    for( unsigned i = 0; i < 4; ++i )
+        CHECK_EQ( index->frameTime( i ), times[i] );
+
+    CHECK( index->isKeyframe( 0 ) );
+    CHECK( !index->isKeyframe( 1 ) );
+    CHECK( !index->isKeyframe( 3 ) );
+
+    //negative offsets of version 1, keyframe flag follows sample to its presentation place
+    track.stts = { { 3, 40 } };
+    track.ctts = { { 1, 40 }, { 1, -40 }, { 1, 0 } };
+    track.cttsVersion = 1;
+    index = buildIndex( track );
+    CHECK( index );
+    if( !index )
+        return;
+
+    CHECK_EQ( index->frameCount(), 3 );
+    CHECK_EQ( index->frameTime( 0 ), 0 );
+    CHECK_EQ( index->frameTime( 1 ), 40000 );
+    CHECK_EQ( index->frameTime( 2 ), 80000 );
+    CHECK( !index->isKeyframe( 0 ) );
+    CHECK( index->isKeyframe( 1 ) );
+}
+
+void testElst()
+{
+    Mp4Track track;
+    track.stts = { { 4, 40 } };
+
+    //samples before media start are not presented
+    track.elst = { { 1000, 80 } };
+    std::shared_ptr<MediaIndex> index = buildIndex( track );
+    CHECK( index );
+    if( index ) {
+        CHECK_EQ( index->frameCount(), 2 );
+        CHECK_EQ( index->frameTime( 0 ), 0 );
+        CHECK_EQ( index->frameTime( 1 ), 40000 );
+    }
+
+    //empty edit delays start, its duration is in movie timescale
+    track.elst = { { 500, -1 }, { 1000, 0 } };
+    index = buildIndex( track );
+    CHECK( index );
+    if( index ) {
+        CHECK_EQ( index->frameCount(), 4 );
+        CHECK_EQ( index->frameTime( 0 ), 500000 );
+        CHECK_EQ( index->frameTime( 3 ), 620000 );
+    }
+
+    track.elstVersion = 1;
+    track.elst = { { 1000, -1 }, { 4000, 0 } };
+    index = buildIndex( track, 2000 );
+    CHECK( index );
+    if( index ) {
+        CHECK_EQ( index->frameCount(), 4 );
+        CHECK_EQ( index->frameTime( 0 ), 500000 );
+        CHECK_EQ( index->frameTime( 1 ), 540000 );
+    }
+}
+
+void testKeyframes()
+{
+    Mp4Track track;
+    track.stts = { { 10, 40 } };
+    track.hasStss = true;
+    //out of range sample numbers are ignored
+    track.stss = { 0, 1, 5, 9, 11 };
+
+    std::shared_ptr<MediaIndex> index = buildIndex( track );
+    CHECK( index );
+    if( !index )
+        return;
+
+    CHECK_EQ( index->frameCount(), 10 );
+    CHECK( index->isKeyframe( 0 ) );
+    CHECK( !index->isKeyframe( 1 ) );
+    CHECK( index->isKeyframe( 4 ) );
+    CHECK( index->isKeyframe( 8 ) );
+    CHECK( !index->isKeyframe( 9 ) );
+
+    CHECK_EQ( index->keyframeBefore( 0 ), 0 );
+    CHECK_EQ( index->keyframeBefore( 3 ), 0 );
+    CHECK_EQ( index->keyframeBefore( 4 ), 4 );
+    CHECK_EQ( index->keyframeBefore( 7 ), 4 );
+    CHECK_EQ( index->keyframeBefore( 9 ), 8 );
+
+    CHECK_EQ( index->seekCost( 4 ), 1 );
+    CHECK_EQ( index->seekCost( 7 ), 4 );
+
+    CHECK_EQ( index->stepsTo( 1, 3 ), 2 );
+    CHECK_EQ( index->stepsTo( 4, 7 ), 3 );
+    //keyframe in between, seek is as cheap
+    CHECK_EQ( index->stepsTo( 3, 5 ), 0 );
+    CHECK_EQ( index->stepsTo( 5, 5 ), 0 );
+    CHECK_EQ( index->stepsTo( 6, 2 ), 0 );
+
+    //frameAt() boundaries
+    CHECK_EQ( index->frameAt( -1 ), 0 );
+    CHECK_EQ( index->frameAt( 0 ), 0 );
+    CHECK_EQ( index->frameAt( 39999 ), 0 );
+    CHECK_EQ( index->frameAt( 40000 ), 1 );
+    CHECK_EQ( index->frameAt( 40001 ), 1 );
+    CHECK_EQ( index->frameAt( 360000 ), 9 );
+    CHECK_EQ( index->frameAt( 1000000000 ), 9 );
+}
+
+void testTrackSelection()
+{
+    Mp4Track audio;
+    audio.handler = "soun";
+    audio.stts = { { 100, 1024 } };
+
+    Mp4Track video;
+    video.stts = { { 2, 40 } };
+
+    std::shared_ptr<MediaIndex> index = buildIndex( { audio, video } );
+    CHECK( index );
+    if( index )
+        CHECK_EQ( index->frameCount(), 2 );
+
+    CHECK( !buildIndex( audio ) );
+
+    //track without samples
+    video.stts.clear();
+    CHECK( !buildIndex( video ) );
+}
+
+void testBrokenFiles()
+{
+    Mp4Track track;
+    track.stts = { { 2, 40 } };
+
+    //stts entry count which doesn't fit the box
+    std::vector<uint8_t> mp4 = makeMp4( { track } );
+    const uint8_t sttsTag[] = { 's', 't', 't', 's' };
+    auto stts = std::search( mp4.begin(), mp4.end(), sttsTag, sttsTag + 4 );
+    CHECK( stts != mp4.end() );
+    if( stts != mp4.end() ) {
+        stts[9] = 0x10;
+        CHECK( writeFile( MediaPath, mp4 ) );
+        CHECK( !MediaIndex::build( MediaPath ) );
+    }
+
+    //box size beyond the end of file
+    mp4 = makeMp4( { track } );
+    mp4.resize( mp4.size() - 4 );
+    CHECK( writeFile( MediaPath, mp4 ) );
+    CHECK( !MediaIndex::build( MediaPath ) );
+
+    CHECK( writeFile( MediaPath, std::vector<uint8_t>( 100, 0 ) ) );
+    CHECK( !MediaIndex::build( MediaPath ) );
+
+    CHECK( writeFile( MediaPath, std::vector<uint8_t>() ) );
+    CHECK( !MediaIndex::build( MediaPath ) );
+
+    CHECK( !MediaIndex::build( "media_index_test_missing.mp4" ) );
+}
+
+void testCancel()
+{
+    Mp4Track track;
+    track.stts = { { 2, 40 } };
+    CHECK( writeFile( MediaPath, makeMp4( { track } ) ) );
+
+    std::atomic<bool> cancelled( true );
+    CHECK( !MediaIndex::build( MediaPath, &cancelled ) );
+    CHECK( !MediaIndex::open( MediaPath, std::string(), &cancelled ) );
+
+    cancelled = false;
+    CHECK( MediaIndex::build( MediaPath, &cancelled ) );
+}
+
+void testSidecar()
+{
+    //nested directories are created by MediaIndex itself
+    const std::string cacheDir = "media_index_test.cache/nested";
+    const time_t mediaTime = 1000000000;
+
+    Mp4Track track;
+    track.stts = { { 5, 40 } };
+    track.hasStss = true;
+    track.stss = { 1, 4 };
+    CHECK( writeFile( MediaPath, makeMp4( { track } ) ) );
+    setModificationTime( MediaPath, mediaTime );
+
+    std::shared_ptr<MediaIndex> built = MediaIndex::open( MediaPath, cacheDir );
+    CHECK( built );
+    if( !built )
+        return;
+    CHECK_EQ( built->frameCount(), 5 );
+    CHECK_EQ( built->frameTime( 4 ), 160000 );
+
+    //same size and modification time, so sidecar is taken as is,
+    //which proves it keeps everything index was built with
+    track.stts = { { 5, 20 } };
+    track.stss = { 2, 5 };
+    CHECK( writeFile( MediaPath, makeMp4( { track } ) ) );
+    setModificationTime( MediaPath, mediaTime );
+
+    std::shared_ptr<MediaIndex> mapped = MediaIndex::open( MediaPath, cacheDir );
+    CHECK( mapped );
+    if( mapped ) {
+        CHECK_EQ( mapped->frameCount(), built->frameCount() );
+        for( unsigned i = 0; i < mapped->frameCount() && i < built->frameCount(); ++i ) {
+            CHECK_EQ( mapped->frameTime( i ), built->frameTime( i ) );
+            CHECK_EQ( mapped->isKeyframe( i ), built->isKeyframe( i ) );
+        }
+    }
+
+    //modified media invalidates sidecar
+    setModificationTime( MediaPath, mediaTime + 1 );
+    std::shared_ptr<MediaIndex> rebuilt = MediaIndex::open( MediaPath, cacheDir );
+    CHECK( rebuilt );
+    if( rebuilt ) {
+        CHECK_EQ( rebuilt->frameTime( 4 ), 80000 );
+        CHECK( !rebuilt->isKeyframe( 0 ) );
+        CHECK( rebuilt->isKeyframe( 1 ) );
+    }
+
+    //and the new one is kept instead
+    std::shared_ptr<MediaIndex> remapped = MediaIndex::open( MediaPath, cacheDir );
+    CHECK( remapped );
+    if( remapped )
+        CHECK_EQ( remapped->frameTime( 4 ), 80000 );
+
+    //without cache directory index is just built
+    std::shared_ptr<MediaIndex> uncached = MediaIndex::open( MediaPath, std::string() );
+    CHECK( uncached );
+    if( uncached )
+        CHECK_EQ( uncached->frameCount(), 5 );
+}
+
+void testMrlToPath()
+{
+    std::string path;
+#ifndef _WIN32
+    CHECK( MediaIndex::mrlToPath( "file:///tmp/a%20b.mp4", &path ) );
+    CHECK( "/tmp/a b.mp4" == path );
+#else
+    CHECK( MediaIndex::mrlToPath( "file:///C:/a%20b.mp4", &path ) );
+    CHECK( "C:/a b.mp4" == path );
+#endif
+
+    CHECK( MediaIndex::mrlToPath( "video.mp4", &path ) );
+    CHECK( "video.mp4" == path );
+
+    CHECK( !MediaIndex::mrlToPath( "", &path ) );
+    CHECK( !MediaIndex::mrlToPath( "http://host/video.mp4", &path ) );
+    CHECK( !MediaIndex::mrlToPath( "file://host/video.mp4", &path ) );
+    CHECK( !MediaIndex::mrlToPath( "file://", &path ) );
+}
+
+}
+
+int main()
+{
+    testStts();
+    testCtts();
+    testElst();
+    testKeyframes();
+    testTrackSelection();
+    testBrokenFiles();
+    testCancel();
+    testSidecar();
+    testMrlToPath();
+
+    remove( MediaPath );
+
+    return checksResult( "media_index_test" );
+}
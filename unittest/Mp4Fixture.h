@@ -0,0 +1,161 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Hand-built MP4 files with just the boxes MediaIndex reads.
+
+///////////////////////////////////////////////////////////////////////////////
+class Mp4Writer
+{
+public:
+    void u8( uint8_t v )
+        { data.push_back( v ); }
+    void u32( uint32_t v )
+        { for( int s = 24; s >= 0; s -= 8 ) u8( static_cast<uint8_t>( v >> s ) ); }
+    void u64( uint64_t v )
+        { u32( static_cast<uint32_t>( v >> 32 ) ); u32( static_cast<uint32_t>( v ) ); }
+    void tag( const char* t )
+        { for( int i = 0; i < 4; ++i ) u8( static_cast<uint8_t>( t[i] ) ); }
+    void zeros( size_t count )
+        { data.insert( data.end(), count, 0 ); }
+
+    size_t begin( const char* type )
+        { const size_t start = data.size(); u32( 0 ); tag( type ); return start; }
+    void end( size_t start )
+    {
+        const uint32_t size = static_cast<uint32_t>( data.size() - start );
+        for( int i = 0; i < 4; ++i )
+            data[start + i] = static_cast<uint8_t>( size >> ( 24 - 8 * i ) );
+    }
+
+    std::vector<uint8_t> data;
+};
+
+struct Mp4Track
+{
+    Mp4Track() :
+        handler( "vide" ), timescale( 1000 ), cttsVersion( 0 ), hasStss( false ), elstVersion( 0 ) {}
+
+    const char* handler;
+    uint32_t timescale;
+    //sample count, sample delta
+    std::vector<std::pair<uint32_t, uint32_t> > stts;
+    //sample count, composition offset, no ctts box if empty
+    std::vector<std::pair<uint32_t, int32_t> > ctts;
+    uint8_t cttsVersion;
+    //1-based sync sample numbers
+    std::vector<uint32_t> stss;
+    bool hasStss;
+    //segment duration in movie timescale, media time in track timescale, no edts box if empty
+    std::vector<std::pair<int64_t, int64_t> > elst;
+    uint8_t elstVersion;
+};
+
+inline void writeTrack( Mp4Writer& w, const Mp4Track& track )
+{
+    const size_t trak = w.begin( "trak" );
+
+    if( !track.elst.empty() ) {
+        const size_t edts = w.begin( "edts" );
+        const size_t elst = w.begin( "elst" );
+        w.u32( static_cast<uint32_t>( track.elstVersion ) << 24 );
+        w.u32( static_cast<uint32_t>( track.elst.size() ) );
+        for( const auto& entry: track.elst ) {
+            if( 1 == track.elstVersion ) {
+                w.u64( static_cast<uint64_t>( entry.first ) );
+                w.u64( static_cast<uint64_t>( entry.second ) );
+            } else {
+                w.u32( static_cast<uint32_t>( entry.first ) );
+                w.u32( static_cast<uint32_t>( entry.second ) );
+            }
+            w.u32( 0x00010000 );
+        }
+        w.end( elst );
+        w.end( edts );
+    }
+
+    const size_t mdia = w.begin( "mdia" );
+    size_t box = w.begin( "mdhd" );
+    w.u32( 0 ); w.u32( 0 ); w.u32( 0 ); w.u32( track.timescale ); w.u32( 0 );
+    w.u32( 0 );
+    w.end( box );
+
+    box = w.begin( "hdlr" );
+    w.u32( 0 ); w.u32( 0 ); w.tag( track.handler ); w.zeros( 12 ); w.u8( 0 );
+    w.end( box );
+
+    const size_t minf = w.begin( "minf" );
+    const size_t stbl = w.begin( "stbl" );
+
+    box = w.begin( "stts" );
+    w.u32( 0 ); w.u32( static_cast<uint32_t>( track.stts.size() ) );
+    for( const auto& entry: track.stts ) {
+        w.u32( entry.first ); w.u32( entry.second );
+    }
+    w.end( box );
+
+    if( !track.ctts.empty() ) {
+        box = w.begin( "ctts" );
+        w.u32( static_cast<uint32_t>( track.cttsVersion ) << 24 );
+        w.u32( static_cast<uint32_t>( track.ctts.size() ) );
+        for( const auto& entry: track.ctts ) {
+            w.u32( entry.first ); w.u32( static_cast<uint32_t>( entry.second ) );
+        }
+        w.end( box );
+    }
+
+    if( track.hasStss ) {
+        box = w.begin( "stss" );
+        w.u32( 0 ); w.u32( static_cast<uint32_t>( track.stss.size() ) );
+        for( uint32_t sample: track.stss )
+            w.u32( sample );
+        w.end( box );
+    }
+
+    w.end( stbl );
+    w.end( minf );
+    w.end( mdia );
+    w.end( trak );
+}
+
+inline std::vector<uint8_t> makeMp4( const std::vector<Mp4Track>& tracks, uint32_t movieTimescale = 1000 )
+{
+    Mp4Writer w;
+
+    size_t box = w.begin( "ftyp" );
+    w.tag( "isom" ); w.u32( 512 ); w.tag( "isom" ); w.tag( "mp41" );
+    w.end( box );
+
+    //media data is irrelevant for index
+    box = w.begin( "mdat" );
+    w.zeros( 64 );
+    w.end( box );
+
+    const size_t moov = w.begin( "moov" );
+    box = w.begin( "mvhd" );
+    w.u32( 0 ); w.u32( 0 ); w.u32( 0 ); w.u32( movieTimescale ); w.u32( 0 );
+    w.zeros( 80 );
+    w.end( box );
+
+    for( const Mp4Track& track: tracks )
+        writeTrack( w, track );
+
+    w.end( moov );
+
+    return w.data;
+}
+
+inline bool writeFile( const std::string& path, const std::vector<uint8_t>& data )
+{
+    FILE* file = fopen( path.c_str(), "wb" );
+    if( !file )
+        return false;
+
+    const bool written = data.empty() || 1 == fwrite( data.data(), data.size(), 1, file );
+    return 0 == fclose( file ) && written;
+}
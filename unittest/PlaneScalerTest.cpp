@@ -0,0 +1,201 @@
+// PlaneScaler: exact copies at 1:1, averaging on downscale, regions, channels and bands.
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "PlaneScaler.h"
+#include "WorkerPool.h"
+
+#include "Check.h"
+
+namespace {
+
+struct Plane
+{
+    Plane( unsigned width, unsigned height, unsigned channels = 1 ) :
+        width( width ), height( height ), channels( channels ),
+        pitch( width * channels + 8 ), samples( pitch * height, 0xCD ) {}
+
+    uint8_t& at( unsigned x, unsigned y, unsigned channel = 0 )
+        { return samples[y * pitch + x * channels + channel]; }
+
+    unsigned width;
+    unsigned height;
+    unsigned channels;
+    unsigned pitch;
+    std::vector<uint8_t> samples;
+};
+
+void scale( Plane& source, Plane* target,
+            double x, double y, double width, double height,
+            WorkerPool* pool = nullptr )
+{
+    PlaneScaler scaler;
+    scaler.setup( source.channels, source.width, source.height,
+                  x, y, width, height,
+                  target->width, target->height );
+    scaler.scale( source.samples.data(), source.pitch,
+                  target->samples.data(), target->pitch,
+                  pool );
+}
+
+void scale( Plane& source, Plane* target, WorkerPool* pool = nullptr )
+{
+    scale( source, target, 0, 0, source.width, source.height, pool );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void testIdentity()
+{
+    Plane source( 17, 9 );
+    for( unsigned y = 0; y < source.height; ++y ) {
+        for( unsigned x = 0; x < source.width; ++x )
+            source.at( x, y ) = static_cast<uint8_t>( x * 13 + y * 29 );
+    }
+
+    Plane target( 17, 9 );
+    scale( source, &target );
+
+    unsigned mismatches = 0;
+    for( unsigned y = 0; y < target.height; ++y ) {
+        for( unsigned x = 0; x < target.width; ++x )
+            mismatches += target.at( x, y ) != source.at( x, y );
+    }
+    CHECK_EQ( mismatches, 0 );
+
+    //padding after row is never written
+    CHECK_EQ( target.samples[target.width], 0xCD );
+}
+
+void testRegion()
+{
+    Plane source( 16, 16 );
+    for( unsigned y = 0; y < source.height; ++y ) {
+        for( unsigned x = 0; x < source.width; ++x )
+            source.at( x, y ) = static_cast<uint8_t>( y * 16 + x );
+    }
+
+    //region of target size is plain crop
+    Plane target( 4, 5 );
+    scale( source, &target, 3, 6, 4, 5 );
+
+    unsigned mismatches = 0;
+    for( unsigned y = 0; y < target.height; ++y ) {
+        for( unsigned x = 0; x < target.width; ++x )
+            mismatches += target.at( x, y ) != source.at( x + 3, y + 6 );
+    }
+    CHECK_EQ( mismatches, 0 );
+}
+
+void testDownscale()
+{
+    //vertical stripes, one sample wide
+    Plane source( 64, 8 );
+    for( unsigned y = 0; y < source.height; ++y ) {
+        for( unsigned x = 0; x < source.width; ++x )
+            source.at( x, y ) = x & 1 ? 255 : 0;
+    }
+
+    //every covered sample contributes, so stripes are averaged, not aliased
+    Plane target( 32, 4 );
+    scale( source, &target );
+
+    unsigned outliers = 0;
+    for( unsigned y = 0; y < target.height; ++y ) {
+        for( unsigned x = 1; x + 1 < target.width; ++x )
+            outliers += target.at( x, y ) < 127 || target.at( x, y ) > 128;
+    }
+    CHECK_EQ( outliers, 0 );
+
+    //flat plane stays flat at any scale
+    Plane flat( 50, 30 );
+    for( unsigned y = 0; y < flat.height; ++y ) {
+        for( unsigned x = 0; x < flat.width; ++x )
+            flat.at( x, y ) = 77;
+    }
+
+    const unsigned sizes[][2] = { { 7, 3 }, { 25, 15 }, { 49, 31 }, { 120, 70 }, { 1, 1 } };
+    for( const auto& size: sizes ) {
+        Plane scaled( size[0], size[1] );
+        scale( flat, &scaled );
+
+        unsigned changed = 0;
+        for( unsigned y = 0; y < scaled.height; ++y ) {
+            for( unsigned x = 0; x < scaled.width; ++x )
+                changed += scaled.at( x, y ) != 77;
+        }
+        CHECK_EQ( changed, 0 );
+    }
+}
+
+void testUpscale()
+{
+    Plane source( 2, 1 );
+    source.at( 0, 0 ) = 0;
+    source.at( 1, 0 ) = 200;
+
+    //linear interpolation between samples, edges are repeated
+    Plane target( 4, 2 );
+    scale( source, &target );
+
+    CHECK_EQ( target.at( 0, 0 ), 0 );
+    CHECK_EQ( target.at( 1, 0 ), 50 );
+    CHECK_EQ( target.at( 2, 0 ), 150 );
+    CHECK_EQ( target.at( 3, 0 ), 200 );
+    CHECK_EQ( target.at( 2, 1 ), 150 );
+}
+
+void testChannels()
+{
+    //interleaved samples like NV12 chroma or RGBA are not mixed
+    Plane source( 40, 20, 2 );
+    for( unsigned y = 0; y < source.height; ++y ) {
+        for( unsigned x = 0; x < source.width; ++x ) {
+            source.at( x, y, 0 ) = 16;
+            source.at( x, y, 1 ) = 240;
+        }
+    }
+
+    Plane target( 13, 7, 2 );
+    scale( source, &target );
+
+    unsigned mixed = 0;
+    for( unsigned y = 0; y < target.height; ++y ) {
+        for( unsigned x = 0; x < target.width; ++x )
+            mixed += target.at( x, y, 0 ) != 16 || target.at( x, y, 1 ) != 240;
+    }
+    CHECK_EQ( mixed, 0 );
+}
+
+void testBands()
+{
+    //large enough to be split into bands
+    Plane source( 1920, 1080 );
+    srand( 1 );
+    for( unsigned y = 0; y < source.height; ++y ) {
+        for( unsigned x = 0; x < source.width; ++x )
+            source.at( x, y ) = static_cast<uint8_t>( rand() );
+    }
+
+    Plane single( 1280, 720 );
+    scale( source, &single, 100.5, 50.25, 1700, 1000 );
+    Plane banded( 1280, 720 );
+    scale( source, &banded, 100.5, 50.25, 1700, 1000, &WorkerPool::instance() );
+
+    CHECK( single.samples == banded.samples );
+}
+
+}
+
+int main()
+{
+    testIdentity();
+    testRegion();
+    testDownscale();
+    testUpscale();
+    testChannels();
+    testBands();
+
+    return checksResult( "plane_scaler_test" );
+}
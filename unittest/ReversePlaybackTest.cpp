@@ -0,0 +1,163 @@
+// ReversePlayback: segment planning with and without index, backward presentation clock.
+
+#include <stdio.h>
+
+#include <memory>
+#include <vector>
+
+#include "ReversePlayback.h"
+#include "MediaIndex.h"
+
+#include "Check.h"
+#include "Mp4Fixture.h"
+
+namespace {
+
+typedef ReversePlayback::Clock Clock;
+
+const size_t FrameSize = 16;
+
+void addFrames( ReversePlayback& reverse, unsigned count )
+{
+    std::vector<unsigned char> data( FrameSize, 0 );
+    for( unsigned i = 0; i < count; ++i ) {
+        //decoder is asked to step to the next frame of segment, except for the last one
+        CHECK_EQ( reverse.addFrame( data.data(), data.size() ), i + 1 < count );
+    }
+}
+
+int64_t presented( ReversePlayback& reverse, Clock::time_point now, double rate = 1.0 )
+{
+    const ReversePlayback::Frame* frame = reverse.present( now, rate );
+    return frame ? frame->time : -1;
+}
+
+Clock::time_point after( Clock::time_point time, int ms )
+{
+    return time + std::chrono::milliseconds( ms );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void testWithoutIndex()
+{
+    ReversePlayback reverse;
+    CHECK( !reverse.active() );
+
+    reverse.start( nullptr, 40, 400, FrameSize );
+    CHECK( reverse.active() );
+    CHECK( !reverse.finished() );
+
+    //nothing is decoded yet
+    const Clock::time_point start = Clock::now();
+    CHECK_EQ( presented( reverse, start ), -1 );
+
+    //the whole range before the shown frame fits into one segment
+    int64_t seekTime = -1;
+    CHECK( reverse.beginSegment( &seekTime ) );
+    CHECK_EQ( seekTime, 0 );
+    CHECK( reverse.decoding() );
+    CHECK( !reverse.beginSegment( &seekTime ) );
+
+    addFrames( reverse, 10 );
+    CHECK( !reverse.decoding() );
+    //addFrame() outside of segment is ignored
+    std::vector<unsigned char> data( FrameSize, 0 );
+    CHECK( !reverse.addFrame( data.data(), data.size() ) );
+
+    //media start was reached, so there is nothing more to decode
+    CHECK( !reverse.beginSegment( &seekTime ) );
+
+    //frames go backwards from the one before the shown one
+    CHECK_EQ( presented( reverse, start ), 360 );
+    //shown frame lasts back to its own time
+    CHECK_EQ( presented( reverse, after( start, 40 ) ), -1 );
+    CHECK_EQ( presented( reverse, after( start, 60 ) ), 320 );
+    //clock runs with rate
+    CHECK_EQ( presented( reverse, after( start, 80 ), 2.0 ), 280 );
+
+    //clock stops at the first frame of media
+    CHECK_EQ( presented( reverse, after( start, 10000 ) ), 0 );
+    CHECK( reverse.finished() );
+    CHECK_EQ( presented( reverse, after( start, 10040 ) ), -1 );
+
+    reverse.stop();
+    CHECK( !reverse.active() );
+    CHECK( !reverse.finished() );
+    CHECK_EQ( presented( reverse, after( start, 10080 ) ), -1 );
+}
+
+void testMemoryBound()
+{
+    //only two frames of this size fit into half of memory budget
+    const size_t frameSize = 64 * 1024 * 1024;
+
+    ReversePlayback reverse;
+    reverse.start( nullptr, 40, 400, frameSize );
+
+    int64_t seekTime = -1;
+    CHECK( reverse.beginSegment( &seekTime ) );
+    CHECK_EQ( seekTime, 320 );
+    addFrames( reverse, 2 );
+}
+
+void testWithIndex()
+{
+    //20 frames 40 ms each, keyframes are the first and 11th frames
+    Mp4Track track;
+    track.stts = { { 20, 40 } };
+    track.hasStss = true;
+    track.stss = { 1, 11 };
+    const char mediaPath[] = "reverse_playback_test.mp4";
+    CHECK( writeFile( mediaPath, makeMp4( { track } ) ) );
+    std::shared_ptr<MediaIndex> index = MediaIndex::build( mediaPath );
+    remove( mediaPath );
+    CHECK( index );
+    if( !index )
+        return;
+
+    ReversePlayback reverse;
+    //time in the middle of frame 15
+    reverse.start( index, 40, 610, FrameSize );
+
+    //segment starts at keyframe before the shown frame
+    int64_t seekTime = -1;
+    CHECK( reverse.beginSegment( &seekTime ) );
+    CHECK_EQ( seekTime, 400 );
+    addFrames( reverse, 5 );
+
+    //decoded segment waits until presentation picks it up
+    CHECK( !reverse.beginSegment( &seekTime ) );
+
+    const Clock::time_point start = Clock::now();
+    CHECK_EQ( presented( reverse, start ), 560 );
+
+    //preceding GOP is decoded while this one is presented
+    CHECK( reverse.beginSegment( &seekTime ) );
+    CHECK_EQ( seekTime, 0 );
+
+    CHECK_EQ( presented( reverse, after( start, 80 ) ), 520 );
+
+    //decoder is late, so clock waits at the first frame of presented segment
+    CHECK_EQ( presented( reverse, after( start, 1000 ) ), 400 );
+    CHECK_EQ( presented( reverse, after( start, 2000 ) ), -1 );
+    CHECK( !reverse.finished() );
+
+    addFrames( reverse, 10 );
+    CHECK_EQ( presented( reverse, after( start, 2040 ) ), 360 );
+    CHECK_EQ( presented( reverse, after( start, 2080 ) ), 320 );
+    CHECK( !reverse.beginSegment( &seekTime ) );
+
+    CHECK_EQ( presented( reverse, after( start, 5000 ) ), 0 );
+    CHECK( reverse.finished() );
+}
+
+}
+
+int main()
+{
+    testWithoutIndex();
+    testMemoryBound();
+    testWithIndex();
+
+    return checksResult( "reverse_playback_test" );
+}
@@ -0,0 +1,83 @@
+// SeekMatcher: stale frames, rounded times, frames displayed before reported time and steps.
+
+#include "SeekMatcher.h"
+
+#include "Check.h"
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+void testStaleFrames()
+{
+    SeekMatcher matcher;
+    matcher.start( 10, 0, 20 );
+
+    //frames displayed before the seek already could have the new time
+    CHECK( !matcher.matches( 1000, 9, 1000 ) );
+    CHECK( !matcher.matches( 1000, 10, 1000 ) );
+    CHECK( matcher.matches( 1000, 11, 1000 ) );
+}
+
+void testTolerance()
+{
+    SeekMatcher matcher;
+    matcher.start( 10, 0, 20 );
+
+    //position seeks are rounded, so frame time is close to the target, but not equal
+    CHECK( matcher.matches( 1019, 11, 1000 ) );
+    CHECK( matcher.matches( 980, 11, 1000 ) );
+    CHECK( !matcher.matches( 1021, 11, 1000 ) );
+    CHECK( !matcher.matches( 500, 11, 1000 ) );
+}
+
+void testReportedTime()
+{
+    SeekMatcher matcher;
+    matcher.start( 10, 0, 20 );
+
+    //frame displayed before time was reported is stamped with time from before the seek
+    CHECK( !matcher.matches( 500, 11, 1000 ) );
+    CHECK( !matcher.matchesReported( 11 ) );
+
+    //time of some older event
+    matcher.timeReported( 500, 1000 );
+    CHECK( !matcher.matchesReported( 11 ) );
+
+    matcher.timeReported( 1033, 1000 );
+    CHECK( matcher.matchesReported( 11 ) );
+    CHECK( !matcher.matchesReported( 10 ) );
+    //frames displayed after the reported time match whatever they are stamped with
+    CHECK( matcher.matches( 1040, 12, 1000 ) );
+
+    //new seek forgets reported time
+    matcher.start( 12, 0, 20 );
+    CHECK( !matcher.matchesReported( 13 ) );
+    CHECK( !matcher.matches( 1040, 13, 2000 ) );
+}
+
+void testSteps()
+{
+    SeekMatcher matcher;
+    matcher.start( 10, 3, 20 );
+
+    //every step displays one frame, only the last one is the seeked one, whatever its time
+    CHECK( !matcher.matches( 1000, 11, 1000 ) );
+    CHECK( !matcher.matches( 1000, 12, 1000 ) );
+    CHECK( matcher.matches( 0, 13, 1000 ) );
+
+    //steps are matched only by frames
+    matcher.timeReported( 1000, 1000 );
+    CHECK( !matcher.matchesReported( 12 ) );
+}
+
+}
+
+int main()
+{
+    testStaleFrames();
+    testTolerance();
+    testReportedTime();
+    testSteps();
+
+    return checksResult( "seek_matcher_test" );
+}